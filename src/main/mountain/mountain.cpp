@@ -120,7 +120,7 @@ float rand01() {
 void Mountain::AddLights()
 {
     center = new GameObject(Assets::meshes["Default/Sphere"], glm::vec3(0, 15, 0));
-    center->angularVelocity = glm::vec3(0, 0.25, 0);
+    center->SetAngularVelocity(glm::vec3(0, 0.25, 0));
 
     defferedRendering = true;
 
@@ -168,6 +168,8 @@ void Mountain::SetupScene() {
     ground->material.SetFloat("LENGTH", GROUND_L);
     ground->material.SetTexture("PERLIN_NOISE", Assets::textures["PerlinNoise"]);
     ground->material.texture = Assets::textures["Mountain"];
+    // the terrain is generated in Mountain.GS, the canal reaches up to y = 65
+    ground->SetLocalBounds(AABB(glm::vec3(-GROUND_W / 2, 0, -GROUND_L / 2), glm::vec3(GROUND_W / 2, 70, GROUND_L / 2)));
 
     // skybox
     GameObject *skybox = new GameObject(Assets::meshes["Default/Cube"], glm::vec3(0, 50, 0), glm::vec3(1200));
@@ -0,0 +1,246 @@
+#include "aabbtree.h"
+
+using namespace engine;
+
+AABBTree::AABBTree()
+{
+    nodes.reserve(64);
+}
+
+float AABBTree::SurfaceArea(const AABB &box)
+{
+    glm::vec3 size = box.max - box.min;
+    return 2 * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+AABB AABBTree::Union(const AABB &a, const AABB &b)
+{
+    return AABB(glm::min(a.min, b.min), glm::max(a.max, b.max));
+}
+
+float AABBTree::RayBoxDistance(glm::vec3 origin, glm::vec3 invDirection, float maxDistance, const AABB &box)
+{
+    // slab test
+    glm::vec3 t1 = (box.min - origin) * invDirection;
+    glm::vec3 t2 = (box.max - origin) * invDirection;
+    glm::vec3 tMin = glm::min(t1, t2);
+    glm::vec3 tMax = glm::max(t1, t2);
+    float enter = glm::max(glm::max(tMin.x, tMin.y), glm::max(tMin.z, 0.0f));
+    float exit = glm::min(glm::min(tMax.x, tMax.y), glm::min(tMax.z, maxDistance));
+    // NaNs (origin on a slab plane of a flat box) make both comparisons false; treat as a hit
+    return enter <= exit || enter != enter || exit != exit ? enter : -1;
+}
+
+int AABBTree::AllocateNode()
+{
+    if (freeList == AABB_TREE_NULL_NODE) {
+        nodes.emplace_back();
+        freeList = (int)nodes.size() - 1;
+    }
+
+    int node = freeList;
+    freeList = nodes[node].next;
+    nodes[node] = Node();
+    nodes[node].height = 0;
+    return node;
+}
+
+void AABBTree::FreeNode(int node)
+{
+    nodes[node].next = freeList;
+    nodes[node].height = -1;
+    nodes[node].userData = nullptr;
+    freeList = node;
+}
+
+int AABBTree::Insert(const AABB &bounds, void *userData, uint32_t layerMask)
+{
+    int proxy = AllocateNode();
+    glm::vec3 fat = glm::vec3(margin);
+    nodes[proxy].bounds = AABB(bounds.min - fat, bounds.max + fat);
+    nodes[proxy].userData = userData;
+    nodes[proxy].layerMask = layerMask;
+    nodes[proxy].leafCount = 1;
+    InsertLeaf(proxy);
+    return proxy;
+}
+
+void AABBTree::Remove(int proxy)
+{
+    RemoveLeaf(proxy);
+    FreeNode(proxy);
+}
+
+bool AABBTree::Move(int proxy, const AABB &bounds)
+{
+    const AABB &fatBounds = nodes[proxy].bounds;
+    if (fatBounds.Contains(bounds.min) && fatBounds.Contains(bounds.max)) {
+        // still inside; but if the object shrank a lot, the fat bounds are too loose
+        glm::vec3 slack = glm::vec3(4 * margin);
+        AABB largeBounds(bounds.min - slack, bounds.max + slack);
+        if (largeBounds.Contains(fatBounds.min) && largeBounds.Contains(fatBounds.max))
+            return false;
+    }
+
+    RemoveLeaf(proxy);
+    glm::vec3 fat = glm::vec3(margin);
+    nodes[proxy].bounds = AABB(bounds.min - fat, bounds.max + fat);
+    InsertLeaf(proxy);
+    return true;
+}
+
+void AABBTree::SetLayerMask(int proxy, uint32_t layerMask)
+{
+    nodes[proxy].layerMask = layerMask;
+    RefreshAncestors(nodes[proxy].parent);
+}
+
+void AABBTree::Refresh(int node)
+{
+    Node &n = nodes[node];
+    const Node &child1 = nodes[n.child1];
+    const Node &child2 = nodes[n.child2];
+    n.bounds = Union(child1.bounds, child2.bounds);
+    n.height = 1 + glm::max(child1.height, child2.height);
+    n.leafCount = child1.leafCount + child2.leafCount;
+    n.layerMask = child1.layerMask | child2.layerMask;
+}
+
+void AABBTree::RefreshAncestors(int node)
+{
+    while (node != AABB_TREE_NULL_NODE) {
+        node = Balance(node);
+        Refresh(node);
+        node = nodes[node].parent;
+    }
+}
+
+void AABBTree::InsertLeaf(int leaf)
+{
+    if (root == AABB_TREE_NULL_NODE) {
+        root = leaf;
+        nodes[root].parent = AABB_TREE_NULL_NODE;
+        return;
+    }
+
+    // find the best sibling using the surface area heuristic
+    AABB leafBounds = nodes[leaf].bounds;
+    int index = root;
+    while (!nodes[index].IsLeaf()) {
+        const Node &node = nodes[index];
+        float area = SurfaceArea(node.bounds);
+        float combinedArea = SurfaceArea(Union(node.bounds, leafBounds));
+
+        // cost of creating a new parent for this node and the new leaf
+        float cost = 2 * combinedArea;
+        // minimum cost of pushing the leaf further down the tree
+        float inheritanceCost = 2 * (combinedArea - area);
+
+        float costs[2];
+        int children[2] = { node.child1, node.child2 };
+        for (int i = 0; i < 2; ++i) {
+            const Node &child = nodes[children[i]];
+            float newArea = SurfaceArea(Union(leafBounds, child.bounds));
+            costs[i] = (child.IsLeaf() ? newArea : newArea - SurfaceArea(child.bounds)) + inheritanceCost;
+        }
+
+        if (cost < costs[0] && cost < costs[1])
+            break;
+        index = costs[0] < costs[1] ? children[0] : children[1];
+    }
+    int sibling = index;
+
+    // create a new parent for the sibling and the leaf
+    int oldParent = nodes[sibling].parent;
+    int newParent = AllocateNode();
+    nodes[newParent].parent = oldParent;
+    nodes[newParent].child1 = sibling;
+    nodes[newParent].child2 = leaf;
+    nodes[sibling].parent = newParent;
+    nodes[leaf].parent = newParent;
+    Refresh(newParent);
+
+    if (oldParent != AABB_TREE_NULL_NODE) {
+        if (nodes[oldParent].child1 == sibling)
+            nodes[oldParent].child1 = newParent;
+        else
+            nodes[oldParent].child2 = newParent;
+    } else {
+        root = newParent;
+    }
+
+    RefreshAncestors(oldParent);
+}
+
+void AABBTree::RemoveLeaf(int leaf)
+{
+    if (leaf == root) {
+        root = AABB_TREE_NULL_NODE;
+        return;
+    }
+
+    int parent = nodes[leaf].parent;
+    int grandParent = nodes[parent].parent;
+    int sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+
+    if (grandParent != AABB_TREE_NULL_NODE) {
+        if (nodes[grandParent].child1 == parent)
+            nodes[grandParent].child1 = sibling;
+        else
+            nodes[grandParent].child2 = sibling;
+        nodes[sibling].parent = grandParent;
+        FreeNode(parent);
+        RefreshAncestors(grandParent);
+    } else {
+        root = sibling;
+        nodes[sibling].parent = AABB_TREE_NULL_NODE;
+        FreeNode(parent);
+    }
+    nodes[leaf].parent = AABB_TREE_NULL_NODE;
+}
+
+// rotates the tree if the subtree rooted at a is imbalanced; returns the new subtree root
+int AABBTree::Balance(int a)
+{
+    if (nodes[a].IsLeaf() || nodes[a].height < 2)
+        return a;
+
+    int b = nodes[a].child1;
+    int c = nodes[a].child2;
+    int balance = nodes[c].height - nodes[b].height;
+    if (balance >= -1 && balance <= 1)
+        return a;
+
+    // the taller child gets promoted
+    int up = balance > 1 ? c : b;
+    int f = nodes[up].child1;
+    int g = nodes[up].child2;
+
+    nodes[up].child1 = a;
+    nodes[up].parent = nodes[a].parent;
+    nodes[a].parent = up;
+
+    int upParent = nodes[up].parent;
+    if (upParent != AABB_TREE_NULL_NODE) {
+        if (nodes[upParent].child1 == a)
+            nodes[upParent].child1 = up;
+        else
+            nodes[upParent].child2 = up;
+    } else {
+        root = up;
+    }
+
+    // the taller grandchild stays under the promoted node, the other one goes to a
+    int keep = nodes[f].height > nodes[g].height ? f : g;
+    int give = keep == f ? g : f;
+    nodes[up].child2 = keep;
+    if (up == c)
+        nodes[a].child2 = give;
+    else
+        nodes[a].child1 = give;
+    nodes[give].parent = a;
+
+    Refresh(a);
+    Refresh(up);
+    return up;
+}
@@ -0,0 +1,184 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include "bounds.h"
+
+#define AABB_TREE_NULL_NODE (-1)
+
+namespace engine
+{
+    // A dynamic AABB tree (in the style of Box2D's b2DynamicTree). Leaves store fattened
+    // bounds so that small movements don't require touching the tree; moving a proxy out
+    // of its fat bounds removes and reinserts it, and the tree is kept balanced with AVL
+    // rotations. Every node also stores the union of the layer masks in its subtree, so
+    // queries filtered by a layer mask skip whole subtrees.
+    class AABBTree
+    {
+    public:
+        AABBTree();
+
+        // returns the id of the new proxy
+        int Insert(const AABB &bounds, void *userData, uint32_t layerMask);
+        void Remove(int proxy);
+        // returns true if the proxy had to be reinserted
+        bool Move(int proxy, const AABB &bounds);
+        void SetLayerMask(int proxy, uint32_t layerMask);
+
+        const AABB &GetFatBounds(int proxy) const { return nodes[proxy].bounds; }
+        void *GetUserData(int proxy) const { return nodes[proxy].userData; }
+        uint32_t GetLayerMask(int proxy) const { return nodes[proxy].layerMask; }
+        int GetProxyCount() const { return root == AABB_TREE_NULL_NODE ? 0 : nodes[root].leafCount; }
+        int GetHeight() const { return root == AABB_TREE_NULL_NODE ? 0 : nodes[root].height; }
+
+        // Generic traversal: test(bounds) decides whether a node may contain results and
+        // callback(proxy) is called for every leaf passing the test; it returns false to stop.
+        // If rejected is given, it is incremented with the number of leaves matching the
+        // layer mask that were skipped because test() failed on one of their ancestors.
+        template <typename Test, typename Callback>
+        void Traverse(uint32_t layerMask, Test test, Callback callback, int *rejected = nullptr) const;
+
+        template <typename Callback>
+        void Query(const AABB &box, uint32_t layerMask, Callback callback) const
+        {
+            Traverse(layerMask, [&](const AABB &bounds) { return bounds.Overlaps(box); }, callback);
+        }
+
+        template <typename Callback>
+        void Query(glm::vec3 point, uint32_t layerMask, Callback callback) const
+        {
+            Traverse(layerMask, [&](const AABB &bounds) { return bounds.Contains(point); }, callback);
+        }
+
+        template <typename Callback>
+        void Query(const Frustum &frustum, uint32_t layerMask, Callback callback, int *rejected = nullptr) const
+        {
+            Traverse(layerMask, [&](const AABB &bounds) { return frustum.Intersects(bounds); },
+                     callback, rejected);
+        }
+
+        // callback(proxy, maxDistance) returns the new maximum distance along the ray:
+        // return maxDistance to keep going, a smaller value to clip the ray, 0 to stop
+        template <typename Callback>
+        void RayCast(glm::vec3 origin, glm::vec3 direction, float maxDistance,
+                     uint32_t layerMask, Callback callback) const
+        {
+            SphereCast(origin, 0, direction, maxDistance, layerMask, callback);
+        }
+        // the same for a sphere moving along the ray: the bounds are grown by its radius
+        template <typename Callback>
+        void SphereCast(glm::vec3 origin, float radius, glm::vec3 direction, float maxDistance,
+                        uint32_t layerMask, Callback callback) const;
+
+        // distance along the ray at which it enters the box, or -1 if it misses it
+        static float RayBoxDistance(glm::vec3 origin, glm::vec3 invDirection, float maxDistance, const AABB &box);
+
+        // how much the leaves are fattened in each direction
+        float margin = 0.1f;
+
+    private:
+        struct Node {
+            AABB bounds;
+            void *userData = nullptr;
+            int parent = AABB_TREE_NULL_NODE;
+            int next = AABB_TREE_NULL_NODE;  // free list
+            int child1 = AABB_TREE_NULL_NODE;
+            int child2 = AABB_TREE_NULL_NODE;
+            int height = -1;  // 0 for leaves, -1 for free nodes
+            int leafCount = 0;
+            uint32_t layerMask = 0;
+
+            bool IsLeaf() const { return child1 == AABB_TREE_NULL_NODE; }
+        };
+
+        // fixed-size stack for traversals, spilling to the heap only for degenerate trees
+        struct Stack {
+            int inlineData[64];
+            std::vector<int> heapData;
+            int size = 0;
+
+            void Push(int value)
+            {
+                if (size < 64) inlineData[size] = value;
+                else heapData.push_back(value);
+                ++size;
+            }
+            int Pop()
+            {
+                --size;
+                if (size < 64) return inlineData[size];
+                int value = heapData.back();
+                heapData.pop_back();
+                return value;
+            }
+            bool Empty() const { return size == 0; }
+        };
+
+        int AllocateNode();
+        void FreeNode(int node);
+        void InsertLeaf(int leaf);
+        void RemoveLeaf(int leaf);
+        int Balance(int node);
+        void Refresh(int node);  // recomputes an internal node from its children
+        void RefreshAncestors(int node);
+        static float SurfaceArea(const AABB &box);
+        static AABB Union(const AABB &a, const AABB &b);
+
+        std::vector<Node> nodes;
+        int root = AABB_TREE_NULL_NODE;
+        int freeList = AABB_TREE_NULL_NODE;
+    };
+
+    template <typename Test, typename Callback>
+    void AABBTree::Traverse(uint32_t layerMask, Test test, Callback callback, int *rejected) const
+    {
+        if (root == AABB_TREE_NULL_NODE)
+            return;
+
+        Stack stack;
+        stack.Push(root);
+        while (!stack.Empty()) {
+            const Node &node = nodes[stack.Pop()];
+            if ((node.layerMask & layerMask) == 0)
+                continue;
+            if (!test(node.bounds)) {
+                if (rejected) *rejected += node.leafCount;
+                continue;
+            }
+
+            if (node.IsLeaf()) {
+                if (!callback((int)(&node - nodes.data())))
+                    return;
+            } else {
+                stack.Push(node.child1);
+                stack.Push(node.child2);
+            }
+        }
+    }
+
+    template <typename Callback>
+    void AABBTree::SphereCast(glm::vec3 origin, float radius, glm::vec3 direction, float maxDistance,
+                              uint32_t layerMask, Callback callback) const
+    {
+        if (root == AABB_TREE_NULL_NODE)
+            return;
+
+        glm::vec3 invDirection = 1.0f / direction;  // infinities are fine for the slab test
+        Stack stack;
+        stack.Push(root);
+        while (!stack.Empty() && maxDistance > 0) {
+            const Node &node = nodes[stack.Pop()];
+            if ((node.layerMask & layerMask) == 0)
+                continue;
+            AABB bounds = AABB(node.bounds.min - radius, node.bounds.max + radius);
+            if (RayBoxDistance(origin, invDirection, maxDistance, bounds) < 0)
+                continue;
+
+            if (node.IsLeaf()) {
+                maxDistance = callback((int)(&node - nodes.data()), maxDistance);
+            } else {
+                stack.Push(node.child1);
+                stack.Push(node.child2);
+            }
+        }
+    }
+}
@@ -0,0 +1,112 @@
+#include <new>
+#include <cstdlib>
+#include <iostream>
+#include "allocationtracker.h"
+
+using namespace engine;
+
+// all constant-initialized, so allocations made by static constructors are counted too
+std::atomic<AllocationSubsystem> AllocationTracker::current(ALLOCATION_OTHER);
+std::atomic<size_t> AllocationTracker::counts[ALLOCATION_SUBSYSTEMS];
+std::atomic<size_t> AllocationTracker::bytes[ALLOCATION_SUBSYSTEMS];
+AllocationStats AllocationTracker::lastFrame[ALLOCATION_SUBSYSTEMS];
+
+bool AllocationTracker::IsEnabled()
+{
+#if defined(WIST_TRACK_ALLOCATIONS)
+    return true;
+#else
+    return false;
+#endif
+}
+
+void AllocationTracker::Record(size_t size)
+{
+    int subsystem = current.load(std::memory_order_relaxed);
+    counts[subsystem].fetch_add(1, std::memory_order_relaxed);
+    bytes[subsystem].fetch_add(size, std::memory_order_relaxed);
+}
+
+void AllocationTracker::FrameStart()
+{
+    for (int i = 0; i < ALLOCATION_SUBSYSTEMS; ++i) {
+        lastFrame[i].count = counts[i].exchange(0, std::memory_order_relaxed);
+        lastFrame[i].bytes = bytes[i].exchange(0, std::memory_order_relaxed);
+    }
+}
+
+AllocationStats AllocationTracker::GetFrameStats(AllocationSubsystem subsystem)
+{
+    return lastFrame[subsystem];
+}
+
+AllocationStats AllocationTracker::GetFrameTotal()
+{
+    AllocationStats total;
+    for (int i = 0; i < ALLOCATION_SUBSYSTEMS; ++i) {
+        total.count += lastFrame[i].count;
+        total.bytes += lastFrame[i].bytes;
+    }
+    return total;
+}
+
+const char *AllocationTracker::GetName(AllocationSubsystem subsystem)
+{
+    static const char *names[ALLOCATION_SUBSYSTEMS] = {
+        "other", "updates", "tasks", "simulation", "collisions", "physics", "rendering"
+    };
+    return names[subsystem];
+}
+
+void AllocationTracker::PrintStats()
+{
+    if (!IsEnabled()) {
+        std::cout << "allocation tracking is off, build with WIST_TRACK_ALLOCATIONS\n";
+        return;
+    }
+    for (int i = 0; i < ALLOCATION_SUBSYSTEMS; ++i) {
+        AllocationStats stats = lastFrame[i];
+        if (stats.count > 0) {
+            std::cout << "allocations " << GetName((AllocationSubsystem)i) << ": "
+                      << stats.count << " (" << stats.bytes << "B)\n";
+        }
+    }
+}
+
+#if defined(WIST_TRACK_ALLOCATIONS)
+// The replaced global operator new and delete; the nothrow forms end up in these.
+// Aligned allocations aren't counted.
+void *operator new(size_t size)
+{
+    AllocationTracker::Record(size);
+    void *block = std::malloc(size > 0 ? size : 1);
+    if (block == nullptr)
+        throw std::bad_alloc();
+    return block;
+}
+
+void *operator new[](size_t size)
+{
+    return ::operator new(size);
+}
+
+void operator delete(void *block) noexcept
+{
+    std::free(block);
+}
+
+void operator delete[](void *block) noexcept
+{
+    std::free(block);
+}
+
+void operator delete(void *block, size_t) noexcept
+{
+    std::free(block);
+}
+
+void operator delete[](void *block, size_t) noexcept
+{
+    std::free(block);
+}
+#endif
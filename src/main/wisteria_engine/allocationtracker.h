@@ -0,0 +1,78 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+
+namespace engine
+{
+    // the parts of a frame the allocations are counted for, see AllocationTracker::Scope
+    enum AllocationSubsystem {
+        ALLOCATION_OTHER,  // outside of the scene's frame: the framework, input, the game's own code
+        ALLOCATION_UPDATES,  // the objects' Tick, per step and per frame
+        ALLOCATION_TASKS,
+        ALLOCATION_SIMULATION,  // transforms, motion, the scene tree
+        ALLOCATION_COLLISIONS,
+        ALLOCATION_PHYSICS,
+        ALLOCATION_RENDERING,
+        ALLOCATION_SUBSYSTEMS  // the number of subsystems
+    };
+
+    struct AllocationStats {
+        size_t count = 0;
+        size_t bytes = 0;
+    };
+
+    // Counts the general heap allocations (the global operator new) of each frame, per
+    // subsystem. Only built with WIST_TRACK_ALLOCATIONS, which replaces the global operator
+    // new; otherwise the stats stay at zero. Once a scene settles, its frames should not
+    // allocate at all, which a game can check with
+    //     assert(AllocationTracker::GetFrameTotal().count == 0);
+    // The subsystem is the one of the main thread: the job system's workers only run
+    // inside a part of the frame, their allocations are counted for that part.
+    class AllocationTracker
+    {
+    public:
+        static bool IsEnabled();
+        // the counts so far become those of the last frame, and start over
+        static void FrameStart();
+        // for the last frame
+        static AllocationStats GetFrameStats(AllocationSubsystem subsystem);
+        static AllocationStats GetFrameTotal();
+        static const char *GetName(AllocationSubsystem subsystem);
+        static void PrintStats();
+
+        // called by the replaced operator new
+        static void Record(size_t size);
+
+        // counts the allocations of its lifetime for the subsystem, then goes back to the
+        // previous one
+        class Scope
+        {
+        public:
+            explicit Scope(AllocationSubsystem subsystem)
+            {
+#if defined(WIST_TRACK_ALLOCATIONS)
+                previous = current.exchange(subsystem, std::memory_order_relaxed);
+#else
+                (void)subsystem;
+#endif
+            }
+            ~Scope()
+            {
+#if defined(WIST_TRACK_ALLOCATIONS)
+                current.store(previous, std::memory_order_relaxed);
+#endif
+            }
+            Scope(const Scope &) = delete;
+            Scope &operator=(const Scope &) = delete;
+
+        private:
+            AllocationSubsystem previous = ALLOCATION_OTHER;
+        };
+
+    private:
+        static std::atomic<AllocationSubsystem> current;
+        static std::atomic<size_t> counts[ALLOCATION_SUBSYSTEMS];
+        static std::atomic<size_t> bytes[ALLOCATION_SUBSYSTEMS];
+        static AllocationStats lastFrame[ALLOCATION_SUBSYSTEMS];
+    };
+}
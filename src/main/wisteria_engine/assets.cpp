@@ -7,4 +7,7 @@ std::unordered_map<std::string, Mesh *> Assets::meshes;
 std::unordered_map<std::string, std::string> Assets::paths;
 std::unordered_map<std::string, Shader *> Assets::shaders;
 std::unordered_map<std::string, engine::Material> Assets::materials;
-std::unordered_map<std::string, Texture *> Assets::textures;
\ No newline at end of file
+std::unordered_map<std::string, Texture *> Assets::textures;
+std::unordered_map<Mesh *, AABB> Assets::meshBounds;
+std::unordered_map<Mesh *, TriangleBVH> Assets::meshBVHs;
+std::unordered_map<Texture *, Heightfield> Assets::heightfields;
\ No newline at end of file
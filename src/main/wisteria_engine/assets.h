@@ -8,6 +8,9 @@
 #include "meshplusplus.h"
 #include "material.h"
 #include "texture.h"
+#include "bounds.h"
+#include "trianglebvh.h"
+#include "heightfield.h"
 
 // to whoever wrote gfxc framework:
 // seriously, did you never learn to add parantheses around macro definitions?
@@ -24,6 +27,58 @@ namespace engine
             MeshPlusPlus *mesh = new MeshPlusPlus(name);
             mesh->LoadMesh(PATH_JOIN(lookupDirectory, fileLocation.c_str()), fileName.c_str());
             meshes[name] = mesh;
+            GetMeshBounds(mesh);
+        }
+
+        // local space bounds of a mesh, computed once from its CPU-side vertex data
+        static const AABB &GetMeshBounds(Mesh *mesh)
+        {
+            auto it = meshBounds.find(mesh);
+            if (it != meshBounds.end())
+                return it->second;
+
+            AABB bounds;
+            if (!mesh->vertices.empty())
+                bounds = AABB::FromPoints(&mesh->vertices[0].position, mesh->vertices.size(), sizeof(VertexFormat));
+            else if (!mesh->positions.empty())
+                bounds = AABB::FromPoints(mesh->positions.data(), mesh->positions.size());
+            return meshBounds[mesh] = bounds;
+        }
+
+        // triangle BVH of a mesh, built once from its CPU-side vertex data, on first use
+        static const TriangleBVH *GetMeshBVH(Mesh *mesh)
+        {
+            auto it = meshBVHs.find(mesh);
+            if (it != meshBVHs.end())
+                return &it->second;
+
+            TriangleBVH &bvh = meshBVHs[mesh];
+            if (!mesh->vertices.empty())
+                bvh.Build(&mesh->vertices[0].position, mesh->vertices.size(), sizeof(VertexFormat),
+                          mesh->indices.data(), mesh->indices.size());
+            else if (!mesh->positions.empty())
+                bvh.Build(mesh->positions.data(), mesh->positions.size(), sizeof(glm::vec3),
+                          mesh->indices.data(), mesh->indices.size());
+            return &bvh;
+        }
+
+        // heightfield of a heightmap (its red channel, from 0 to 1), built once on first use;
+        // the rows of the texture go along z
+        static const Heightfield *GetHeightfield(Texture *heightmap)
+        {
+            auto it = heightfields.find(heightmap);
+            if (it != heightfields.end())
+                return &it->second;
+
+            Heightfield &field = heightfields[heightmap];
+            field.Build(heightmap->GetRawTextureData(), heightmap->GetWidth(), heightmap->GetHeight(), 3);
+            return &field;
+        }
+
+        // overrides the bounds of a mesh whose geometry is generated on the GPU
+        static void SetMeshBounds(Mesh *mesh, AABB bounds)
+        {
+            meshBounds[mesh] = bounds;
         }
 
         static void AddPath(const std::string &name, const std::string &path)
@@ -116,5 +171,8 @@ namespace engine
         static std::unordered_map<std::string, Shader *> shaders;
         static std::unordered_map<std::string, Material> materials;
         static std::unordered_map<std::string, Texture *> textures;
+        static std::unordered_map<Mesh *, AABB> meshBounds;
+        static std::unordered_map<Mesh *, TriangleBVH> meshBVHs;
+        static std::unordered_map<Texture *, Heightfield> heightfields;
     };
 }
\ No newline at end of file
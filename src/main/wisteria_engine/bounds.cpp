@@ -0,0 +1,135 @@
+#include "bounds.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+    #include <emmintrin.h>
+    #define WIST_FRUSTUM_SSE
+#elif defined(__ARM_NEON)
+    #include <arm_neon.h>
+    #define WIST_FRUSTUM_NEON
+#endif
+
+using namespace engine;
+
+AABB AABB::Transformed(const glm::mat4 &matrix) const
+{
+    if (IsEmpty())
+        return AABB();
+
+    // Arvo's method: transform the center, then project the extents on the world axes
+    glm::vec3 center = matrix * glm::vec4(Center(), 1);
+    glm::vec3 extents = Extents();
+    glm::vec3 worldExtents = glm::abs(glm::vec3(matrix[0])) * extents.x +
+                             glm::abs(glm::vec3(matrix[1])) * extents.y +
+                             glm::abs(glm::vec3(matrix[2])) * extents.z;
+    return AABB(center - worldExtents, center + worldExtents);
+}
+
+AABB AABB::FromPoints(const glm::vec3 *points, size_t count, size_t stride)
+{
+    AABB box;
+    const char *data = reinterpret_cast<const char *>(points);
+    for (size_t i = 0; i < count; ++i)
+        box.Expand(*reinterpret_cast<const glm::vec3 *>(data + i * stride));
+    return box;
+}
+
+Frustum Frustum::FromMatrix(const glm::mat4 &m)
+{
+    // Gribb & Hartmann; glm matrices are column major, so row i is (m[0][i], ..., m[3][i])
+    glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+    glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+    glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+    glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+    glm::vec4 planes[6] = {
+        row3 + row0,  // left
+        row3 - row0,  // right
+        row3 + row1,  // bottom
+        row3 - row1,  // top
+        row3 + row2,  // near
+        row3 - row2,  // far
+    };
+
+    Frustum frustum;
+    for (int i = 0; i < 8; ++i) {
+        glm::vec4 plane = glm::vec4(0, 0, 0, 1);  // padding: 0 * x + 1 >= 0 always holds
+        if (i < 6) {
+            float length = glm::length(glm::vec3(planes[i]));
+            plane = length > 0 ? planes[i] / length : plane;
+        }
+        frustum.nx[i] = plane.x;
+        frustum.ny[i] = plane.y;
+        frustum.nz[i] = plane.z;
+        frustum.d[i] = plane.w;
+    }
+    return frustum;
+}
+
+AABB Frustum::GetBounds(const glm::mat4 &viewProjection)
+{
+    glm::mat4 inverse = glm::inverse(viewProjection);
+    AABB box;
+    for (int corner = 0; corner < 8; ++corner) {
+        glm::vec4 ndc = glm::vec4(corner & 1 ? 1 : -1, corner & 2 ? 1 : -1, corner & 4 ? 1 : -1, 1);
+        glm::vec4 world = inverse * ndc;
+        box.Expand(glm::vec3(world) / world.w);
+    }
+    return box;
+}
+
+// a box is outside if, for any plane, its center is further behind the plane than
+// the projection of its extents on the plane normal
+bool Frustum::Intersects(const AABB &box) const
+{
+    if (box.IsEmpty())
+        return false;
+
+    glm::vec3 c = box.Center();
+    glm::vec3 e = box.Extents();
+
+#if defined(WIST_FRUSTUM_SSE)
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    __m128 cx = _mm_set1_ps(c.x), cy = _mm_set1_ps(c.y), cz = _mm_set1_ps(c.z);
+    __m128 ex = _mm_set1_ps(e.x), ey = _mm_set1_ps(e.y), ez = _mm_set1_ps(e.z);
+    for (int i = 0; i < 8; i += 4) {
+        __m128 px = _mm_load_ps(nx + i), py = _mm_load_ps(ny + i), pz = _mm_load_ps(nz + i);
+        __m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, cx), _mm_mul_ps(py, cy)),
+                                 _mm_add_ps(_mm_mul_ps(pz, cz), _mm_load_ps(d + i)));
+        __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_and_ps(px, absMask), ex),
+                                              _mm_mul_ps(_mm_and_ps(py, absMask), ey)),
+                                   _mm_mul_ps(_mm_and_ps(pz, absMask), ez));
+        if (_mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(dist, radius), _mm_setzero_ps())))
+            return false;
+    }
+    return true;
+#elif defined(WIST_FRUSTUM_NEON)
+    for (int i = 0; i < 8; i += 4) {
+        float32x4_t px = vld1q_f32(nx + i), py = vld1q_f32(ny + i), pz = vld1q_f32(nz + i);
+        float32x4_t dist = vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(vld1q_f32(d + i), px, c.x), py, c.y), pz, c.z);
+        float32x4_t radius = vmlaq_n_f32(vmlaq_n_f32(vmulq_n_f32(vabsq_f32(px), e.x),
+                                                     vabsq_f32(py), e.y), vabsq_f32(pz), e.z);
+        uint32x4_t outside = vcltq_f32(vaddq_f32(dist, radius), vdupq_n_f32(0));
+        if (vgetq_lane_u32(outside, 0) | vgetq_lane_u32(outside, 1) |
+            vgetq_lane_u32(outside, 2) | vgetq_lane_u32(outside, 3))
+            return false;
+    }
+    return true;
+#else
+    for (int i = 0; i < 6; ++i) {
+        float dist = nx[i] * c.x + ny[i] * c.y + nz[i] * c.z + d[i];
+        float radius = glm::abs(nx[i]) * e.x + glm::abs(ny[i]) * e.y + glm::abs(nz[i]) * e.z;
+        if (dist + radius < 0)
+            return false;
+    }
+    return true;
+#endif
+}
+
+bool Frustum::Intersects(const BoundingSphere &sphere) const
+{
+    for (int i = 0; i < 6; ++i) {
+        float dist = nx[i] * sphere.center.x + ny[i] * sphere.center.y + nz[i] * sphere.center.z + d[i];
+        if (dist < -sphere.radius)
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <cfloat>
+#include "utils/glm_utils.h"
+
+namespace engine
+{
+    struct BoundingSphere {
+        glm::vec3 center = glm::vec3(0);
+        float radius = 0;
+    };
+
+    // axis aligned bounding box; a default constructed box is empty (min > max)
+    struct AABB {
+        AABB() = default;
+        AABB(glm::vec3 min, glm::vec3 max) : min(min), max(max) {}
+
+        glm::vec3 min = glm::vec3(FLT_MAX);
+        glm::vec3 max = glm::vec3(-FLT_MAX);
+
+        bool IsEmpty() const { return min.x > max.x || min.y > max.y || min.z > max.z; }
+        bool operator==(const AABB &other) const { return min == other.min && max == other.max; }
+        bool operator!=(const AABB &other) const { return !(*this == other); }
+        glm::vec3 Center() const { return (min + max) * 0.5f; }
+        glm::vec3 Extents() const { return (max - min) * 0.5f; }  // half size
+
+        void Expand(glm::vec3 point) { min = glm::min(min, point); max = glm::max(max, point); }
+        void Expand(const AABB &other) { min = glm::min(min, other.min); max = glm::max(max, other.max); }
+
+        bool Contains(glm::vec3 point) const
+        {
+            return point.x >= min.x && point.x <= max.x &&
+                   point.y >= min.y && point.y <= max.y &&
+                   point.z >= min.z && point.z <= max.z;
+        }
+        bool Overlaps(const AABB &other) const
+        {
+            return min.x <= other.max.x && max.x >= other.min.x &&
+                   min.y <= other.max.y && max.y >= other.min.y &&
+                   min.z <= other.max.z && max.z >= other.min.z;
+        }
+
+        // the smallest AABB containing this box after the given affine transformation
+        AABB Transformed(const glm::mat4 &matrix) const;
+        BoundingSphere GetBoundingSphere() const { return { Center(), glm::length(Extents()) }; }
+
+        // stride is in bytes, so that this works directly on interleaved vertex data
+        static AABB FromPoints(const glm::vec3 *points, size_t count, size_t stride = sizeof(glm::vec3));
+    };
+
+    // The 6 planes of a view frustum, pointing inwards. They are kept in SoA layout and
+    // padded to 8 planes that never reject anything, so that a box can be tested against
+    // 4 planes at a time with SSE/NEON.
+    struct Frustum {
+        alignas(16) float nx[8];
+        alignas(16) float ny[8];
+        alignas(16) float nz[8];
+        alignas(16) float d[8];
+
+        // the planes are extracted from the combined projection * view matrix
+        static Frustum FromMatrix(const glm::mat4 &viewProjection);
+        // bounds of the 8 corners of the frustum given by the same matrix
+        static AABB GetBounds(const glm::mat4 &viewProjection);
+
+        bool Intersects(const AABB &box) const;
+        bool Intersects(const BoundingSphere &sphere) const;
+    };
+}
@@ -0,0 +1,221 @@
+#include <algorithm>
+#include "broadphase.h"
+
+#define GRID_CELL_BITS 21
+#define GRID_CELL_LIMIT ((1 << (GRID_CELL_BITS - 1)) - 1)
+
+using namespace engine;
+
+int Broadphase::Insert(const AABB &bounds, void *userData, uint32_t layerMask)
+{
+    int proxy = freeList;
+    if (proxy == BROADPHASE_NULL_PROXY) {
+        proxy = (int)proxies.size();
+        proxies.push_back(Proxy());
+    } else {
+        freeList = proxies[proxy].next;
+    }
+
+    Proxy &p = proxies[proxy];
+    p.bounds = bounds;
+    p.userData = userData;
+    p.layerMask = layerMask;
+    p.pairMask = 0;
+    p.next = BROADPHASE_NULL_PROXY;
+    p.live = true;
+    OnInsert(proxy);
+    return proxy;
+}
+
+void Broadphase::Remove(int proxy)
+{
+    FreeProxy(proxy);
+}
+
+void Broadphase::FreeProxy(int proxy)
+{
+    proxies[proxy].live = false;
+    proxies[proxy].userData = nullptr;
+    proxies[proxy].next = freeList;
+    freeList = proxy;
+}
+
+void Broadphase::Move(int proxy, const AABB &bounds, uint32_t layerMask)
+{
+    proxies[proxy].bounds = bounds;
+    proxies[proxy].layerMask = layerMask;
+}
+
+void Broadphase::ComputePairMasks(const uint32_t pairMasks[32])
+{
+    for (auto &proxy : proxies) {
+        proxy.pairMask = 0;
+        if (!proxy.live)
+            continue;
+        for (int layer = 0; layer < 32; ++layer) {
+            if (proxy.layerMask & (1u << layer))
+                proxy.pairMask |= pairMasks[layer];
+        }
+    }
+}
+
+void SweepAndPrune::OnInsert(int proxy)
+{
+    // sorted into place by the next FindPairs
+    order.push_back(proxy);
+}
+
+void SweepAndPrune::Remove(int proxy)
+{
+    // the proxy id can only be reused once it is out of order, see FindPairs
+    proxies[proxy].live = false;
+    proxies[proxy].userData = nullptr;
+    removed.push_back(proxy);
+}
+
+void SweepAndPrune::SortOrder()
+{
+    // insertion sort: close to linear on the nearly sorted order of the last step
+    int count = (int)order.size();
+    for (int i = 1; i < count; ++i) {
+        int proxy = order[i];
+        float key = proxies[proxy].bounds.min[axis];
+        int j = i - 1;
+        while (j >= 0 && proxies[order[j]].bounds.min[axis] > key) {
+            order[j + 1] = order[j];
+            --j;
+        }
+        order[j + 1] = proxy;
+    }
+}
+
+void SweepAndPrune::FindPairs(const uint32_t pairMasks[32], std::vector<std::pair<int, int>> &pairs)
+{
+    if (!removed.empty()) {
+        order.erase(std::remove_if(order.begin(), order.end(),
+                                   [this](int proxy) { return !proxies[proxy].live; }),
+                    order.end());
+        for (int proxy : removed)
+            FreeProxy(proxy);
+        removed.clear();
+    }
+
+    ComputePairMasks(pairMasks);
+    SortOrder();
+
+    glm::vec3 sum = glm::vec3(0), sumSquares = glm::vec3(0);
+    int count = (int)order.size();
+    for (int i = 0; i < count; ++i) {
+        const Proxy &a = proxies[order[i]];
+        glm::vec3 center = a.bounds.Center();
+        sum += center;
+        sumSquares += center * center;
+        // a proxy colliding with no layer can't be part of any pair, as the masks are symmetric
+        if (a.pairMask == 0)
+            continue;
+
+        float end = a.bounds.max[axis];
+        for (int j = i + 1; j < count; ++j) {
+            const Proxy &b = proxies[order[j]];
+            if (b.bounds.min[axis] > end)
+                break;
+            if (CanCollide(a, b) && a.bounds.Overlaps(b.bounds))
+                pairs.push_back({ order[i], order[j] });
+        }
+    }
+
+    // sweep along the axis with the largest variance next time; changing the axis
+    // costs one full sort, then the order is incremental again
+    if (count > 1) {
+        glm::vec3 variance = sumSquares - sum * sum / (float)count;
+        int newAxis = 0;
+        if (variance.y > variance[newAxis]) newAxis = 1;
+        if (variance.z > variance[newAxis]) newAxis = 2;
+        if (newAxis != axis) {
+            axis = newAxis;
+            std::sort(order.begin(), order.end(), [this](int a, int b) {
+                return proxies[a].bounds.min[axis] < proxies[b].bounds.min[axis];
+            });
+        }
+    }
+}
+
+glm::ivec3 UniformGrid::GetCell(glm::vec3 point) const
+{
+    glm::ivec3 cell = glm::ivec3(glm::floor(point / cellSize));
+    return glm::clamp(cell, glm::ivec3(-GRID_CELL_LIMIT), glm::ivec3(GRID_CELL_LIMIT));
+}
+
+uint64_t UniformGrid::PackCell(glm::ivec3 cell)
+{
+    const uint64_t mask = (1ull << GRID_CELL_BITS) - 1;
+    return ((uint64_t)(cell.x & mask) << (2 * GRID_CELL_BITS)) |
+           ((uint64_t)(cell.y & mask) << GRID_CELL_BITS) |
+           (uint64_t)(cell.z & mask);
+}
+
+void UniformGrid::FindPairs(const uint32_t pairMasks[32], std::vector<std::pair<int, int>> &pairs)
+{
+    ComputePairMasks(pairMasks);
+
+    entries.clear();
+    oversized.clear();
+    for (int proxy = 0; proxy < (int)proxies.size(); ++proxy) {
+        const Proxy &p = proxies[proxy];
+        if (!p.live || p.pairMask == 0 || p.bounds.IsEmpty())
+            continue;
+
+        glm::ivec3 minCell = GetCell(p.bounds.min), maxCell = GetCell(p.bounds.max);
+        glm::ivec3 size = maxCell - minCell + 1;
+        if ((int64_t)size.x * size.y * size.z > maxCellsPerProxy) {
+            oversized.push_back(proxy);
+            continue;
+        }
+        for (int x = minCell.x; x <= maxCell.x; ++x)
+            for (int y = minCell.y; y <= maxCell.y; ++y)
+                for (int z = minCell.z; z <= maxCell.z; ++z)
+                    entries.push_back({ PackCell(glm::ivec3(x, y, z)), proxy });
+    }
+
+    // sorting brings the proxies of each cell together, without any hash map
+    std::sort(entries.begin(), entries.end(), [](const CellEntry &a, const CellEntry &b) {
+        return a.cell < b.cell || (a.cell == b.cell && a.proxy < b.proxy);
+    });
+
+    for (size_t begin = 0; begin < entries.size();) {
+        size_t end = begin + 1;
+        while (end < entries.size() && entries[end].cell == entries[begin].cell)
+            ++end;
+
+        for (size_t i = begin; i < end; ++i) {
+            const Proxy &a = proxies[entries[i].proxy];
+            for (size_t j = i + 1; j < end; ++j) {
+                const Proxy &b = proxies[entries[j].proxy];
+                if (!CanCollide(a, b) || !a.bounds.Overlaps(b.bounds))
+                    continue;
+                // two proxies share every cell their overlap covers; only the cell with
+                // the lowest corner of the overlap reports them
+                glm::vec3 overlapMin = glm::max(a.bounds.min, b.bounds.min);
+                if (PackCell(GetCell(overlapMin)) == entries[begin].cell)
+                    pairs.push_back({ entries[i].proxy, entries[j].proxy });
+            }
+        }
+        begin = end;
+    }
+
+    // oversized proxies are tested against everything, each pair of them once
+    for (size_t i = 0; i < oversized.size(); ++i) {
+        const Proxy &a = proxies[oversized[i]];
+        for (int other = 0; other < (int)proxies.size(); ++other) {
+            const Proxy &b = proxies[other];
+            if (other == oversized[i] || !b.live || b.pairMask == 0)
+                continue;
+            // other oversized proxies are only tested from the first of the two
+            bool otherOversized = std::binary_search(oversized.begin(), oversized.end(), other);
+            if (otherOversized && other < oversized[i])
+                continue;
+            if (CanCollide(a, b) && a.bounds.Overlaps(b.bounds))
+                pairs.push_back({ oversized[i], other });
+        }
+    }
+}
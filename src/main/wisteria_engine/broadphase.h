@@ -0,0 +1,97 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include "bounds.h"
+
+#define BROADPHASE_NULL_PROXY (-1)
+
+namespace engine
+{
+    // A broadphase keeps the bounds of many colliders and finds the pairs whose bounds
+    // overlap, so that the narrowphase only runs on those. Proxies work like the ones
+    // of the AABBTree: Insert returns an id, which is then moved and removed.
+    class Broadphase
+    {
+    public:
+        virtual ~Broadphase() = default;
+
+        int Insert(const AABB &bounds, void *userData, uint32_t layerMask);
+        virtual void Remove(int proxy);
+        void Move(int proxy, const AABB &bounds, uint32_t layerMask);
+
+        void *GetUserData(int proxy) const { return proxies[proxy].userData; }
+        const AABB &GetBounds(int proxy) const { return proxies[proxy].bounds; }
+
+        // Fills pairs with every overlapping pair of proxies whose layers may collide:
+        // pairMasks[l] is the set of layers colliding with layer l, and must be symmetric.
+        // Every pair is reported once, the first proxy being the one found first.
+        virtual void FindPairs(const uint32_t pairMasks[32], std::vector<std::pair<int, int>> &pairs) = 0;
+
+    protected:
+        struct Proxy {
+            AABB bounds;
+            void *userData = nullptr;
+            uint32_t layerMask = 0;
+            uint32_t pairMask = 0;  // layers this proxy collides with, set by FindPairs
+            int next = BROADPHASE_NULL_PROXY;  // free list
+            bool live = false;
+        };
+
+        virtual void OnInsert(int /*proxy*/) {}
+        void FreeProxy(int proxy);
+        void ComputePairMasks(const uint32_t pairMasks[32]);
+        bool CanCollide(const Proxy &a, const Proxy &b) const { return (a.pairMask & b.layerMask) != 0; }
+
+        std::vector<Proxy> proxies;
+        int freeList = BROADPHASE_NULL_PROXY;
+    };
+
+    // Incremental sweep and prune: the proxies are kept sorted by their lower bound on
+    // one axis and swept in that order, testing each one only against the proxies
+    // starting before it ends. Between steps objects barely move, so the order of the
+    // previous step is nearly sorted and an insertion sort fixes it in about linear time.
+    // The sweep axis follows the axis along which the colliders are the most spread out.
+    class SweepAndPrune : public Broadphase
+    {
+    public:
+        void Remove(int proxy) override;
+        void FindPairs(const uint32_t pairMasks[32], std::vector<std::pair<int, int>> &pairs) override;
+
+    protected:
+        void OnInsert(int proxy) override;
+
+    private:
+        void SortOrder();
+
+        std::vector<int> order;  // proxies sorted by bounds.min[axis]
+        std::vector<int> removed;  // freed at the next FindPairs, once they left order
+        int axis = 0;
+    };
+
+    // Uniform spatial hash: every proxy is binned into the grid cells its bounds cover,
+    // and only proxies sharing a cell are tested. Works best when the colliders are
+    // about the size of a cell; proxies covering too many cells are tested against
+    // everything instead. Cell coordinates are limited to +-1M cells.
+    class UniformGrid : public Broadphase
+    {
+    public:
+        void FindPairs(const uint32_t pairMasks[32], std::vector<std::pair<int, int>> &pairs) override;
+
+        float cellSize = 2.0f;
+        int maxCellsPerProxy = 64;
+
+    private:
+        struct CellEntry {
+            uint64_t cell;
+            int proxy;
+        };
+
+        glm::ivec3 GetCell(glm::vec3 point) const;
+        static uint64_t PackCell(glm::ivec3 cell);
+
+        // reused between steps, so that a step doesn't allocate once they are big enough
+        std::vector<CellEntry> entries;
+        std::vector<int> oversized;
+    };
+}
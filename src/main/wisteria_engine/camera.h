@@ -2,6 +2,7 @@
 #include <iostream>
 #include "gameobject3d.h"
 #include "framebuffer.h"
+#include "renderqueue.h"
 
 namespace engine
 {
@@ -14,7 +15,7 @@ namespace engine
             : GameObject(pos, glm::vec3(1), glm::quatLookAt(-forward, up))
         // quatLookAt's default looking direction is -Z but gameobjects look at +Z
         {
-            viewMatrix = glm::lookAt(position, position + this->forward, this->up);
+            viewMatrix = glm::lookAt(GetPosition(), GetPosition() + GetForward(), GetUp());
             projectionMatrix = glm::perspective(glm::radians(60.0f), 4.0f / 3.0f, 0.1f, 1000.0f);
         }
 
@@ -28,8 +29,9 @@ namespace engine
             projectionMatrix = glm::ortho(left, right, bottom, top, near, far);
         }
 
-        glm::mat4 GetViewMatrix() const
+        glm::mat4 GetViewMatrix()
         {
+            UpdateTransform();  // the view matrix is refreshed by OnTransformChange
             return viewMatrix;
         }
 
@@ -40,19 +42,20 @@ namespace engine
 
         void RotateAround(float distance, float angle, glm::vec3 localAxis)
         {
-            Translate(distance * forward);
+            Translate(distance * GetForward());
             Rotate(glm::angleAxis(angle, localAxis));
-            Translate(-distance * forward);
+            Translate(-distance * GetForward());
         }
 
         void RotateAround(float distance, float angle)
         {
-            RotateAround(distance, angle, up);
+            RotateAround(distance, angle, GetUp());
         }
 
         void OnTransformChange() override
         {
-            viewMatrix = glm::lookAt(position, position + forward, up);
+            glm::vec3 position = GetPosition();
+            viewMatrix = glm::lookAt(position, position + GetForward(), GetUp());
         }
 
         bool IsOrthographic() const
@@ -77,9 +80,9 @@ namespace engine
             viewportHeight = height;
         }
 
-        glm::vec4 GetPositionGeneralized() const
+        glm::vec4 GetPositionGeneralized()
         {
-            return glm::vec4(isOrthographic ? forward : position, !isOrthographic);
+            return glm::vec4(isOrthographic ? GetForward() : GetPosition(), !isOrthographic);
         }
 
         float viewportX = 0;
@@ -90,6 +93,7 @@ namespace engine
         bool active = true;
         FrameBuffer *renderTarget = nullptr;
         unsigned int cullingMask = 0xFFFFFFFF;
+        RenderStats stats;  // culling statistics of the last render of this camera
 
     private:
         bool isOrthographic = false;
@@ -97,6 +101,8 @@ namespace engine
         glm::mat4 projectionMatrix;
         // when using deffered rendering, each camera needs its own G-Buffer
         FrameBuffer *gBuffer = nullptr;
+        // draw packets collected for this camera, reused every frame
+        RenderQueue renderQueue;
 
         friend class ControlledScene3D;
     };
@@ -0,0 +1,27 @@
+#include "contactcache.h"
+#include "gameobject3d.h"
+
+using namespace engine;
+
+ContactCache::Key ContactCache::MakeKey(GameObject *first, GameObject *second)
+{
+    return first < second ? Key(first, second) : Key(second, first);
+}
+
+size_t ContactCache::Find(GameObject *first, GameObject *second, bool &created)
+{
+    Key key = MakeKey(first, second);
+    auto it = index.find(key);
+    if (it != index.end()) {
+        created = false;
+        return it->second;
+    }
+
+    created = true;
+    size_t contact = contacts.size();
+    index.emplace(key, contact);
+    contacts.emplace_back();
+    contacts[contact].first = first;
+    contacts[contact].second = second;
+    return contact;
+}
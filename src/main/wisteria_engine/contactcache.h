@@ -0,0 +1,92 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+#include "bounds.h"
+#include "hitarea3d.h"
+#include "rigidbody.h"
+
+namespace engine
+{
+    class GameObject;
+
+    struct CollisionStats {
+        unsigned int pairs = 0;  // candidate pairs found by the broadphase
+        unsigned int tests = 0;  // narrowphase tests run, the others reused their last result
+        unsigned int touching = 0;
+        // heap allocations made by the narrowphase and the scene's collision buffers;
+        // stays at zero once the set of contacts is stable
+        unsigned int allocations = 0;
+    };
+
+    // a pair of colliding objects, as remembered from one collision step to the next
+    struct Contact {
+        GameObject *first = nullptr;
+        GameObject *second = nullptr;
+        // hit area bounds when the narrowphase last ran; while they don't change, its
+        // result can't either (see GameObject::Collides for the contract on hit areas)
+        AABB firstBounds;
+        AABB secondBounds;
+        ContactRecord record;  // of the last narrowphase, seen from first
+        bool touching = false;
+        uint32_t lastStep = 0;  // last collision step the broadphase reported the pair
+        // points of the last physics step, for the pairs involving a rigid body
+        ContactManifold manifold;
+    };
+
+    // Persistent contacts, keyed by the two objects owning the hit areas (an object has a
+    // single hit area). Contacts are densely packed, in the order they were created,
+    // so walking them is deterministic.
+    class ContactCache
+    {
+    public:
+        // index of the contact of a pair, in either order; created is set if it's new.
+        // Indices stay valid until the next RemoveIf, unlike references.
+        size_t Find(GameObject *first, GameObject *second, bool &created);
+        Contact &operator[](size_t contact) { return contacts[contact]; }
+
+        // removes every contact for which remove(contact) returns true
+        template <typename Predicate>
+        void RemoveIf(Predicate remove);
+
+        size_t Size() const { return contacts.size(); }
+        size_t Capacity() const { return contacts.capacity(); }
+
+    private:
+        typedef std::pair<GameObject *, GameObject *> Key;
+        struct KeyHash {
+            size_t operator()(const Key &key) const
+            {
+                // the key is ordered, so a plain mix is enough; XOR would make (a, b)
+                // collide with (b, a) and every (a, a)
+                uint64_t h = reinterpret_cast<uintptr_t>(key.first) * 0x9E3779B97F4A7C15ull;
+                h ^= reinterpret_cast<uintptr_t>(key.second) + 0x7F4A7C159E3779B9ull + (h << 6) + (h >> 2);
+                return (size_t)h;
+            }
+        };
+        static Key MakeKey(GameObject *first, GameObject *second);
+
+        std::vector<Contact> contacts;
+        std::unordered_map<Key, size_t, KeyHash> index;
+    };
+
+    template <typename Predicate>
+    void ContactCache::RemoveIf(Predicate remove)
+    {
+        // compacts in place, keeping the order of the remaining contacts
+        size_t kept = 0;
+        for (size_t i = 0; i < contacts.size(); ++i) {
+            Key key = MakeKey(contacts[i].first, contacts[i].second);
+            if (remove(contacts[i])) {
+                index.erase(key);
+                continue;
+            }
+            if (kept != i) {
+                contacts[kept] = std::move(contacts[i]);
+                index[key] = kept;
+            }
+            ++kept;
+        }
+        contacts.erase(contacts.begin() + kept, contacts.end());
+    }
+}
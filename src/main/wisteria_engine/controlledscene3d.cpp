@@ -1,4 +1,5 @@
 #include <iostream>
+#include <algorithm>
 #include <filesystem>
 #include "gameobject3d.h"
 #include "controlledscene3d.h"
@@ -6,13 +7,14 @@
 #include "camera.h"
 #include "material.h"
 #include "assets.h"
+#include "jobsystem.h"
+#include "allocationtracker.h"
 
 #define CAMERA_INIT_FOVY 60
 #define DEFAULT_WINDOW_WIDTH 1280
 #define DEFAULT_WINDOW_HEIGHT 720
 #define CAMERA_INIT_ZNEAR 0.01f
 #define CAMERA_INIT_ZFAR 300.0f
-#define DEFAULT_LAYER 0
 
 namespace fs = std::filesystem;
 
@@ -35,13 +37,15 @@ MessageCallback(GLenum source,
 
 ControlledScene3D::ControlledScene3D()
 {
-    gameObjects.reserve(70);
     toDestroy.reserve(10);
     // usually, there aren't more than 2 cameras in a scene
     cameras.reserve(2);
-    layers.assign(32, std::unordered_set<GameObject *>());
     lights.reserve(10);
     collisionMasks.assign(32, 0);
+    dirtyTransforms.resize(1);
+    motionQueues.resize(1);
+    proxyQueues.resize(1);
+    snapshotQueues.resize(1);
 
     glEnable(GL_DEBUG_OUTPUT);
     glDebugMessageCallback(MessageCallback, 0);
@@ -49,12 +53,14 @@ ControlledScene3D::ControlledScene3D()
 
 ControlledScene3D::~ControlledScene3D()
 {
-    for (auto &gameObject : gameObjects)
+    std::vector<GameObject *> objects = gameObjects.Objects();
+    for (auto gameObject : objects)
         delete gameObject;
 
-    gameObjects.clear();
     toDestroy.clear();
     cameras.clear();
+
+    JobSystem::Shutdown();
 }
 
 void engine::checkFBStatus()
@@ -101,6 +107,12 @@ void ControlledScene3D::Init()
     // ignore the fact that SimpleScene already provides a camera. In the future,
     // I plan on removing the entire framework and replacing it with my own.
     GetCameraInput()->SetActive(false);
+    // the GL thread (this one) becomes thread 0 of the job system
+    JobSystem::Initialize();
+    dirtyTransforms.resize(JobSystem::ThreadCount());
+    motionQueues.resize(JobSystem::ThreadCount());
+    proxyQueues.resize(JobSystem::ThreadCount());
+    snapshotQueues.resize(JobSystem::ThreadCount());
     mainCamera = new Camera(glm::vec3(0, 1.4, 0), glm::vec3_forward, glm::vec3_up);
     mainCamera->SetPerspective(CAMERA_INIT_FOVY,
                                DEFAULT_WINDOW_WIDTH / (float)DEFAULT_WINDOW_HEIGHT,
@@ -151,28 +163,179 @@ void ControlledScene3D::InitShaders()
     Assets::LoadShader("Deffered/Composite", "ScreenSpace.VS", "Deffered.Composite.FS");
     Assets::LoadShader("Deffered/LightAccumulate/Cube", "Default.VS", "Deffered.Light.Cube.FS");
     Assets::LoadShader("Deffered/Composite/Cube", "ScreenSpace.VS", "Deffered.Composite.Cube.FS");
+    lightAccumulateShaders[0] = Assets::shaders["Deffered/LightAccumulate"];
+    lightAccumulateShaders[1] = Assets::shaders["Deffered/LightAccumulate/Cube"];
+    compositeShaders[0] = Assets::shaders["Deffered/Composite"];
+    compositeShaders[1] = Assets::shaders["Deffered/Composite/Cube"];
     Assets::LoadShader("Particles", "Particles.VS", "Particles.GS", "Default.Texture.FS");
 }
 
 void ControlledScene3D::AddToScene(GameObject *gameObject)
 {
+    if (deferringCommands) {
+        Defer([this, gameObject]() { AddToScene(gameObject); });
+        return;
+    }
+    if (gameObject->scene == this && gameObjects.Get(gameObject->handle) == gameObject)
+        return;
+
     // I don't think the perfomance cost of dynamic_cast here is significant
-    if (dynamic_cast<Light *>(gameObject) != nullptr) {
+    if (dynamic_cast<Light *>(gameObject) != nullptr)
         lights.push_back(static_cast<Light *>(gameObject));
-    } else {
-        gameObjects.insert(gameObject);
-    }
+    gameObject->handle = gameObjects.Add(gameObject);
     gameObject->scene = this;
+    // the parent is added first, so a whole hierarchy ends up in the store
+    GameObject *parent = gameObject->parent;
+    if (useTransformStore && (parent == nullptr || parent->transformStore == &transformStore))
+        transformStore.Add(gameObject);
+    gameObject->UpdateTransform();
+    gameObject->SnapshotTransform();
+    gameObject->snapshotQueued = false;
+    gameObject->renderedTime = updates.GetTime(gameObject->useUnscaledTime);
+    updates.Add(gameObject);
+    if (gameObject->HasMotion())
+        kinematics.Add(gameObject);
+    if (gameObject->rigidBody != nullptr)
+        physics.Add(gameObject->rigidBody);
     gameObject->Initialize();
-    layers[DEFAULT_LAYER].insert(gameObject);
+    UpdateProxy(gameObject);
     for (auto &child : gameObject->GetChildren()) {
         AddToScene(child);
     }
 }
 
+void ControlledScene3D::QueueTransformUpdate(GameObject *gameObject)
+{
+    unsigned int thread = JobSystem::ThreadIndex();
+    dirtyTransforms[thread < dirtyTransforms.size() ? thread : 0].push_back(gameObject);
+}
+
+void ControlledScene3D::QueueMotion(GameObject *gameObject)
+{
+    unsigned int thread = JobSystem::ThreadIndex();
+    motionQueues[thread < motionQueues.size() ? thread : 0].push_back(gameObject->handle);
+}
+
+void ControlledScene3D::AddRigidBody(RigidBody *body)
+{
+    if (deferringCommands) {
+        Defer([this, body]() { AddRigidBody(body); });
+        return;
+    }
+    // the body is added with its object otherwise, see AddToScene
+    if (body->GetGameObject()->scene == this)
+        physics.Add(body);
+}
+
+void ControlledScene3D::RefreshUpdates(GameObject *gameObject)
+{
+    // objects get scheduled with the rest of their state once they join, see AddToScene
+    if (gameObject->scene == this && gameObjects.Get(gameObject->handle) == gameObject)
+        updates.Refresh(gameObject);
+}
+
+TaskHandle ControlledScene3D::StartTask(Task task)
+{
+    if (deferringCommands) {
+        std::cerr << "Tasks can't be started from the Tick of a step, use Defer.\n";
+        exit(1);
+    }
+    return tasks.Start(std::move(task), gameObjects);
+}
+
+void ControlledScene3D::StopTask(TaskHandle task)
+{
+    if (deferringCommands) {
+        Defer([this, task]() { StopTask(task); });
+        return;
+    }
+    tasks.Stop(task);
+}
+
+bool ControlledScene3D::IsTaskRunning(TaskHandle task) const
+{
+    return tasks.IsRunning(task);
+}
+
+void ControlledScene3D::QueueSnapshot(GameObject *gameObject)
+{
+    unsigned int thread = JobSystem::ThreadIndex();
+    snapshotQueues[thread < snapshotQueues.size() ? thread : 0].push_back(gameObject->handle);
+}
+
+void ControlledScene3D::ResolveTransforms(unsigned int thread)
+{
+    // objects resolved on demand in the meantime are simply skipped
+    for (auto gameObject : dirtyTransforms[thread])
+        gameObject->UpdateTransform();
+    dirtyTransforms[thread].clear();
+}
+
+void ControlledScene3D::ResolveTransforms()
+{
+    for (unsigned int thread = 0; thread < dirtyTransforms.size(); ++thread)
+        ResolveTransforms(thread);
+    if (transformStore.Size() > 0)
+        transformStore.ResolveAll();
+}
+
+uint32_t ControlledScene3D::RootIndex(GameObject *gameObject)
+{
+    while (gameObject->parent != nullptr && gameObject->parent->scene == gameObject->scene)
+        gameObject = gameObject->parent;
+    return gameObject->GetHandle().index;
+}
+
+bool ControlledScene3D::IsOutsideTickingHierarchy(GameObject *gameObject) const
+{
+    if (!deferringCommands)
+        return false;
+    return RootIndex(gameObject) != tickingRoots[JobSystem::ThreadIndex()];
+}
+
+void ControlledScene3D::UpdateProxy(GameObject *gameObject)
+{
+    if (tickingInParallel) {
+        // the tree is shared, so only queue the object; Simulate syncs it after the ticks
+        if (!gameObject->proxyDirty) {
+            gameObject->proxyDirty = true;
+            unsigned int thread = JobSystem::ThreadIndex();
+            proxyQueues[thread < proxyQueues.size() ? thread : 0].push_back(gameObject);
+        }
+        return;
+    }
+    gameObject->proxyDirty = false;
+
+    AABB bounds = gameObject->GetProxyBounds();
+    if (bounds.IsEmpty()) {
+        if (gameObject->proxy != AABB_TREE_NULL_NODE) {
+            sceneTree.Remove(gameObject->proxy);
+            gameObject->proxy = AABB_TREE_NULL_NODE;
+        }
+        // meshes without CPU-side geometry can't be culled, but still need to be drawn
+        if (gameObject->mesh)
+            unboundedRenderables.insert(gameObject);
+        else
+            unboundedRenderables.erase(gameObject);
+        return;
+    }
+
+    if (!unboundedRenderables.empty())
+        unboundedRenderables.erase(gameObject);
+    if (gameObject->proxy == AABB_TREE_NULL_NODE)
+        gameObject->proxy = sceneTree.Insert(bounds, gameObject, gameObject->layerMask);
+    else
+        sceneTree.Move(gameObject->proxy, bounds);
+}
+
 void ControlledScene3D::Destroy(GameObject *gameObject)
 {
-    toDestroy.insert(gameObject);
+    if (deferringCommands) {
+        Defer([this, gameObject]() { Destroy(gameObject); });
+        return;
+    }
+
+    toDestroy.push_back(gameObject->handle);
     for (auto &child : gameObject->GetChildren()) {
         Destroy(child);
     }
@@ -184,8 +347,15 @@ void ControlledScene3D::AddToLayer(GameObject *gameObject, int layer)
         std::cerr << "Wisteria Engine only supports 32 layers.\n";
         exit(1);
     }
-    layers[layer].insert(gameObject);
+    if (deferringCommands) {
+        Defer([this, gameObject, layer]() { AddToLayer(gameObject, layer); });
+        return;
+    }
+    uint32_t oldMask = gameObject->layerMask;
     gameObject->layerMask |= (1 << layer);
+    gameObjects.UpdateLayers(gameObject, oldMask);
+    if (gameObject->proxy != AABB_TREE_NULL_NODE)
+        sceneTree.SetLayerMask(gameObject->proxy, gameObject->layerMask);
 }
 
 void ControlledScene3D::RemoveFromLayer(GameObject *gameObject, int layer)
@@ -194,18 +364,183 @@ void ControlledScene3D::RemoveFromLayer(GameObject *gameObject, int layer)
         std::cerr << "Wisteria Engine only supports 32 layers.\n";
         exit(1);
     }
-    layers[layer].erase(gameObject);
+    if (deferringCommands) {
+        Defer([this, gameObject, layer]() { RemoveFromLayer(gameObject, layer); });
+        return;
+    }
+    uint32_t oldMask = gameObject->layerMask;
     gameObject->layerMask &= ~(1 << layer);
+    gameObjects.UpdateLayers(gameObject, oldMask);
+    if (gameObject->proxy != AABB_TREE_NULL_NODE)
+        sceneTree.SetLayerMask(gameObject->proxy, gameObject->layerMask);
+}
+
+const std::vector<GameObject *> &ControlledScene3D::GetLayer(int layer)
+{
+    if (layer < 0 || layer >= 32) {
+        std::cerr << "Wisteria Engine only supports 32 layers.\n";
+        exit(1);
+    }
+    return gameObjects.GetLayer(layer);
+}
+
+GameObject *ControlledScene3D::FindObject(ObjectHandle handle) const
+{
+    return gameObjects.Get(handle);
+}
+
+void ControlledScene3D::QueryBox(const AABB &box, uint32_t layerMask, std::vector<GameObject *> &results)
+{
+    sceneTree.Query(box, layerMask, [&](int proxy) {
+        GameObject *gameObject = static_cast<GameObject *>(sceneTree.GetUserData(proxy));
+        if (gameObject->GetProxyBounds().Overlaps(box))
+            results.push_back(gameObject);
+        return true;
+    });
+}
+
+void ControlledScene3D::QueryPoint(glm::vec3 point, uint32_t layerMask, std::vector<GameObject *> &results)
+{
+    sceneTree.Query(point, layerMask, [&](int proxy) {
+        GameObject *gameObject = static_cast<GameObject *>(sceneTree.GetUserData(proxy));
+        if (gameObject->GetProxyBounds().Contains(point))
+            results.push_back(gameObject);
+        return true;
+    });
+}
+
+GameObject *ControlledScene3D::QueryRay(glm::vec3 origin, glm::vec3 direction, float maxDistance,
+                                        uint32_t layerMask, float *distance)
+{
+    direction = glm::normalize(direction);
+    glm::vec3 invDirection = 1.0f / direction;
+    GameObject *closest = nullptr;
+    float closestDistance = maxDistance;
+    sceneTree.RayCast(origin, direction, maxDistance, layerMask, [&](int proxy, float limit) {
+        GameObject *gameObject = static_cast<GameObject *>(sceneTree.GetUserData(proxy));
+        float hit = AABBTree::RayBoxDistance(origin, invDirection, limit, gameObject->GetProxyBounds());
+        if (hit < 0 || hit > closestDistance)
+            return limit;
+        closest = gameObject;
+        closestDistance = hit;
+        return hit;  // nothing further away matters anymore
+    });
+
+    if (distance != nullptr)
+        *distance = closest ? closestDistance : -1;
+    return closest;
+}
+
+template <typename Callback>
+void ControlledScene3D::Cast(glm::vec3 origin, float radius, glm::vec3 direction, float maxDistance,
+                             uint32_t layerMask, Callback hit)
+{
+    direction = glm::normalize(direction);
+    sceneTree.SphereCast(origin, radius, direction, maxDistance, layerMask, [&](int proxy, float limit) {
+        GameObject *gameObject = static_cast<GameObject *>(sceneTree.GetUserData(proxy));
+        HitArea *hitArea = gameObject->hitArea;
+        RaycastHit result;
+        if (hitArea == nullptr || hitArea->support == nullptr ||
+            !hitArea->Cast(origin, radius, direction, limit, result))
+            return limit;
+        result.gameObject = gameObject;
+        return hit(result);
+    });
+}
+
+bool ControlledScene3D::Raycast(glm::vec3 origin, glm::vec3 direction, float maxDistance,
+                                uint32_t layerMask, RaycastHit &hit)
+{
+    return SphereCast(origin, 0, direction, maxDistance, layerMask, hit);
+}
+
+void ControlledScene3D::RaycastAll(glm::vec3 origin, glm::vec3 direction, float maxDistance,
+                                   uint32_t layerMask, std::vector<RaycastHit> &hits)
+{
+    SphereCastAll(origin, 0, direction, maxDistance, layerMask, hits);
+}
+
+bool ControlledScene3D::SphereCast(glm::vec3 origin, float radius, glm::vec3 direction, float maxDistance,
+                                   uint32_t layerMask, RaycastHit &hit)
+{
+    hit = RaycastHit();
+    Cast(origin, radius, direction, maxDistance, layerMask, [&](const RaycastHit &result) {
+        hit = result;
+        return result.distance;  // nothing further away matters anymore
+    });
+    return hit.gameObject != nullptr;
+}
+
+void ControlledScene3D::SphereCastAll(glm::vec3 origin, float radius, glm::vec3 direction, float maxDistance,
+                                      uint32_t layerMask, std::vector<RaycastHit> &hits)
+{
+    size_t first = hits.size();
+    Cast(origin, radius, direction, maxDistance, layerMask, [&](const RaycastHit &result) {
+        hits.push_back(result);
+        return maxDistance;
+    });
+    std::sort(hits.begin() + first, hits.end(), [](const RaycastHit &a, const RaycastHit &b) {
+        return a.distance < b.distance;
+    });
+}
+
+void ControlledScene3D::OverlapBox(const AABB &box, uint32_t layerMask, std::vector<GameObject *> &results)
+{
+    sceneTree.Query(box, layerMask, [&](int proxy) {
+        GameObject *gameObject = static_cast<GameObject *>(sceneTree.GetUserData(proxy));
+        HitArea *hitArea = gameObject->hitArea;
+        if (hitArea != nullptr && hitArea->support != nullptr && hitArea->Overlaps(box))
+            results.push_back(gameObject);
+        return true;
+    });
+}
+
+void ControlledScene3D::OverlapSphere(glm::vec3 center, float radius, uint32_t layerMask,
+                                      std::vector<GameObject *> &results)
+{
+    AABB box = AABB(center - radius, center + radius);
+    sceneTree.Query(box, layerMask, [&](int proxy) {
+        GameObject *gameObject = static_cast<GameObject *>(sceneTree.GetUserData(proxy));
+        HitArea *hitArea = gameObject->hitArea;
+        if (hitArea != nullptr && hitArea->support != nullptr && hitArea->Overlaps(center, radius))
+            results.push_back(gameObject);
+        return true;
+    });
 }
 
-struct pair_hash {
-    inline std::size_t operator()(const std::pair<GameObject *, GameObject *> &v) const {
-        return reinterpret_cast<uintptr_t>(v.first) ^ reinterpret_cast<uintptr_t>(v.second);
+void ControlledScene3D::CastBatch(const std::vector<CastQuery> &queries, std::vector<RaycastHit> &hits)
+{
+    hits.resize(queries.size());
+    auto castRange = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            const CastQuery &query = queries[i];
+            SphereCast(query.origin, query.radius, query.direction, query.maxDistance, query.layerMask, hits[i]);
+        }
+    };
+
+    // the queries only read the scene once the transforms and the tree are up to date;
+    // from a parallel Tick, they can't be brought up to date, so run on this thread only
+    if (tickingInParallel) {
+        castRange(0, queries.size());
+        return;
     }
-};
+    ResolveTransforms();
+    JobSystem::ParallelFor(queries.size(), 16, castRange);
+}
+
+static inline int BitCount(uint8_t bits)
+{
+    int count = 0;
+    for (; bits; bits &= bits - 1)
+        ++count;
+    return count;
+}
 
 void ControlledScene3D::FrameStart()
 {
+    AllocationTracker::FrameStart();
+    frameArena.Reset();
+
     // Clears the color buffer (using the previously set color) and depth buffer
     glClearColor(clearColor.r, clearColor.g, clearColor.b, clearColor.a);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -216,59 +551,260 @@ void ControlledScene3D::Update(float deltaTimeSeconds)
     deltaTime = deltaTimeSeconds * timeScale;
     unscaledDeltaTime = deltaTimeSeconds;
 
+    // simulation first. The accumulator runs on unscaled time so that objects using
+    // unscaled time keep moving while the scene is paused (timeScale = 0)
+    accumulator = glm::min(accumulator + unscaledDeltaTime, maxSubSteps * fixedDeltaTime);
+    while (accumulator >= fixedDeltaTime) {
+        Simulate();
+        accumulator -= fixedDeltaTime;
+    }
+    interpolationAlpha = interpolateTransforms ? accumulator / fixedDeltaTime : 1.0f;
+
+    // then the objects updating once per frame, on this thread, like input handling
+    {
+        AllocationTracker::Scope scope(ALLOCATION_UPDATES);
+        updates.CollectFrame(deltaTime, unscaledDeltaTime, frameUpdates);
+        for (auto &update : frameUpdates) {
+            update.gameObject->Tick(update.deltaTime);
+            if (update.gameObject->mesh != update.gameObject->boundsMesh)
+                UpdateProxy(update.gameObject);
+        }
+    }
+    {
+        AllocationTracker::Scope scope(ALLOCATION_TASKS);
+        tasks.Frame(gameObjects);
+    }
+
+    // the render passes below only read the simulated state; changes made outside
+    // of the simulation (input, camera controls) are resolved here
+    AllocationTracker::Scope scope(ALLOCATION_RENDERING);
+    ResolveTransforms();
+    renderStats = RenderStats();
     Camera *savedMainCamera = mainCamera;
-    std::set<Camera *> screenCameras;
-    bool update = true;
-    
+    FrameVector<Camera *> screenCameras{ FrameAllocator<Camera *>(frameArena) };
+    screenCameras.reserve(cameras.size());
+
     // cameras rendering into a framebuffer first
     for (auto &camera : cameras) {
         if (!camera->renderTarget) {
-            screenCameras.insert(camera);
+            screenCameras.push_back(camera);
             continue;
         }
         mainCamera = camera;
         if (defferedRendering) {
-            DefferedRenderScene(update);
+            DefferedRenderScene();
             // renderTarget = camera->renderTarget;
             // ForwardRenderScene();
         } else {
             renderTarget = camera->renderTarget;
-            ForwardRenderScene(update);
+            ForwardRenderScene();
         }
-        update = false;
     }
     // then screen cameras
     for (auto &camera : screenCameras) {
         mainCamera = camera;
         if (defferedRendering) {
-            DefferedRenderScene(update);
+            DefferedRenderScene();
         } else {
             renderTarget = camera->renderTarget;
-            ForwardRenderScene(update);
+            ForwardRenderScene();
         }
-        update = false;
     }
     mainCamera = savedMainCamera;
-    screenCameras.clear();
 
+    AllocationTracker::Scope sceneScope(ALLOCATION_UPDATES);
     Tick();
+    DestroyPending();
+}
+
+void ControlledScene3D::Simulate()
+{
+    AllocationTracker::Scope scope(ALLOCATION_SIMULATION);
+
+    // the previous transforms are those of the start of the step; only the objects that
+    // moved since the last one can be behind, every other one already has it. Every
+    // transform is resolved before the ticks, which read the other hierarchies from these
+    ResolveTransforms();
+    for (auto &queue : snapshotQueues) {
+        for (auto handle : queue) {
+            GameObject *gameObject = gameObjects.Get(handle);
+            if (gameObject == nullptr)
+                continue;
+            gameObject->snapshotQueued = false;
+            gameObject->SnapshotTransform();
+        }
+        queue.clear();
+    }
+
+    // only the objects that opted in tick, in hierarchy order (see UpdateScheduler)
+    float scaledStep = fixedDeltaTime * timeScale;
+    {
+        AllocationTracker::Scope updatesScope(ALLOCATION_UPDATES);
+        updates.Step(gameObjects, scaledStep, fixedDeltaTime, scheduled, scheduledRoots);
+
+        // A root hierarchy is the unit of work: objects only touch their own hierarchy while
+        // ticking, so different roots can tick on different threads, while the objects of
+        // one hierarchy still tick parent first, as before
+        // Commands are deferred to the end of the phase on one thread as well, so the
+        // ticks see the same scene whatever the number of threads
+        size_t roots = scheduledRoots.size() - 1;
+        commandBuffers.resize(JobSystem::ThreadCount());
+        tickingObject.resize(JobSystem::ThreadCount());
+        tickingRoots.resize(JobSystem::ThreadCount());
+        deferringCommands = true;
+        if (parallelTick && JobSystem::ThreadCount() > 1 && roots > 1) {
+            tickingInParallel = true;
+            JobSystem::ParallelFor(roots, 8, [&](size_t begin, size_t end) {
+                TickScheduled(scheduledRoots[begin], scheduledRoots[end]);
+            });
+            tickingInParallel = false;
+        } else {
+            TickScheduled(0, scheduled.size());
+        }
+        deferringCommands = false;
+        ApplyDeferredCommands();
+    }
+    // the tasks whose wait is over, after the ticks like deferred commands
+    {
+        AllocationTracker::Scope tasksScope(ALLOCATION_TASKS);
+        tasks.Step(gameObjects, updates.GetTime(false), updates.GetTime(true));
+    }
+
+    // then the motion of everything that moves, including what started moving in the ticks
+    for (auto &queue : motionQueues) {
+        for (auto handle : queue) {
+            GameObject *gameObject = gameObjects.Get(handle);
+            if (gameObject == nullptr)
+                continue;
+            gameObject->motionQueued = false;
+            if (gameObject->HasMotion())
+                kinematics.Add(gameObject);
+        }
+        queue.clear();
+    }
+    kinematics.Integrate(scaledStep, fixedDeltaTime, parallelTick);
+    // what it moved is resolved here, and the objects in the transform store in one pass
+    ResolveTransforms();
+
+    // transforms moved during the ticks and swapped meshes still need their leaves updated
+    for (auto &queue : proxyQueues) {
+        for (auto gameObject : queue)
+            UpdateProxy(gameObject);
+        queue.clear();
+    }
+    for (auto &update : scheduled) {
+        if (update.gameObject->mesh != update.gameObject->boundsMesh)
+            UpdateProxy(update.gameObject);
+    }
 
     CheckCollisions();
-    
-    for (auto gameObject : toDestroy) {
-        if (gameObjects.find(gameObject) == gameObjects.end())
-            continue;
+    StepPhysics(scaledStep);
+    DestroyPending();
+}
 
-        gameObjects.erase(gameObject);
-        for (int layer = 0; layer < 32; ++layer)
-            RemoveFromLayer(gameObject, layer);
+void ControlledScene3D::TickScheduled(size_t begin, size_t end)
+{
+    unsigned int thread = JobSystem::ThreadIndex();
+    for (size_t i = begin; i < end; ++i) {
+        tickingObject[thread] = i;
+        tickingRoots[thread] = scheduled[i].root;
+        scheduled[i].gameObject->Tick(scheduled[i].deltaTime);
+    }
+    // one top-down pass over what these ticks moved; a thread only ever dirties
+    // objects of the hierarchies it ticks, so this can run in parallel too. Each object
+    // is resolved as part of its own hierarchy, for the getters of OnTransformChange
+    for (auto gameObject : dirtyTransforms[thread]) {
+        tickingRoots[thread] = RootIndex(gameObject);
+        gameObject->UpdateTransform();
+    }
+    dirtyTransforms[thread].clear();
+}
 
-        delete gameObject;
+void ControlledScene3D::Defer(std::function<void()> command)
+{
+    if (!deferringCommands) {
+        command();
+        return;
+    }
+
+    unsigned int thread = JobSystem::ThreadIndex();
+    std::vector<DeferredCommand> &buffer = commandBuffers[thread];
+    buffer.push_back({ tickingObject[thread], buffer.size(), std::move(command) });
+}
+
+void ControlledScene3D::ApplyDeferredCommands()
+{
+    // merge the per-thread buffers in the order the commands would have been issued
+    // by a serial Tick; commands of one object all come from the same thread
+    deferredCommands.clear();
+    for (auto &buffer : commandBuffers) {
+        for (auto &command : buffer)
+            deferredCommands.push_back(&command);
+    }
+    std::sort(deferredCommands.begin(), deferredCommands.end(),
+              [](const DeferredCommand *a, const DeferredCommand *b) {
+        return a->order != b->order ? a->order < b->order : a->sequence < b->sequence;
+    });
+
+    for (auto command : deferredCommands)
+        command->command();
+    for (auto &buffer : commandBuffers)
+        buffer.clear();
+}
+
+void ControlledScene3D::DestroyPending()
+{
+    if (!toDestroy.empty())
+        ResolveTransforms();  // the queues must not keep pointers to deleted objects
+    for (auto handle : toDestroy) {
+        GameObject *gameObject = gameObjects.Get(handle);
+        if (gameObject == nullptr)
+            continue;
+
+        gameObjects.Remove(handle);
+        if (dynamic_cast<Light *>(gameObject) != nullptr)
+            lights.erase(std::find(lights.begin(), lights.end(), gameObject));
+        transformStore.Remove(gameObject);
+        kinematics.Remove(gameObject);
+        updates.Remove(gameObject);
+        tasks.Remove(gameObject);
+        if (gameObject->rigidBody != nullptr)
+            physics.Remove(gameObject->rigidBody);
+        if (gameObject->proxy != AABB_TREE_NULL_NODE) {
+            sceneTree.Remove(gameObject->proxy);
+            gameObject->proxy = AABB_TREE_NULL_NODE;
+        }
+        unboundedRenderables.erase(gameObject);
+        if (gameObject->collider != BROADPHASE_NULL_PROXY)
+            colliderBroadphase->Remove(gameObject->collider);
+        gameObject->scene = nullptr;
+        destroyed.push_back(gameObject);
     }
     toDestroy.clear();
+
+    // the objects touching a destroyed one get their exit before it is deleted
+    if (!destroyed.empty() && contacts.Size() > 0) {
+        contacts.RemoveIf([this](Contact &contact) {
+            bool firstAlive = contact.first->scene == this, secondAlive = contact.second->scene == this;
+            if (firstAlive && secondAlive)
+                return false;
+            if (contact.touching && firstAlive) {
+                contact.first->OnCollisionExit(contact.second);
+                physics.OnSeparated(contact.first);
+            }
+            if (contact.touching && secondAlive) {
+                contact.second->OnCollisionExit(contact.first);
+                physics.OnSeparated(contact.second);
+            }
+            return true;
+        });
+    }
+    for (auto gameObject : destroyed)
+        delete gameObject;
+    destroyed.clear();
 }
 
-void ControlledScene3D::ForwardRenderScene(bool update)
+void ControlledScene3D::ForwardRenderScene()
 {
     // std::cout << "Forward rendering from " << mainCamera->name << std::endl;
     if (!mainCamera->active)
@@ -286,24 +822,61 @@ void ControlledScene3D::ForwardRenderScene(bool update)
         glViewport(vx, vy, vw, vh);
     }
 
-    for (auto gameObject : gameObjects) {
-        if (!gameObject->active)
-            continue;
+    SetupCullingFrusta();
+    mainCamera->stats = RenderStats();
 
-        if (gameObject->GetLayerMask() & mainCamera->cullingMask)
-            DrawGameObject(gameObject, update);
-    }
+    RenderQueue &queue = mainCamera->renderQueue;
+    queue.Clear();
+    CollectDrawPackets(queue);
+    queue.Sort();
+    SubmitRenderQueue(queue);
+    renderStats.Add(mainCamera->stats);
 
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
-void ControlledScene3D::DefferedRenderScene(bool update)
+void ControlledScene3D::SetupCullingFrusta()
+{
+    glm::mat4 projection = mainCamera->GetProjectionMatrix();
+    if (renderTarget != nullptr && renderTarget->NeedsCubeRendering()) {
+        glm::mat4 viewMatrices[6];
+        CubeFaceViewMatrices(viewMatrices);
+        cullingBounds = AABB();
+        for (int face = 0; face < 6; ++face) {
+            cullingFrusta[face] = Frustum::FromMatrix(projection * viewMatrices[face]);
+            cullingBounds.Expand(Frustum::GetBounds(projection * viewMatrices[face]));
+        }
+        numCullingFrusta = 6;
+    } else {
+        cullingFrusta[0] = Frustum::FromMatrix(projection * mainCamera->GetViewMatrix());
+        numCullingFrusta = 1;
+    }
+}
+
+uint8_t ControlledScene3D::CullBounds(const AABB &bounds)
+{
+    // objects without CPU-side geometry (and without custom bounds) are never culled
+    if (!frustumCulling || bounds.IsEmpty())
+        return CUBE_ALL_FACES;
+
+    if (numCullingFrusta == 1)
+        return cullingFrusta[0].Intersects(bounds) ? CUBE_ALL_FACES : 0;
+
+    uint8_t faceMask = 0;
+    for (int face = 0; face < numCullingFrusta; ++face) {
+        if (cullingFrusta[face].Intersects(bounds))
+            faceMask |= 1 << face;
+    }
+    return faceMask;
+}
+
+void ControlledScene3D::DefferedRenderScene()
 {
     gBuffer = mainCamera->gBuffer;
 
     // G-Buffer pass
     renderTarget = gBuffer;
-    ForwardRenderScene(update);
+    ForwardRenderScene();
 
     // Light accumulation pass
     gBuffer->Clear(false, true, { 3 });
@@ -315,10 +888,21 @@ void ControlledScene3D::DefferedRenderScene(bool update)
         glEnable(GL_CULL_FACE);
         glCullFace(GL_FRONT);
 
+        Mesh *lightVolume = Assets::meshes["Default/Sphere"];
+        renderTarget = gBuffer;
+        SetupCullingFrusta();
         for (auto &light : lights) {
-            renderTarget = gBuffer;
-            AccumulateLight(light, update);
+            if (!light->active)
+                continue;
+            AABB bounds = Assets::GetMeshBounds(lightVolume).Transformed(light->ObjectToWorldMatrix());
+            cubeFaceMask = CullBounds(bounds);
+            if (cubeFaceMask == 0) {
+                renderStats.culled += 1;
+                continue;
+            }
+            AccumulateLight(light);
         }
+        cubeFaceMask = CUBE_ALL_FACES;
 
         glDisable(GL_CULL_FACE);
         glDisable(GL_BLEND);
@@ -339,41 +923,135 @@ void ControlledScene3D::DefferedRenderScene(bool update)
 
     // Composite pass
     Mesh *quad = Assets::meshes["Default/Quad"];
-    Shader *shader = HelperDefferedShader("Deffered/Composite");
+    Shader *shader = HelperDefferedShader(compositeShaders);
 
-    Material material(shader);
-    material.SetVec3("WIST_AMBIENT_LIGHT", Light::ambientLight);
+    // Material::Use sets the ambient light already
+    Material &material = compositeMaterial;
+    material.shader = shader;
     material.SetTexture("TEXTURE_COLOR", gBuffer->GetColorTexture(0));
     material.SetTexture("TEXTURE_LIGHT", gBuffer->GetColorTexture(3));
     material.Use();
+    objectRenderDeltaTime = 0;
     RenderMesh(quad, shader, 1, glm::mat4(1));
 }
 
-void ControlledScene3D::DrawGameObject(GameObject *gameObject, bool update)
+void ControlledScene3D::CollectDrawPackets(RenderQueue &queue)
 {
-    float objectDeltaTime = gameObject->useUnscaledTime ? unscaledDeltaTime : deltaTime;
-    // if (update) gameObject->Tick(objectDeltaTime);
-    gameObject->Tick(objectDeltaTime);
-
-    if (gameObject->mesh) {
-        glm::mat4 modelMatrix = gameObject->ObjectToWorldMatrix();
-        if (gameObject->material.shader) {
-            RenderMeshCustomMaterial(gameObject->mesh, gameObject->material, modelMatrix);
-        } else {
-            Shader *shader = defferedRendering ? Assets::shaders["AllData"] : Assets::shaders["VertexColor"];
-            RenderMesh(gameObject->mesh, shader, 1, modelMatrix);
+    uint32_t cullingMask = mainCamera->cullingMask;
+    if (!frustumCulling) {
+        for (auto gameObject : gameObjects) {
+            if (gameObject->GetLayerMask() & cullingMask)
+                CollectDrawPacket(gameObject, queue);
         }
+        return;
     }
 
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);  // in case Tick() bound an SSBO
+    // the tree rejects whole subtrees outside the view (or on layers the camera doesn't
+    // see); the leaves that pass are tested again with their exact bounds
+    auto collect = [&](int proxy) {
+        CollectDrawPacket(static_cast<GameObject *>(sceneTree.GetUserData(proxy)), queue);
+        return true;
+    };
+    if (numCullingFrusta == 1) {
+        int rejected = 0;
+        sceneTree.Query(cullingFrusta[0], cullingMask, collect, &rejected);
+        // this also counts rejected leaves without a mesh (e.g. hit areas only), which
+        // is close enough for statistics
+        mainCamera->stats.culled += rejected;
+    } else {
+        sceneTree.Query(cullingBounds, cullingMask, collect);
+    }
 
-    for (auto &child : gameObject->GetChildren()) {
-        if (!child->active)
+    for (auto gameObject : unboundedRenderables) {
+        if (gameObject->GetLayerMask() & cullingMask)
+            CollectDrawPacket(gameObject, queue);
+    }
+}
+
+void ControlledScene3D::CollectDrawPacket(GameObject *gameObject, RenderQueue &queue)
+{
+    if (!gameObject->mesh || !gameObject->IsActiveInHierarchy())
+        return;
+
+    uint8_t faceMask = CullBounds(gameObject->GetWorldBounds());
+    if (faceMask == 0) {
+        mainCamera->stats.culled += 1;
+        return;
+    }
+    mainCamera->stats.visible += 1;
+    if (numCullingFrusta == 6)
+        mainCamera->stats.culledFaces += 6 - BitCount(faceMask);
+    PushDrawPacket(gameObject, faceMask, queue);
+}
+
+void ControlledScene3D::PushDrawPacket(GameObject *gameObject, uint8_t faceMask, RenderQueue &queue)
+{
+    DrawPacket packet;
+    packet.gameObject = gameObject;
+    packet.mesh = gameObject->mesh;
+    packet.modelMatrix = InterpolatedModelMatrix(gameObject);
+    packet.layerMask = gameObject->GetLayerMask();
+    packet.faceMask = faceMask;
+
+    Material &material = gameObject->material;
+    if (material.shader) {
+        packet.material = &material;
+        packet.shader = material.shader;
+        packet.blending = material.blending;
+    } else {
+        packet.material = nullptr;
+        packet.shader = defferedRendering ? Assets::shaders["AllData"] : Assets::shaders["VertexColor"];
+        packet.blending = false;
+    }
+
+    glm::vec3 toObject = glm::vec3(packet.modelMatrix[3]) - mainCamera->GetPosition();
+    float depth = glm::dot(toObject, toObject);  // squared distance sorts the same way
+    size_t textureSet = packet.material ? material.GetTextureSetHash() : 0;
+    queue.Push(packet, material.renderPass, depth, textureSet);
+}
+
+void ControlledScene3D::SubmitRenderQueue(RenderQueue &queue)
+{
+    RenderState state;
+    for (size_t i = 0; i < queue.Size(); ++i) {
+        DrawPacket &packet = queue[i];
+        if (!packet.shader || !packet.shader->program)
             continue;
 
-        if (child->GetLayerMask() & mainCamera->cullingMask)
-            DrawGameObject(child);
+        GameObject *gameObject = packet.gameObject;
+        gameObject->OnBeforeRender();
+
+        if (packet.material) {
+            packet.material->Use(&state);
+        } else if (state.shader != packet.shader) {
+            packet.shader->Use();
+            state.shader = packet.shader;
+        }
+
+        // GPU-simulated meshes (e.g. particles) advance by WIST_DELTA_TIME, so only
+        // the first draw after a simulation step gets the simulated time
+        double time = updates.GetTime(gameObject->useUnscaledTime);
+        objectRenderDeltaTime = (float)(time - gameObject->renderedTime);
+        gameObject->renderedTime = time;
+        int instances = packet.material ? packet.material->instances : 1;
+        cubeFaceMask = packet.faceMask;
+        RenderMesh(packet.mesh, packet.shader, instances, packet.modelMatrix);
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);  // in case OnBeforeRender() bound an SSBO
     }
+    cubeFaceMask = CUBE_ALL_FACES;
+}
+
+glm::mat4 ControlledScene3D::InterpolatedModelMatrix(GameObject *gameObject)
+{
+    const glm::mat4 &current = gameObject->ObjectToWorldMatrixRef();
+    if (interpolationAlpha >= 1)
+        return current;
+
+    // a component-wise lerp is not a proper rigid interpolation, but within a single
+    // fixed step the rotations are small enough for the difference not to be visible
+    const glm::mat4 &previous = gameObject->previousObjectToWorldMatrix;
+    return previous + (current - previous) * interpolationAlpha;
 }
 
 void ControlledScene3D::RenderMesh(Mesh *mesh, Shader *shader, int instances, const glm::mat4 &modelMatrix)
@@ -381,8 +1059,8 @@ void ControlledScene3D::RenderMesh(Mesh *mesh, Shader *shader, int instances, co
     if (!mesh || !shader || !shader->program)
         return;
 
-    // Render an object using the specified shader and the specified position
-    shader->Use();
+    // Render an object using the specified shader and the specified position.
+    // The shader must already be in use (see Material::Use and SubmitRenderQueue)
     GLuint loc_view_matrix = glGetUniformLocation(shader->program, "WIST_VIEW_MATRIX");
     GLuint loc_projection_matrix = glGetUniformLocation(shader->program, "WIST_PROJECTION_MATRIX");
     GLuint loc_model_matrix = glGetUniformLocation(shader->program, "WIST_MODEL_MATRIX");
@@ -408,7 +1086,7 @@ void ControlledScene3D::RenderMesh(Mesh *mesh, Shader *shader, int instances, co
             glm::ivec2(drawAreaWidth, drawAreaHeight);
         glUniform2iv(loc_resolution, 1, glm::value_ptr(resolution));
     }
-    glUniform1f(loc_delta_time, deltaTime);
+    glUniform1f(loc_delta_time, objectRenderDeltaTime);
 
     mesh->UseMaterials(false);  // To whoever wrote gfxc: I hate you for this. Took me 3 days to figure out why my textures weren't working!!
 
@@ -420,13 +1098,18 @@ void ControlledScene3D::RenderMesh(Mesh *mesh, Shader *shader, int instances, co
     }
 }
 
-void ControlledScene3D::RenderMeshCustomMaterial(Mesh *mesh, Material material, const glm::mat4 &modelMatrix)
+void ControlledScene3D::CubeFaceViewMatrices(glm::mat4 viewMatrices[6])
 {
-    if (!mesh || !material.shader || !material.shader->GetProgramID())
-        return;
-
-    material.Use();
-    RenderMesh(mesh, material.shader, material.instances, modelMatrix);
+    glm::vec3 cameraPos = mainCamera->GetPosition();
+    glm::vec3 cameraForward = mainCamera->GetForward();
+    glm::vec3 cameraUp = mainCamera->GetUp();
+    glm::vec3 cameraRight = mainCamera->GetRight();
+    viewMatrices[0] = glm::lookAt(cameraPos, cameraPos + cameraRight,   -cameraUp);   // +X
+    viewMatrices[1] = glm::lookAt(cameraPos, cameraPos - cameraRight,   -cameraUp);   // -X
+    viewMatrices[2] = glm::lookAt(cameraPos, cameraPos + cameraUp,  cameraForward);   // +Y
+    viewMatrices[3] = glm::lookAt(cameraPos, cameraPos - cameraUp, -cameraForward);   // -Y
+    viewMatrices[4] = glm::lookAt(cameraPos, cameraPos + cameraForward, -cameraUp);   // +Z
+    viewMatrices[5] = glm::lookAt(cameraPos, cameraPos - cameraForward, -cameraUp);   // -Z
 }
 
 void ControlledScene3D::HelperCubeRender(Mesh *mesh, int instances, Shader *shader)
@@ -434,20 +1117,14 @@ void ControlledScene3D::HelperCubeRender(Mesh *mesh, int instances, Shader *shad
     GLuint loc_view_matrix = glGetUniformLocation(shader->program, "WIST_VIEW_MATRIX");
     GLuint loc_cube_face = glGetUniformLocation(shader->program, "WIST_CUBE_FACE");
 
-    glm::vec3 cameraPos = mainCamera->GetPosition();
-    glm::vec3 cameraForward = mainCamera->GetForward();
-    glm::vec3 cameraUp = mainCamera->GetUp();
-    glm::vec3 cameraRight = mainCamera->GetRight();
-    glm::mat4 viewMatrices[6] = {
-        glm::lookAt(cameraPos, cameraPos + cameraRight,   -cameraUp),   // +X
-        glm::lookAt(cameraPos, cameraPos - cameraRight,   -cameraUp),   // -X
-        glm::lookAt(cameraPos, cameraPos + cameraUp,  cameraForward),   // +Y
-        glm::lookAt(cameraPos, cameraPos - cameraUp, -cameraForward),   // -Y
-        glm::lookAt(cameraPos, cameraPos + cameraForward, -cameraUp),   // +Z
-        glm::lookAt(cameraPos, cameraPos - cameraForward, -cameraUp),   // -Z
-    };
+    glm::mat4 viewMatrices[6];
+    CubeFaceViewMatrices(viewMatrices);
     FrameBuffer::Shape shape = renderTarget->GetShape();
+    bool firstFace = true;
     for (unsigned char face = 0; face < 6; ++face) {
+        if ((cubeFaceMask & (1 << face)) == 0)
+            continue;  // culled for this face
+
         glUniformMatrix4fv(loc_view_matrix, 1, GL_FALSE, glm::value_ptr(viewMatrices[face]));
         glUniform1i(loc_cube_face, face);
         for (auto att : shape.colorAttachments) {
@@ -459,31 +1136,253 @@ void ControlledScene3D::HelperCubeRender(Mesh *mesh, int instances, Shader *shad
             renderTarget->AttachDepthCubemapFace(face);
         }
         mesh->Render(instances);
+        if (firstFace) {
+            // the remaining faces must not advance GPU-simulated meshes again
+            glUniform1f(glGetUniformLocation(shader->program, "WIST_DELTA_TIME"), 0);
+            firstFace = false;
+        }
     }
 }
 
 void ControlledScene3D::CheckCollisions()
 {
-    std::unordered_set<std::pair<GameObject *, GameObject *>, pair_hash> pairs;
+    AllocationTracker::Scope scope(ALLOCATION_COLLISIONS);
+
+    // layers[l] is tested against the layers in pairMasks[l]; collisionMasks[l1] only
+    // lists the layers l2 >= l1, so mirror it to make the test symmetric
+    uint32_t pairMasks[32] = { 0 };
     for (int layer1 = 0; layer1 < 32; ++layer1) {
         for (int layer2 = layer1; layer2 < 32; ++layer2) {
             if ((collisionMasks[layer1] & (1 << layer2)) == 0)
                 continue;
-            
-            for (auto gameObject1 : layers[layer1]) {
-                for (auto gameObject2 : layers[layer2]) {
-                    if (gameObject1 == gameObject2 ||
-                        pairs.find({gameObject1, gameObject2}) != pairs.end()) continue;
-                    
-                    std::unique_ptr<CollisionEvent> event1, event2;
-                    pairs.insert(std::make_pair(gameObject1, gameObject2));
-                    if (gameObject1->Collides(gameObject2, event1, event2)) {
-                        event1->Dispatch(gameObject1);
-                        event2->Dispatch(gameObject2);
-                    }
-                }
+            pairMasks[layer1] |= 1u << layer2;
+            pairMasks[layer2] |= 1u << layer1;
+        }
+    }
+
+    collisionStats = CollisionStats();
+    size_t pairCapacity = collisionPairs.capacity() + colliderPairs.capacity() + pairContacts.capacity();
+    size_t narrowphaseCapacity = 0;  // summed over the workers below
+    size_t contactCapacity = contacts.Capacity();
+    size_t arenaAllocations = collisionArena.GetAllocationCount();
+    collisionArena.Reset();
+
+    collisionPairs.clear();
+    if (broadphase == BROADPHASE_TREE)
+        FindTreePairs(pairMasks);
+    else
+        FindColliderPairs(pairMasks);
+
+    // contacts are found or created serially, so that the narrowphase below only
+    // writes to the contact of its own pair
+    ++collisionStep;
+    collisionStats.pairs = (unsigned int)collisionPairs.size();
+    pairContacts.clear();
+    for (auto &pair : collisionPairs) {
+        bool created;
+        size_t index = contacts.Find(pair.first, pair.second, created);
+        if (created)
+            ++collisionStats.allocations;  // the index entry of the new contact
+        Contact &contact = contacts[index];
+        contact.lastStep = collisionStep;
+        uint64_t order = ((uint64_t)contact.first->handle.index << 32) | contact.second->handle.index;
+        pairContacts.push_back({ order, index, contact.touching, created });
+    }
+
+    // narrowphase, only for the pairs whose hit areas moved since they were last tested;
+    // the transforms must not be resolved lazily from several threads
+    if (collisionWorkers.size() != JobSystem::ThreadCount()) {
+        collisionWorkers.resize(JobSystem::ThreadCount());
+        ++collisionStats.allocations;
+    }
+    for (auto &worker : collisionWorkers) {
+        worker.tests = 0;
+        narrowphaseCapacity += worker.narrowphase.GetCapacity();
+    }
+    if (parallelCollisions && JobSystem::ThreadCount() > 1) {
+        ResolveTransforms();
+        JobSystem::ParallelFor(pairContacts.size(), 64, [this](size_t begin, size_t end) {
+            TestContacts(begin, end);
+        });
+    } else {
+        TestContacts(0, pairContacts.size());
+    }
+    for (auto &worker : collisionWorkers)
+        collisionStats.tests += worker.tests;
+
+    // the order of the events only depends on the objects, not on the broadphase or
+    // on how the pairs were split between the threads
+    std::sort(pairContacts.begin(), pairContacts.end(), [](const PairContact &a, const PairContact &b) {
+        return a.order < b.order;
+    });
+
+    // single-threaded dispatch, in that order; events are built for hits only
+    for (auto &pairContact : pairContacts) {
+        Contact &contact = contacts[pairContact.contact];
+        GameObject *first = contact.first, *second = contact.second;
+        bool wasTouching = pairContact.wasTouching;
+        if (contact.touching) {
+            ++collisionStats.touching;
+            CollisionEvent *firstEvent = contact.record.CreateEvent(second, false, collisionArena);
+            CollisionEvent *secondEvent = contact.record.CreateEvent(first, true, collisionArena);
+            if (wasTouching) {
+                first->OnCollisionStay(*firstEvent);
+                second->OnCollisionStay(*secondEvent);
+            } else {
+                first->OnCollisionEnter(*firstEvent);
+                second->OnCollisionEnter(*secondEvent);
+                if (first->taskWaiters != TASK_NULL_INDEX)
+                    tasks.OnCollisionEnter(first, second);
+                if (second->taskWaiters != TASK_NULL_INDEX)
+                    tasks.OnCollisionEnter(second, first);
             }
+            firstEvent->Dispatch(first);
+            secondEvent->Dispatch(second);
+        } else if (wasTouching) {
+            first->OnCollisionExit(second);
+            second->OnCollisionExit(first);
+            physics.OnSeparated(first);
+            physics.OnSeparated(second);
+        }
+    }
+
+    // pairs the broadphase didn't report anymore are apart
+    contacts.RemoveIf([this](Contact &contact) {
+        if (contact.lastStep == collisionStep)
+            return false;
+        if (contact.touching) {
+            contact.first->OnCollisionExit(contact.second);
+            contact.second->OnCollisionExit(contact.first);
+            physics.OnSeparated(contact.first);
+            physics.OnSeparated(contact.second);
         }
+        return true;
+    });
+    // the tasks waiting for the enter events, once they are all dispatched
+    {
+        AllocationTracker::Scope tasksScope(ALLOCATION_TASKS);
+        tasks.ResumeCollisions(gameObjects);
+    }
+
+    // growing buffers are the only other allocations; none once the scene settles
+    collisionStats.allocations += (unsigned int)(collisionArena.GetAllocationCount() - arenaAllocations);
+    if (collisionPairs.capacity() + colliderPairs.capacity() + pairContacts.capacity() != pairCapacity)
+        ++collisionStats.allocations;
+    for (auto &worker : collisionWorkers)
+        narrowphaseCapacity -= worker.narrowphase.GetCapacity();
+    if (narrowphaseCapacity != 0)
+        ++collisionStats.allocations;
+    if (contacts.Capacity() != contactCapacity)
+        ++collisionStats.allocations;
+}
+
+void ControlledScene3D::StepPhysics(float scaledStep)
+{
+    if (physics.Size() == 0)
+        return;
+    AllocationTracker::Scope scope(ALLOCATION_PHYSICS);
+
+    // in the order of the contacts, so the solver gives the same result on every run
+    physicsContacts.clear();
+    for (size_t i = 0; i < contacts.Size(); ++i) {
+        Contact &contact = contacts[i];
+        if (!contact.touching) {
+            contact.manifold.count = 0;  // nothing to warm start from once they touch again
+            continue;
+        }
+        if (contact.first->rigidBody != nullptr || contact.second->rigidBody != nullptr)
+            physicsContacts.push_back(&contact);
+    }
+    physics.Step(physicsContacts, scaledStep);
+}
+
+void ControlledScene3D::TestContacts(size_t begin, size_t end)
+{
+    CollisionWorker &worker = collisionWorkers[JobSystem::ThreadIndex()];
+    Narrowphase &narrowphase = worker.narrowphase;
+    narrowphase.Clear();
+    for (size_t i = begin; i < end; ++i) {
+        Contact &contact = contacts[pairContacts[i].contact];
+        GameObject *first = contact.first, *second = contact.second;
+        AABB firstBounds = first->hitArea->GetSweptBounds();
+        AABB secondBounds = second->hitArea->GetSweptBounds();
+        if (!pairContacts[i].created && firstBounds == contact.firstBounds && secondBounds == contact.secondBounds)
+            continue;
+        contact.firstBounds = firstBounds;
+        contact.secondBounds = secondBounds;
+        // the built-in shapes are queued and tested in batches, the others right away
+        if (!narrowphase.Add(first->hitArea, second->hitArea, pairContacts[i].contact))
+            contact.touching = first->Collides(second, contact.record);
+        ++worker.tests;
+    }
+    narrowphase.Run();
+    narrowphase.ForEachResult([this](size_t index, bool touching, const ContactRecord &record) {
+        contacts[index].touching = touching;
+        contacts[index].record = record;
+    });
+}
+
+void ControlledScene3D::FindTreePairs(const uint32_t pairMasks[32])
+{
+    // broadphase: every object queries the tree for overlapping leaves on the layers
+    // it collides with; each pair is kept once, from the object with the smaller proxy
+    for (auto gameObject : gameObjects) {
+        if (gameObject->hitArea == nullptr || gameObject->proxy == AABB_TREE_NULL_NODE)
+            continue;
+        uint32_t mask = 0;
+        for (int layer = 0; layer < 32; ++layer) {
+            if (gameObject->layerMask & (1u << layer))
+                mask |= pairMasks[layer];
+        }
+        if (mask == 0)
+            continue;
+
+        int proxy = gameObject->proxy;
+        sceneTree.Query(sceneTree.GetFatBounds(proxy), mask, [&](int other) {
+            GameObject *otherObject = static_cast<GameObject *>(sceneTree.GetUserData(other));
+            if (other > proxy && otherObject->hitArea != nullptr)
+                collisionPairs.push_back({ gameObject, otherObject });
+            return true;
+        });
+    }
+}
+
+void ControlledScene3D::FindColliderPairs(const uint32_t pairMasks[32])
+{
+    Broadphase *target = broadphase == BROADPHASE_GRID ?
+        static_cast<Broadphase *>(&uniformGrid) : &sweepAndPrune;
+    if (target != colliderBroadphase) {
+        // the broadphase was switched: the colliders move over to the new one
+        for (auto gameObject : gameObjects) {
+            if (gameObject->collider != BROADPHASE_NULL_PROXY) {
+                colliderBroadphase->Remove(gameObject->collider);
+                gameObject->collider = BROADPHASE_NULL_PROXY;
+            }
+        }
+        colliderBroadphase = target;
+    }
+    uniformGrid.cellSize = gridCellSize;
+
+    // the colliders follow the world bounds of the hit areas
+    for (auto gameObject : gameObjects) {
+        HitArea *hitArea = gameObject->hitArea;
+        if (hitArea != nullptr && hitArea->support != nullptr) {
+            AABB bounds = hitArea->GetSweptBounds();
+            if (gameObject->collider == BROADPHASE_NULL_PROXY)
+                gameObject->collider = colliderBroadphase->Insert(bounds, gameObject, gameObject->layerMask);
+            else
+                colliderBroadphase->Move(gameObject->collider, bounds, gameObject->layerMask);
+        } else if (gameObject->collider != BROADPHASE_NULL_PROXY) {
+            colliderBroadphase->Remove(gameObject->collider);
+            gameObject->collider = BROADPHASE_NULL_PROXY;
+        }
+    }
+
+    colliderPairs.clear();
+    colliderBroadphase->FindPairs(pairMasks, colliderPairs);
+    for (auto &pair : colliderPairs) {
+        collisionPairs.push_back({ static_cast<GameObject *>(colliderBroadphase->GetUserData(pair.first)),
+                                   static_cast<GameObject *>(colliderBroadphase->GetUserData(pair.second)) });
     }
 }
 
@@ -513,30 +1412,24 @@ void ControlledScene3D::InitGBuffer()
     }
 }
 
-Shader *ControlledScene3D::HelperDefferedShader(std::string shaderName)
+Shader *ControlledScene3D::HelperDefferedShader(Shader *const variants[2])
 {
-    if (gBuffer != nullptr && gBuffer->NeedsCubeRendering())
-        shaderName += "/Cube";
-    return Assets::shaders[shaderName];
+    return variants[gBuffer != nullptr && gBuffer->NeedsCubeRendering() ? 1 : 0];
 }
 
-void ControlledScene3D::AccumulateLight(Light *light, bool update)
+void ControlledScene3D::AccumulateLight(Light *light)
 {
     bool cubeRender = gBuffer->NeedsCubeRendering();
-    Shader *shader = HelperDefferedShader("Deffered/LightAccumulate");
+    Shader *shader = HelperDefferedShader(lightAccumulateShaders);
     Material &material = light->material;
     material.shader = shader;
     material.SetTexture("TEXTURE_NORMAL", gBuffer->GetColorTexture(1));
     material.SetTexture("TEXTURE_WORLD_POSITION", gBuffer->GetColorTexture(2));
 
-    if (update) {
-        float deltaTime = light->useUnscaledTime ? unscaledDeltaTime : this->deltaTime;
-        light->Tick(deltaTime);
-    }
-
     light->Use();
     material.Use();
-    RenderMesh(Assets::meshes["Default/Sphere"], shader, 1, light->ObjectToWorldMatrix());
+    objectRenderDeltaTime = 0;
+    RenderMesh(Assets::meshes["Default/Sphere"], shader, 1, InterpolatedModelMatrix(light));
 }
 
 void ControlledScene3D::OnInputUpdate(float deltaTime, int mods)
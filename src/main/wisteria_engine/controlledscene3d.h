@@ -5,9 +5,21 @@
 #include "camera.h"
 #include "meshplusplus.h"
 #include "light.h"
+#include "renderqueue.h"
+#include "aabbtree.h"
+#include "objectregistry.h"
+#include "broadphase.h"
+#include "contactcache.h"
+#include "narrowphase.h"
+#include "kinematics.h"
+#include "updatescheduler.h"
+#include "tasks.h"
+#include "framearena.h"
 
 #include "components/simple_scene.h"
 
+#define CUBE_ALL_FACES 0x3F
+
 namespace engine
 {
     class GameObject;
@@ -22,6 +34,83 @@ namespace engine
         void Destroy(GameObject *gameObject);
         void AddToLayer(GameObject *gameObject, int layer);
         void RemoveFromLayer(GameObject *gameObject, int layer);
+        // the objects of the scene on a layer, in a stable order
+        const std::vector<GameObject *> &GetLayer(int layer);
+        // the object a handle refers to, or nullptr if it was destroyed since
+        GameObject *FindObject(ObjectHandle handle) const;
+
+        // keeps the object's leaf in the scene tree in sync with its bounds; called
+        // by the object itself whenever its transform, bounds or hit area change, and
+        // after the updates of the objects that swapped their mesh. Objects whose mesh is
+        // swapped from elsewhere must call it themselves
+        void UpdateProxy(GameObject *gameObject);
+        // remembers an object whose transform changed, to be resolved by ResolveTransforms
+        void QueueTransformUpdate(GameObject *gameObject);
+        // remembers an object that started moving, to get a slot in the integrator
+        void QueueMotion(GameObject *gameObject);
+        // called by GameObject::AddRigidBody; defers itself like AddToScene
+        void AddRigidBody(RigidBody *body);
+        // called by the object once its update mode or sleep changed
+        void RefreshUpdates(GameObject *gameObject);
+        // remembers an object whose world transform changed in this step: it's the only
+        // kind whose previous matrix has to catch up at the start of the next one
+        void QueueSnapshot(GameObject *gameObject);
+        // during the Tick phase of a step, whether the object is in another root hierarchy
+        // than the one ticking on the calling thread, see GameObject::ReadsStepStart
+        bool IsOutsideTickingHierarchy(GameObject *gameObject) const;
+
+        // Scripts: the task runs until its first wait, then is resumed by the scene whenever
+        // what it waits for happens (see Task). Its owner must be in the scene, and it stops
+        // once the owner is destroyed. Not from the Tick of a step, go through Defer there
+        TaskHandle StartTask(Task task);
+        void StopTask(TaskHandle task);
+        bool IsTaskRunning(TaskHandle task) const;
+
+        // Runs the command right away, or, when called from the Tick of a step (parallel or
+        // not), at the end of the Tick phase. Deferred commands are applied in the order of
+        // the objects that issued them, so the result doesn't depend on the number of
+        // threads. Destroy, AddToScene and the layer functions defer themselves.
+        void Defer(std::function<void()> command);
+
+        // spatial queries against the scene tree; only objects on the given layers whose
+        // bounds (mesh and hit area) overlap the box / contain the point are returned
+        void QueryBox(const AABB &box, uint32_t layerMask, std::vector<GameObject *> &results);
+        void QueryPoint(glm::vec3 point, uint32_t layerMask, std::vector<GameObject *> &results);
+        // closest object whose bounds are hit by the ray, or nullptr
+        GameObject *QueryRay(glm::vec3 origin, glm::vec3 direction, float maxDistance,
+                             uint32_t layerMask, float *distance = nullptr);
+
+        // Queries against the hit areas of the objects on the given layers: the scene tree
+        // finds the candidates, then the hit areas are tested exactly (see HitArea::Cast).
+        // The first hit variants return false if nothing was hit; the all hits ones sort
+        // the hits by distance. Directions don't need to be normalized.
+        bool Raycast(glm::vec3 origin, glm::vec3 direction, float maxDistance, uint32_t layerMask,
+                     RaycastHit &hit);
+        void RaycastAll(glm::vec3 origin, glm::vec3 direction, float maxDistance, uint32_t layerMask,
+                        std::vector<RaycastHit> &hits);
+        bool SphereCast(glm::vec3 origin, float radius, glm::vec3 direction, float maxDistance,
+                        uint32_t layerMask, RaycastHit &hit);
+        void SphereCastAll(glm::vec3 origin, float radius, glm::vec3 direction, float maxDistance,
+                           uint32_t layerMask, std::vector<RaycastHit> &hits);
+        void OverlapBox(const AABB &box, uint32_t layerMask, std::vector<GameObject *> &results);
+        void OverlapSphere(glm::vec3 center, float radius, uint32_t layerMask,
+                           std::vector<GameObject *> &results);
+
+        // a ray (radius 0) or sphere cast, for CastBatch
+        struct CastQuery {
+            glm::vec3 origin;
+            glm::vec3 direction;
+            float maxDistance;
+            float radius = 0;
+            uint32_t layerMask = 0xFFFFFFFF;
+        };
+        // first hit of every query, on the job system; hits[i] answers queries[i] and has
+        // a null gameObject if nothing was hit. Custom HitArea::Cast must be thread-safe
+        void CastBatch(const std::vector<CastQuery> &queries, std::vector<RaycastHit> &hits);
+
+        // scratch memory that lives until the start of the next frame, for the containers
+        // of a frame (see FrameAllocator); main thread only, not from a parallel Tick
+        FrameArena &GetFrameArena() { return frameArena; }
 
     protected:
         virtual void Initialize() {}; 
@@ -52,9 +141,28 @@ namespace engine
         void InitMeshes();
         void InitShaders();
         void Update(float deltaTimeSeconds) override;
-        void ForwardRenderScene(bool update = false);
-        void DefferedRenderScene(bool update = false);
+        void Simulate();
+        // ticks scheduled[begin, end)
+        void TickScheduled(size_t begin, size_t end);
+        void ApplyDeferredCommands();
+        // handle index of the root of the object's hierarchy in the scene, as in ScheduledUpdate
+        static uint32_t RootIndex(GameObject *gameObject);
+        void ResolveTransforms(unsigned int thread);
+        void ResolveTransforms();
+        void DestroyPending();
+        void ForwardRenderScene();
+        void DefferedRenderScene();
         void CheckCollisions();
+        // the rigid bodies, from the touching contacts of the collision step
+        void StepPhysics(float scaledStep);
+        void FindTreePairs(const uint32_t pairMasks[32]);
+        // narrowphase over pairContacts[begin, end), with the buffers of the calling thread
+        void TestContacts(size_t begin, size_t end);
+        // all hits are passed to hit(RaycastHit &); its return value is the new max distance
+        template <typename Callback>
+        void Cast(glm::vec3 origin, float radius, glm::vec3 direction, float maxDistance,
+                  uint32_t layerMask, Callback hit);
+        void FindColliderPairs(const uint32_t pairMasks[32]);
         void OnInputUpdate(float deltaTime, int mods) override;
         void OnMouseMove(int mouseX, int mouseY, int deltaX, int deltaY) override;
         // void FrameEnd() override;
@@ -62,22 +170,47 @@ namespace engine
         void ResizeDrawArea();
         void OnWindowResize(int width, int height) override;
         
-        inline Shader *HelperDefferedShader(std::string shaderName);
+        // the variant of the deffered shader for the current G-Buffer, flat or cube
+        inline Shader *HelperDefferedShader(Shader *const variants[2]);
         void HelperCubeRender(Mesh *mesh, int instances, Shader *shader);
         void RenderMesh(Mesh *mesh, Shader *shader, int instances, const glm::mat4 &modelMatrix);
-        void RenderMeshCustomMaterial(Mesh *mesh, Material material, const glm::mat4 &modelMatrix);
-        void DrawGameObject(GameObject *gameObject, bool update = false);
+        void CubeFaceViewMatrices(glm::mat4 viewMatrices[6]);
+        void SetupCullingFrusta();
+        uint8_t CullBounds(const AABB &bounds);
+        void CollectDrawPackets(RenderQueue &queue);
+        void CollectDrawPacket(GameObject *gameObject, RenderQueue &queue);
+        void PushDrawPacket(GameObject *gameObject, uint8_t faceMask, RenderQueue &queue);
+        void SubmitRenderQueue(RenderQueue &queue);
+        glm::mat4 InterpolatedModelMatrix(GameObject *gameObject);
 
         void InitGBuffer();
-        void AccumulateLight(Light *light, bool update = false);
+        void AccumulateLight(Light *light);
 
     protected:
         glm::vec4 clearColor = glm::vec4(0, 0, 0, 1);
-        std::unordered_set<GameObject *> gameObjects;
+        // every object of the scene, lights and children included
+        ObjectRegistry gameObjects;
         float deltaTime;
         float unscaledDeltaTime;
         float timeScale = 1;
 
+        // the simulation (fixed updates, collisions) runs in fixed steps of
+        // fixedDeltaTime unscaled seconds, independently of the number of cameras;
+        // at most maxSubSteps steps are run per frame, the rest of the time is dropped
+        float fixedDeltaTime = 1.0f / 60.0f;
+        int maxSubSteps = 5;
+        // if true, rendered model matrices are interpolated between the last two steps
+        bool interpolateTransforms = true;
+        // tick the root hierarchies of the scene in parallel on the job system, and
+        // integrate the motion of the moving objects there too
+        bool parallelTick = true;
+        // run the narrowphase on the job system too; collision functions registered for
+        // custom hit areas must then be safe to call concurrently on different pairs
+        bool parallelCollisions = true;
+        // keep the transforms of the scene's objects in one structure-of-arrays store,
+        // resolved level by level (see TransformStore); set it before adding objects
+        bool useTransformStore = false;
+
         std::vector<Camera *> cameras;
         Camera *mainCamera;
 
@@ -86,12 +219,94 @@ namespace engine
 
         std::vector<int> collisionMasks;
 
+        bool frustumCulling = true;
+
+        // how CheckCollisions finds the candidate pairs: the scene tree (fattened bounds
+        // of the mesh and the hit area), or a dedicated broadphase over the hit areas only
+        enum BroadphaseMode { BROADPHASE_TREE, BROADPHASE_SWEEP_AND_PRUNE, BROADPHASE_GRID };
+        BroadphaseMode broadphase = BROADPHASE_SWEEP_AND_PRUNE;
+        float gridCellSize = 2.0f;  // for BROADPHASE_GRID, about the size of the colliders
+        RenderStats renderStats;  // totals over all the cameras, for the last frame
+        CollisionStats collisionStats;  // for the last simulation step
+        PhysicsWorld physics;  // the rigid bodies of the scene, see GameObject::AddRigidBody
+
         FrameBuffer *renderTarget = nullptr;  // current render target
         FrameBuffer *gBuffer = nullptr;  // current G-Buffer
+        // looked up once, like the material of the composite pass, which every pass reuses
+        Shader *lightAccumulateShaders[2] = { nullptr, nullptr };
+        Shader *compositeShaders[2] = { nullptr, nullptr };
+        Material compositeMaterial;
 
     private:
-        std::unordered_set<GameObject *> toDestroy;
-        std::vector<std::unordered_set<GameObject *>> layers;
+        std::vector<ObjectHandle> toDestroy;  // stale handles are simply skipped
+        std::vector<GameObject *> destroyed;  // deleted at the end of DestroyPending
+
+        float accumulator = 0;
+        float interpolationAlpha = 1;
+        float objectRenderDeltaTime = 0;  // simulated time the drawn object has not yet rendered
+        uint8_t cubeFaceMask = CUBE_ALL_FACES;  // faces HelperCubeRender draws the current mesh in
+        Frustum cullingFrusta[6];  // one per cubemap face, or just the first one
+        int numCullingFrusta = 1;
+        // the objects that opted in to updates, and those ticking in the current step or
+        // frame, reused to avoid reallocations
+        UpdateScheduler updates;
+        std::vector<ScheduledUpdate> scheduled;
+        std::vector<size_t> scheduledRoots;  // where each root hierarchy starts in scheduled
+        std::vector<ScheduledUpdate> frameUpdates;
+        TaskScheduler tasks;
+
+        struct DeferredCommand {
+            size_t order;  // index in scheduled of the object whose Tick issued the command
+            size_t sequence;
+            std::function<void()> command;
+        };
+        bool tickingInParallel = false;
+        bool deferringCommands = false;  // during the Tick phase of a step, on any number of threads
+        std::vector<std::vector<DeferredCommand>> commandBuffers;  // one per job system thread
+        std::vector<size_t> tickingObject;  // per thread, index in scheduled of the object in Tick
+        std::vector<uint32_t> tickingRoots;  // per thread, root index of the hierarchy in Tick
+        std::vector<DeferredCommand *> deferredCommands;
+        // objects whose transform changed since the last resolve, one list per thread
+        std::vector<std::vector<GameObject *>> dirtyTransforms;
+        // objects moved during the parallel ticks, whose leaves are updated after them
+        std::vector<std::vector<GameObject *>> proxyQueues;
+        // objects moved since the last step, per thread; stale handles are simply skipped
+        std::vector<std::vector<ObjectHandle>> snapshotQueues;
+        TransformStore transformStore;  // only used with useTransformStore
+        // the motion of the moving objects, and those that started moving, per thread
+        KinematicIntegrator kinematics;
+        std::vector<std::vector<ObjectHandle>> motionQueues;  // stale handles are simply skipped
+
+        // every object with non-empty bounds has a leaf here; used for culling,
+        // the collision broadphase and the spatial queries
+        AABBTree sceneTree;
+        std::unordered_set<GameObject *> unboundedRenderables;  // meshes without bounds, never culled
+        AABB cullingBounds;  // bounds of all the culling frusta
+        std::vector<std::pair<GameObject *, GameObject *>> collisionPairs;
+        SweepAndPrune sweepAndPrune;
+        UniformGrid uniformGrid;
+        Broadphase *colliderBroadphase = nullptr;  // the one the colliders are currently in
+        std::vector<std::pair<int, int>> colliderPairs;
+        ContactCache contacts;
+        // contact of each pair of this step, and whether it touched before the narrowphase
+        // or was just created;
+        // sorted by order, from the handles of the objects, before dispatching the events
+        struct PairContact {
+            uint64_t order;
+            size_t contact;
+            bool wasTouching;
+            bool created;
+        };
+        std::vector<PairContact> pairContacts;
+        struct CollisionWorker {
+            Narrowphase narrowphase;
+            unsigned int tests = 0;
+        };
+        std::vector<CollisionWorker> collisionWorkers;  // one per thread
+        FrameArena collisionArena;  // the events of the current step
+        FrameArena frameArena;  // reset by FrameStart
+        std::vector<Contact *> physicsContacts;  // reused every step, see StepPhysics
+        uint32_t collisionStep = 0;
 
         glm::ivec2 windowResolution;
         float aspectRatio = 16.0f / 9.0f;
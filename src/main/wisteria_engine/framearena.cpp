@@ -0,0 +1,44 @@
+#include <new>
+#include <iostream>
+#include "framearena.h"
+
+using namespace engine;
+
+FrameArena::FrameArena(size_t blockSize) : blockSize(blockSize) {}
+
+FrameArena::~FrameArena()
+{
+    for (auto block : blocks)
+        ::operator delete(block);
+}
+
+void *FrameArena::Allocate(size_t size, size_t alignment)
+{
+    if (size + alignment > blockSize) {
+        std::cerr << "FrameArena: allocation of " << size << " bytes doesn't fit in a block.\n";
+        exit(1);
+    }
+
+    size_t start = (offset + alignment - 1) & ~(alignment - 1);
+    if (blocks.empty() || start + size > blockSize) {
+        // next block, allocating it if this is the furthest the arena ever went
+        if (!blocks.empty())
+            ++currentBlock;
+        if (currentBlock >= blocks.size()) {
+            blocks.push_back(static_cast<char *>(::operator new(blockSize)));
+            ++allocationCount;
+        }
+        start = 0;
+    }
+
+    offset = start + size;
+    used += size;
+    return blocks[currentBlock] + start;
+}
+
+void FrameArena::Reset()
+{
+    currentBlock = 0;
+    offset = 0;
+    used = 0;
+}
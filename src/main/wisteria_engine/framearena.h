@@ -0,0 +1,70 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <utility>
+
+namespace engine
+{
+    // Bump allocator for data that only lives until the next Reset, e.g. the collision
+    // events of a step. Allocating is a pointer increment; nothing is freed individually,
+    // and destructors are never run, so only objects that own no resources belong here.
+    // Running out of space adds a block, which is kept afterwards: once the arena has
+    // grown to the peak usage, it doesn't allocate anymore.
+    class FrameArena
+    {
+    public:
+        explicit FrameArena(size_t blockSize = 64 * 1024);
+        ~FrameArena();
+        FrameArena(const FrameArena &) = delete;
+        FrameArena &operator=(const FrameArena &) = delete;
+
+        void *Allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+        template <typename T, typename... Args>
+        T *New(Args &&...args) { return new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...); }
+
+        void Reset();
+
+        size_t GetUsed() const { return used; }
+        size_t GetCapacity() const { return blocks.size() * blockSize; }
+        // heap allocations done by the arena since it was created
+        size_t GetAllocationCount() const { return allocationCount; }
+
+    private:
+        std::vector<char *> blocks;
+        size_t blockSize;
+        size_t currentBlock = 0;
+        size_t offset = 0;  // in the current block
+        size_t used = 0;
+        size_t allocationCount = 0;
+    };
+
+    // Lets the standard containers allocate from an arena, for the scratch data of a
+    // frame, e.g. FrameVector<Camera *> cameras(FrameAllocator<Camera *>(arena)). Freeing
+    // does nothing, the memory comes back with the arena's Reset: the container must not
+    // be used after it, nor grow past the arena's block size.
+    template <typename T>
+    class FrameAllocator
+    {
+        template <typename U> friend class FrameAllocator;
+    public:
+        using value_type = T;
+
+        explicit FrameAllocator(FrameArena &arena) : arena(&arena) {}
+        template <typename U>
+        FrameAllocator(const FrameAllocator<U> &other) : arena(other.arena) {}
+
+        T *allocate(size_t count) { return static_cast<T *>(arena->Allocate(count * sizeof(T), alignof(T))); }
+        void deallocate(T *, size_t) {}
+
+        template <typename U>
+        bool operator==(const FrameAllocator<U> &other) const { return arena == other.arena; }
+        template <typename U>
+        bool operator!=(const FrameAllocator<U> &other) const { return arena != other.arena; }
+
+    private:
+        FrameArena *arena;
+    };
+
+    template <typename T>
+    using FrameVector = std::vector<T, FrameAllocator<T>>;
+}
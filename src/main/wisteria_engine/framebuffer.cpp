@@ -112,7 +112,7 @@ void FrameBuffer::AttachDepthCubemapFace(unsigned int face)
                            depthTexture->GetGLTextureID(), 0);
 }
 
-void FrameBuffer::Clear(bool color, bool depth, std::set<unsigned char> attachments)
+void FrameBuffer::Clear(bool color, bool depth, std::initializer_list<unsigned char> attachments)
 {
     if (!color && !depth) return;
     glBindFramebuffer(GL_FRAMEBUFFER, fbo);
@@ -1,6 +1,7 @@
 #pragma once
 #include "./controlledscene3d.h"
 #include "./texture.h"
+#include <initializer_list>
 
 namespace engine 
 {
@@ -36,7 +37,8 @@ namespace engine
         void AttachCubemapFace(unsigned int numTexture, unsigned int face);
         void AttachDepthCubemapFace(unsigned int face);
         void ClearColor(glm::vec4 clearColor) { this->clearColor = clearColor; }
-        void Clear(bool color = true, bool depth = true, std::set<unsigned char> attachments = {});
+        // attachments are the color attachments also cleared to the clear color, e.g. { 3 }
+        void Clear(bool color = true, bool depth = true, std::initializer_list<unsigned char> attachments = {});
 
         unsigned int fbo = 0;  // TODO: when done debugging, move this back to protected
 
@@ -4,6 +4,8 @@
 #include "hitarea3d.h"
 #include "gameobject3d.h"
 #include "transform3d.h"
+#include "assets.h"
+#include "controlledscene3d.h"
 
 using namespace engine;
 
@@ -16,11 +18,12 @@ GameObject::GameObject(GameObject *parent, Mesh *mesh, glm::vec3 position,
     if (parent != nullptr)
         parent->children.insert(this);
 
-    SetLocalPositionDirty(position);
-    SetLocalScaleDirty(scale);
-    SetLocalRotationDirty(rotation);
+    localPosition = position;
+    localScale = scale;
+    localRotation = rotation;
 
-    RecalculateMatrix();
+    transformDirty = true;
+    UpdateTransform();
 }
 
 GameObject::GameObject()
@@ -50,18 +53,27 @@ GameObject::~GameObject()
         child->parent = nullptr;
     }
     children.clear();
+    // the support is a child, it is destroyed with the rest of the hierarchy
+    delete hitArea;
+    delete rigidBody;
 }
 
 GameObject *GameObject::CreateChild(Mesh *mesh, glm::vec3 position, 
                                     glm::vec3 scale, glm::quat rotation) 
 {
-    return new GameObject(this, mesh, position, scale, rotation);
+    GameObject *child = new GameObject(this, mesh, position, scale, rotation);
+    if (scene != nullptr)
+        scene->AddToScene(child);
+    return child;
 }
 
 GameObject *GameObject::CreateChild(glm::vec3 position,
                                     glm::vec3 scale, glm::quat rotation)
 {
-    return new GameObject(parent, nullptr, position, scale, rotation);
+    GameObject *child = new GameObject(parent, nullptr, position, scale, rotation);
+    if (scene != nullptr)
+        scene->AddToScene(child);
+    return child;
 }
 
 std::unordered_set<GameObject *> &GameObject::GetChildren()
@@ -71,188 +83,282 @@ std::unordered_set<GameObject *> &GameObject::GetChildren()
 
 void GameObject::AddChild(GameObject *child, bool keepWorldPosition)
 {
+    // the world transform to keep, resolved while the child still has its old parent
+    glm::vec3 worldPosition, worldScale;
+    glm::quat worldRotation;
+    if (keepWorldPosition) {
+        child->UpdateTransform();
+        worldPosition = child->PositionRef();
+        worldRotation = child->RotationRef();
+        worldScale = child->PseudoScaleRef();
+    }
+
     if (child->parent != nullptr)
         child->parent->DetachChild(child);
 
-    children.insert(child);
-
-    child->parent = this;
     if (keepWorldPosition) {
-        // trigger a recalculation of the child's local position and rotation
-        child->SetPositionDirty(child->position);
-        child->SetRotationDirty(child->rotation);
-        child->SetPseudoScaleDirty(child->pseudoScale);
-    } else {
-        // trigger a recalculation of the child's world position and rotation
-        child->SetLocalPositionDirty(child->localPosition);
-        child->SetLocalRotationDirty(child->localRotation);
-        child->SetLocalScaleDirty(child->localScale);
+        // express the child's world transform relative to this object
+        UpdateTransform();
+        glm::quat inverseRotation = glm::inverse(RotationRef());
+        child->LocalPositionRef() = inverseRotation * (worldPosition - PositionRef()) / PseudoScaleRef();
+        child->LocalRotationRef() = inverseRotation * worldRotation;
+        child->LocalScaleRef() = worldScale / PseudoScaleRef();
     }
-    RecalculateMatrix();
+
+    // a hierarchy is either entirely in a transform store or not at all
+    if (child->transformStore != nullptr && child->transformStore != transformStore)
+        child->transformStore->Remove(child);
+
+    children.insert(child);
+    child->parent = this;
+    if (child->transformStore != nullptr)
+        child->transformStore->UpdateParent(child);
+    child->MarkTransformDirty();
+
+    // children added to an object already in a scene join the scene too
+    if (scene != nullptr && child->scene != scene)
+        scene->AddToScene(child);
 }
 
 void GameObject::DetachChild(GameObject *child)
 {
     children.erase(child);
     child->parent = nullptr;
+    // the local transform is now relative to the world
+    if (child->transformStore != nullptr)
+        child->transformStore->UpdateParent(child);
+    child->transformDirty = false;
+    child->MarkTransformDirty();
 }
 
-glm::vec3 GameObject::GetLocalPosition() { return localPosition; }
-glm::quat GameObject::GetLocalRotation() { return localRotation; }
-glm::vec3 GameObject::GetLocalScale() { return localScale; }
-glm::vec3 GameObject::GetPosition() { return position; }
-glm::quat GameObject::GetRotation() { return rotation; }
-glm::vec3 GameObject::GetPseudoScale() { return pseudoScale; }
+glm::vec3 GameObject::GetLocalPosition() { return LocalPositionRef(); }
+glm::vec3 GameObject::GetLocalScale() { return LocalScaleRef(); }
 
-void GameObject::SetLocalPositionDirty(glm::vec3 newLocalPos)
+glm::quat GameObject::GetLocalRotation()
 {
-    localPosition = newLocalPos;
-    if (parent == nullptr) {
-        position = newLocalPos;
-    } else {
-        glm::vec3 disp = parent->pseudoScale * newLocalPos;
-        disp = parent->rotation * disp;
-        position = parent->position + disp;
-    }
+    // with a fixed rotation, the local rotation depends on the parent's
+    if (fixedRotation && !ReadsStepStart())
+        UpdateTransform();
+    return LocalRotationRef();
+}
 
-    for (auto child : children)
-    {
-        child->SetLocalPositionDirty(child->localPosition);
-    }
+glm::vec3 GameObject::GetPosition()
+{
+    if (ReadsStepStart())
+        return previousPosition;
+    UpdateTransform();
+    return PositionRef();
 }
+
+glm::quat GameObject::GetRotation()
+{
+    if (ReadsStepStart())
+        return previousRotation;
+    UpdateTransform();
+    return RotationRef();
+}
+
+glm::vec3 GameObject::GetPseudoScale()
+{
+    if (ReadsStepStart())
+        return previousPseudoScale;
+    UpdateTransform();
+    return PseudoScaleRef();
+}
+
 void GameObject::SetLocalPosition(glm::vec3 newLocalPos)
 {
-    SetLocalPositionDirty(newLocalPos);
-    RecalculateMatrix();
+    LocalPositionRef() = newLocalPos;
+    MarkTransformDirty();
 }
 
-void GameObject::SetPositionDirty(glm::vec3 newPosition)
+void GameObject::SetPosition(glm::vec3 newPosition)
 {
-    position = newPosition;
     if (parent == nullptr) {
-        localPosition = newPosition;
+        LocalPositionRef() = newPosition;
     } else {
-        glm::vec3 disp = newPosition - parent->position;
-        disp = glm::inverse(parent->rotation) * disp;
-        localPosition = disp / parent->pseudoScale;
-    }
-
-    for (auto child : children)
-    {
-        child->SetLocalPositionDirty(child->localPosition);
+        parent->UpdateTransform();
+        glm::vec3 disp = newPosition - parent->PositionRef();
+        disp = glm::inverse(parent->RotationRef()) * disp;
+        LocalPositionRef() = disp / parent->PseudoScaleRef();
     }
+    MarkTransformDirty();
 }
-void GameObject::SetPosition(glm::vec3 newPosition)
+
+void GameObject::SetLocalScale(glm::vec3 newLocalScale)
 {
-    SetPositionDirty(newPosition);
-    RecalculateMatrix();
+    LocalScaleRef() = newLocalScale;
+    MarkTransformDirty();
 }
 
-void GameObject::SetLocalScaleDirty(glm::vec3 newLocalScale)
+void GameObject::SetPseudoScale(glm::vec3 newPseudoScale)
 {
-    localScale = newLocalScale;
-    pseudoScale = (parent == nullptr) ? newLocalScale : newLocalScale * parent->pseudoScale;
-    for (auto child : children)
-    {
-        child->SetLocalScaleDirty(child->localScale);
+    if (parent == nullptr) {
+        LocalScaleRef() = newPseudoScale;
+    } else {
+        parent->UpdateTransform();
+        LocalScaleRef() = newPseudoScale / parent->PseudoScaleRef();
     }
+    MarkTransformDirty();
 }
-void GameObject::SetLocalScale(glm::vec3 newLocalScale)
+
+void GameObject::SetLocalRotation(glm::quat newLocalRotation)
 {
-    SetLocalScaleDirty(newLocalScale);
-    RecalculateMatrix();
+    LocalRotationRef() = newLocalRotation;
+    if (fixedRotation) {
+        // the world rotation is the one that is kept, see ResolveTransform
+        glm::quat worldRotation = (parent == nullptr) ? newLocalRotation : parent->GetRotation() * newLocalRotation;
+        RotationRef() = worldRotation;
+    }
+    MarkTransformDirty();
 }
 
-void GameObject::SetPseudoScaleDirty(glm::vec3 newPseudoScale)
+void GameObject::SetRotation(glm::quat newRotation)
 {
-    pseudoScale = newPseudoScale;
-    localScale = (parent == nullptr) ? newPseudoScale : newPseudoScale / parent->pseudoScale;
-    for (auto child : children)
-    {
-        child->SetPseudoScaleDirty(child->pseudoScale);
+    if (fixedRotation) {
+        RotationRef() = newRotation;
+    } else {
+        glm::quat newLocal = (parent == nullptr) ? newRotation : glm::inverse(parent->GetRotation()) * newRotation;
+        LocalRotationRef() = newLocal;
     }
+    MarkTransformDirty();
 }
-void GameObject::SetPseudoScale(glm::vec3 newPseudoScale)
+
+glm::vec3 GameObject::GetForward() { return GetRotation() * glm::vec3_forward; }
+glm::vec3 GameObject::GetRight() { return GetRotation() * glm::vec3_right; }
+glm::vec3 GameObject::GetUp() { return GetRotation() * glm::vec3_up; }
+
+// Setters only write the local transform and flag the object and its descendants;
+// the world transforms are computed once, top-down, by UpdateTransform. A descendant
+// of a dirty object is always dirty, so a clean object means a clean subtree.
+// Objects in a TransformStore only flag their slot, the store handles the rest.
+void GameObject::MarkTransformDirty()
 {
-    SetPseudoScaleDirty(newPseudoScale);
-    RecalculateMatrix();
+    if (transformStore != nullptr) {
+        transformStore->MarkDirty(transformSlot);
+        return;
+    }
+    if (transformDirty)
+        return;
+
+    transformDirty = true;
+    if (scene != nullptr)
+        scene->QueueTransformUpdate(this);
+    for (auto child : children)
+        child->MarkTransformDirtyRecursive();
 }
 
-void GameObject::SetLocalRotationDirty(glm::quat newLocalRotation)
+void GameObject::MarkTransformDirtyRecursive()
 {
-    localRotation = newLocalRotation;
-    rotation = ((parent == nullptr) ? QUAT1 : parent->rotation) * newLocalRotation;
-    forward = rotation * glm::vec3_forward;
-    right = rotation * glm::vec3_right;
-    up = rotation * glm::vec3_up;
+    if (transformStore != nullptr) {
+        transformStore->MarkDirty(transformSlot);
+        return;
+    }
+    if (transformDirty)
+        return;
+
+    transformDirty = true;
     for (auto child : children)
-    {
-        if (child->fixedRotation)
-            child->SetRotationDirty(child->rotation);
-        else
-            child->SetLocalRotationDirty(child->localRotation);
-        child->SetLocalPositionDirty(child->localPosition);
+        child->MarkTransformDirtyRecursive();
+}
+
+void GameObject::UpdateTransform()
+{
+    if (transformStore != nullptr) {
+        transformStore->Resolve(transformSlot);
+        return;
     }
+    if (!transformDirty)
+        return;
+
+    // resolve from the topmost dirty ancestor, as the world transform depends on it
+    GameObject *top = this;
+    while (top->parent != nullptr && top->parent->transformDirty)
+        top = top->parent;
+    top->ResolveTransformRecursive();
 }
-void GameObject::SetLocalRotation(glm::quat newLocalRotation)
+
+void GameObject::ResolveTransformRecursive()
 {
-    SetLocalRotationDirty(newLocalRotation);
-    RecalculateMatrix();
+    ResolveTransform();
+    for (auto child : children) {
+        // may have been resolved already, e.g. by a getter in OnTransformChange
+        if (child->transformDirty)
+            child->ResolveTransformRecursive();
+    }
 }
 
-void GameObject::SetRotationDirty(glm::quat newRotation)
+// computes the world transform from the local one and the (resolved) parent's;
+// objects in a TransformStore are computed by the store instead
+void GameObject::ResolveTransform()
 {
-    rotation = newRotation;
-    localRotation = ((parent == nullptr) ? QUAT1 : glm::inverse(parent->rotation)) * newRotation;
-    forward = rotation * glm::vec3_forward;
-    right = rotation * glm::vec3_right;
-    up = rotation * glm::vec3_up;
-    for (auto child : children)
-    {
-        if (child->fixedRotation)
-            child->SetRotationDirty(child->rotation);
+    if (parent == nullptr) {
+        position = localPosition;
+        pseudoScale = localScale;
+        if (fixedRotation)
+            localRotation = rotation;
         else
-            child->SetLocalRotationDirty(child->localRotation);
-        child->SetLocalPositionDirty(child->localPosition);
+            rotation = localRotation;
+    } else {
+        glm::quat parentRotation = parent->RotationRef();
+        glm::vec3 parentScale = parent->PseudoScaleRef();
+        if (fixedRotation)
+            localRotation = glm::inverse(parentRotation) * rotation;
+        else
+            rotation = parentRotation * localRotation;
+        pseudoScale = localScale * parentScale;
+        position = parent->PositionRef() + parentRotation * (parentScale * localPosition);
     }
+
+    objectToWorldMatrix = transform::TRS(localPosition, localRotation, localScale);
+    if (parent != nullptr)
+        objectToWorldMatrix = parent->ObjectToWorldMatrixRef() * objectToWorldMatrix;
+
+    transformDirty = false;
+    OnTransformResolved();
 }
-void GameObject::SetRotation(glm::quat newRotation)
+
+void GameObject::OnTransformResolved()
 {
-    SetRotationDirty(newRotation);
-    RecalculateMatrix();
+    boundsDirty = true;
+    worldToObjectDirty = true;
+    if (scene != nullptr) {
+        if (!snapshotQueued) {
+            snapshotQueued = true;
+            scene->QueueSnapshot(this);
+        }
+        scene->UpdateProxy(this);
+    }
+    OnTransformChange();
 }
 
-glm::vec3 GameObject::GetForward() { return forward; }
-glm::vec3 GameObject::GetRight() { return right; }
-glm::vec3 GameObject::GetUp() { return up; }
-
-void GameObject::RecalculateMatrix()
+void GameObject::SnapshotTransform()
 {
-    objectToWorldMatrix = (parent == nullptr ? glm::mat4(1) : parent->objectToWorldMatrix) *
-        transform::Translate(localPosition) * 
-        transform::Rotate(localRotation) * 
-        transform::Scale(localScale);
-
-    OnTransformChange();
+    previousObjectToWorldMatrix = ObjectToWorldMatrixRef();
+    previousPosition = PositionRef();
+    previousRotation = RotationRef();
+    previousPseudoScale = PseudoScaleRef();
+}
 
-    for (auto child : children)
-        child->RecalculateMatrix();
+bool GameObject::ReadsStepStart()
+{
+    return scene != nullptr && scene->IsOutsideTickingHierarchy(this);
 }
 
 void GameObject::Translate(glm::vec3 translation, bool local)
 {
     if (local)
-        SetLocalPosition(localPosition + translation);
+        SetLocalPosition(GetLocalPosition() + translation);
     else
-        SetPosition(position + translation);
+        SetPosition(GetPosition() + translation);
 }
 
 void GameObject::Rotate(glm::quat rotation, bool local)
 {
     if (local)
-        SetLocalRotation(rotation * this->localRotation);
+        SetLocalRotation(rotation * GetLocalRotation());
     else {
-        SetRotation(rotation * this->rotation);
+        SetRotation(rotation * GetRotation());
     }
 }
 
@@ -264,22 +370,35 @@ void GameObject::Rotate(glm::vec3 eulerAngles, bool local)
 void GameObject::Scale(glm::vec3 scale, bool local)
 {
     if (local)
-        SetLocalScale(localScale * scale);
+        SetLocalScale(GetLocalScale() * scale);
     else
-        SetPseudoScale(pseudoScale * scale);
+        SetPseudoScale(GetPseudoScale() * scale);
 }
 
-glm::mat4 GameObject::ObjectToWorldMatrix() { return objectToWorldMatrix; }
+glm::mat4 GameObject::ObjectToWorldMatrix()
+{
+    if (ReadsStepStart())
+        return previousObjectToWorldMatrix;
+    UpdateTransform();
+    return ObjectToWorldMatrixRef();
+}
 
 glm::mat4 GameObject::WorldToObjectMatrix()
 {
-    // since this operation is not very used, we can afford to compute it on demand
-    return glm::inverse(objectToWorldMatrix);
+    // computed on demand, then cached until the transform changes
+    if (ReadsStepStart())
+        return glm::inverse(previousObjectToWorldMatrix);
+    UpdateTransform();
+    if (worldToObjectDirty) {
+        worldToObjectMatrix = glm::inverse(ObjectToWorldMatrixRef());
+        worldToObjectDirty = false;
+    }
+    return worldToObjectMatrix;
 }
 
 glm::vec3 GameObject::ObjectToWorldPosition(glm::vec3 point)
 {
-    return objectToWorldMatrix * glm::vec4(point, 1);
+    return ObjectToWorldMatrix() * glm::vec4(point, 1);
 }
 
 glm::vec3 GameObject::WorldToObjectPosition(glm::vec3 point)
@@ -289,21 +408,138 @@ glm::vec3 GameObject::WorldToObjectPosition(glm::vec3 point)
 
 void GameObject::Tick(float deltaTime)
 {
-    if (acceleration != glm::vec3(0)) {
-        velocity += acceleration * deltaTime;
-    }
-    if (velocity != glm::vec3(0)) {
-        glm::vec3 position = GetLocalPosition();
-        position += velocity * deltaTime;
-        SetLocalPosition(position);
+    // the motion is integrated by the scene, for all the moving objects at once
+}
+
+void GameObject::SetUpdateMode(UpdateMode mode, float interval)
+{
+    ChangeUpdates([this, mode, interval]() {
+        updateMode = mode;
+        updateInterval = interval;
+        return true;
+    });
+}
+
+void GameObject::Sleep(float duration)
+{
+    ChangeUpdates([this, duration]() {
+        sleeping = true;
+        sleepDuration = duration;
+        return true;
+    });
+}
+
+void GameObject::Wake()
+{
+    // waking an awake object must not restart its timer
+    ChangeUpdates([this]() {
+        if (!sleeping)
+            return false;
+        sleeping = false;
+        sleepDuration = 0;
+        return true;
+    });
+}
+
+void GameObject::ChangeUpdates(std::function<bool()> change)
+{
+    if (scene == nullptr) {
+        change();
+        return;
     }
-    if (angularVelocity != glm::vec3(0)) {
-        glm::quat rotation = GetLocalRotation();
-        float angularSpeed = glm::length(angularVelocity);
-        glm::vec3 axis = angularVelocity / angularSpeed;
-        rotation = glm::rotate(rotation, angularSpeed * deltaTime, axis);
-        SetLocalRotation(rotation);
+    scene->Defer([this, change]() {
+        if (change() && scene != nullptr)
+            scene->RefreshUpdates(this);
+    });
+}
+
+void GameObject::SetVelocity(glm::vec3 velocity)
+{
+    VelocityRef() = velocity;
+    QueueMotion();
+}
+
+void GameObject::SetAcceleration(glm::vec3 acceleration)
+{
+    AccelerationRef() = acceleration;
+    QueueMotion();
+}
+
+void GameObject::SetAngularVelocity(glm::vec3 angularVelocity)
+{
+    AngularVelocityRef() = angularVelocity;
+    QueueMotion();
+}
+
+RigidBody *GameObject::AddRigidBody(float mass)
+{
+    if (rigidBody != nullptr)
+        return rigidBody;
+    rigidBody = new RigidBody(this, mass);
+    if (scene != nullptr)
+        scene->AddRigidBody(rigidBody);
+    return rigidBody;
+}
+
+bool GameObject::HasMotion()
+{
+    return VelocityRef() != glm::vec3(0) || AccelerationRef() != glm::vec3(0) ||
+           AngularVelocityRef() != glm::vec3(0);
+}
+
+void GameObject::QueueMotion()
+{
+    // objects with a slot leave the integrator by themselves once they stop
+    if (integrator != nullptr || motionQueued || scene == nullptr || !HasMotion())
+        return;
+    motionQueued = true;
+    scene->QueueMotion(this);
+}
+
+void GameObject::SetLocalBounds(AABB bounds)
+{
+    localBounds = bounds;
+    customBounds = true;
+    boundsDirty = true;
+    if (scene != nullptr)
+        scene->UpdateProxy(this);
+}
+
+void GameObject::ResetLocalBounds()
+{
+    customBounds = false;
+    boundsDirty = true;
+    if (scene != nullptr)
+        scene->UpdateProxy(this);
+}
+
+AABB GameObject::GetLocalBounds()
+{
+    if (customBounds)
+        return localBounds;
+    return mesh ? Assets::GetMeshBounds(mesh) : AABB();
+}
+
+AABB GameObject::GetWorldBounds()
+{
+    if (ReadsStepStart())
+        return GetLocalBounds().Transformed(previousObjectToWorldMatrix);
+    UpdateTransform();
+    // the mesh is a public field, so it may have been swapped since the last update
+    if (boundsDirty || boundsMesh != mesh) {
+        worldBounds = GetLocalBounds().Transformed(ObjectToWorldMatrixRef());
+        boundsMesh = mesh;
+        boundsDirty = false;
     }
+    return worldBounds;
+}
+
+AABB GameObject::GetProxyBounds()
+{
+    AABB bounds = mesh ? GetWorldBounds() : AABB();
+    if (hitArea != nullptr && hitArea->support != nullptr)
+        bounds.Expand(hitArea->GetSweptBounds());
+    return bounds;
 }
 
 const HitArea &GameObject::GetHitArea() { return *hitArea; }
@@ -311,13 +547,27 @@ const HitArea &GameObject::GetHitArea() { return *hitArea; }
 void GameObject::SetHitArea(Shape &&shape, glm::vec3 offset, 
                             glm::vec3 scale, glm::quat rotation)
 {
-    GameObject *support = new GameObject(this, nullptr, offset, scale, rotation);
+    // replacing a hit area: its support goes away with it
+    if (hitArea != nullptr) {
+        GameObject *oldSupport = hitArea->support;
+        delete hitArea;
+        hitArea = nullptr;
+        if (oldSupport != nullptr && oldSupport->scene != nullptr) {
+            oldSupport->scene->Destroy(oldSupport);
+        } else if (oldSupport != nullptr) {
+            delete oldSupport;
+        }
+    }
+
+    GameObject *support = CreateChild(nullptr, offset, scale, rotation);
     hitArea = shape.CreateHitArea(support);
+    if (scene != nullptr)
+        scene->UpdateProxy(this);
 }
 
 bool GameObject::Contains(glm::vec3 point)
 {
-    if (hitArea->support == nullptr)
+    if (hitArea == nullptr || hitArea->support == nullptr)
         return false;
     glm::vec3 objectPoint = hitArea->support->WorldToObjectPosition(point);
     return hitArea->Contains(objectPoint);
@@ -330,15 +580,12 @@ bool GameObject::Contains(glm::vec3 point)
 // - This includes the parent's transformations
 // - Mirroring is OK
 // Failure to respect this contract will result in incorrect collision detection.
-bool GameObject::Collides(GameObject *other, CollisionEventPtr &event, CollisionEventPtr &otherEvent)
+bool GameObject::Collides(GameObject *other, ContactRecord &record)
 {
-    if (hitArea->support == nullptr || other->hitArea->support == nullptr)
+    if (hitArea == nullptr || other->hitArea == nullptr ||
+        hitArea->support == nullptr || other->hitArea->support == nullptr)
         return false;
-
-    bool collided = hitArea->Collides(other->hitArea, event, otherEvent);
-    event->gameObject = other;
-    otherEvent->gameObject = this;
-    return collided;
+    return hitArea->Collides(other->hitArea, record);
 }
 
 void GameObject::SetBoxHitArea(float width, float height, float depth, glm::vec3 offset, 
@@ -353,15 +600,44 @@ void GameObject::SetSphereHitArea(float radius, glm::vec3 offset)
     hitArea->support->fixedRotation = true;
 }
 
+void GameObject::SetMeshHitArea(Mesh *mesh)
+{
+    if (mesh == nullptr)
+        mesh = this->mesh;
+    if (mesh == nullptr) {
+        std::cerr << "SetMeshHitArea: " << name << " has no mesh" << std::endl;
+        return;
+    }
+    SetHitArea(MeshShape(Assets::GetMeshBVH(mesh)));
+}
+
+void GameObject::SetHeightfieldHitArea(Texture *heightmap, float width, float height, float depth)
+{
+    if (heightmap == nullptr || heightmap->GetRawTextureData() == nullptr) {
+        std::cerr << "SetHeightfieldHitArea: " << name << " has no heightmap data" << std::endl;
+        return;
+    }
+    SetHitArea(HeightfieldShape(Assets::GetHeightfield(heightmap), width, height, depth));
+}
+
 GameObject *GameObject::InertDeepCopy(bool keepWorldPosition)
 {
     GameObject *copy = keepWorldPosition ? 
-        new GameObject(mesh, position, localScale, rotation) : 
-        new GameObject(mesh, localPosition, localScale, localRotation);
+        new GameObject(mesh, GetPosition(), GetLocalScale(), GetRotation()) : 
+        new GameObject(mesh, GetLocalPosition(), GetLocalScale(), GetLocalRotation());
 
     for (auto child : children)
         copy->AddChild(child->InertDeepCopy(false), false);
     return copy;
 }
 
-uint32_t GameObject::GetLayerMask() { return layerMask; }
\ No newline at end of file
+uint32_t GameObject::GetLayerMask() { return layerMask; }
+
+bool GameObject::IsActiveInHierarchy()
+{
+    for (GameObject *object = this; object != nullptr; object = object->parent) {
+        if (!object->active)
+            return false;
+    }
+    return true;
+}
\ No newline at end of file
@@ -5,6 +5,16 @@
 
 #include "material.h"
 #include "hitarea3d.h"
+#include "bounds.h"
+#include "aabbtree.h"
+#include "broadphase.h"
+#include "transformstore.h"
+#include "kinematics.h"
+#include "rigidbody.h"
+#include "updatescheduler.h"
+#include "tasks.h"
+#include "pool.h"
+#include "objectregistry.h"
 
 #include "core/gpu/mesh.h"
 #include "utils/glm_utils.h"
@@ -17,6 +27,11 @@ namespace engine
     class GameObject
     {
     friend class ControlledScene3D;
+    friend class TransformStore;
+    friend class KinematicIntegrator;
+    friend class PhysicsWorld;
+    friend class UpdateScheduler;
+    friend class TaskScheduler;
     public:
         GameObject();
         GameObject(Mesh *mesh, glm::vec3 position, glm::vec3 scale = glm::vec3(1),
@@ -25,6 +40,10 @@ namespace engine
                    glm::quat rotation = QUAT1);
         virtual ~GameObject();
 
+        // objects, including the derived ones, are allocated from the size-class pools
+        static void *operator new(size_t size) { return Pools::Allocate(size); }
+        static void operator delete(void *block, size_t size) { Pools::Free(block, size); }
+
         GameObject *CreateChild(Mesh *mesh, glm::vec3 position, 
                                 glm::vec3 scale = glm::vec3(1), glm::quat rotation = QUAT1);
         GameObject *CreateChild(glm::vec3 position,
@@ -32,13 +51,37 @@ namespace engine
 
         // lifecycle
         virtual void Initialize() {};
+        // Tick is only called for objects that opted in, see SetUpdateMode. Fixed and timer
+        // updates may run on a worker thread, in parallel with the other root hierarchies of
+        // the scene. Changing this object and its children is fine; anything else (other
+        // objects, reparenting, destroying) must go through scene->Defer(), which applies it
+        // once every object ticked, on one thread or more
         virtual void Tick(float deltaTime);
 
+        // updates: objects without any (the default) are never visited by the scheduler,
+        // so static scenery costs nothing per step. The interval is for UPDATE_TIMER
+        void SetUpdateMode(UpdateMode mode, float interval = 0);
+        UpdateMode GetUpdateMode() const { return updateMode; }
+        // stops the updates until Wake, or for the given seconds of simulated time; e.g. an
+        // object can sleep in its Tick and wake up in OnCollisionEnter
+        void Sleep(float duration = 0);
+        void Wake();
+        bool IsAwake() const { return !sleeping; }
+
         // events
         virtual void OnCollision(const CollisionEvent &collision) {};
         virtual void OnCollision(const SphereBoxCollisionEvent &collision) {};
         virtual void OnCollision(const SphereSphereCollisionEvent &collision) {};
+        // contact lifetime: enter on the first step two hit areas touch, stay on the next
+        // ones, exit on the step they separate (or when the other object is destroyed).
+        // OnCollision keeps being called on every step they touch, after enter/stay
+        virtual void OnCollisionEnter(const CollisionEvent &collision) {};
+        virtual void OnCollisionStay(const CollisionEvent &collision) {};
+        virtual void OnCollisionExit(GameObject *other) {};
         virtual void OnTransformChange() {};
+        // called on the GL thread right before the object is drawn by a camera;
+        // Tick only runs in the simulation phase, so bind per-draw GL state here
+        virtual void OnBeforeRender() {};
 
         // children
         std::unordered_set<GameObject *> &GetChildren();
@@ -52,6 +95,8 @@ namespace engine
         void SetRotation(glm::quat rotation);
         glm::vec3 GetPseudoScale();
         void SetPseudoScale(glm::vec3 scale);
+        // world position at the start of the last simulation step
+        glm::vec3 GetPreviousPosition() const { return glm::vec3(previousObjectToWorldMatrix[3]); }
 
         glm::vec3 GetLocalPosition();
         void SetLocalPosition(glm::vec3 position);
@@ -65,6 +110,20 @@ namespace engine
         void Rotate(glm::vec3 eulerAngles, bool local = false);
         void Scale(glm::vec3 scale, bool local = false);
 
+        // motion, integrated by the scene after the ticks of every step, in local space
+        // (see KinematicIntegrator); objects without any are not visited at all
+        glm::vec3 GetVelocity() { return VelocityRef(); }
+        void SetVelocity(glm::vec3 velocity);
+        glm::vec3 GetAcceleration() { return AccelerationRef(); }
+        void SetAcceleration(glm::vec3 acceleration);
+        // axis times speed, in radians per second
+        glm::vec3 GetAngularVelocity() { return AngularVelocityRef(); }
+        void SetAngularVelocity(glm::vec3 angularVelocity);
+        // makes the object dynamic: its velocities are then driven by the scene's physics,
+        // from its hit area (see RigidBody). Returns the existing body if it has one
+        RigidBody *AddRigidBody(float mass = 1);
+        RigidBody *GetRigidBody() const { return rigidBody; }
+
         glm::vec3 GetForward();
         glm::vec3 GetRight();
         glm::vec3 GetUp();
@@ -75,19 +134,36 @@ namespace engine
         glm::vec3 ObjectToWorldPosition(glm::vec3 point);
         glm::vec3 WorldToObjectPosition(glm::vec3 point);
 
+        // bounds; by default the local bounds are the bounds of the mesh. Objects whose
+        // geometry is generated on the GPU must set them explicitly to be culled correctly
+        void SetLocalBounds(AABB bounds);
+        void ResetLocalBounds();
+        AABB GetLocalBounds();
+        AABB GetWorldBounds();
+
         // hit area
         HitArea const &GetHitArea();
         void SetHitArea(Shape &&shape, glm::vec3 offset = glm::vec3(0),
                         glm::vec3 scale = glm::vec3(1), glm::quat rotation = QUAT1);
         bool Contains(glm::vec3 point);
-        bool Collides(GameObject *other, CollisionEventPtr &event, CollisionEventPtr &otherEvent);
+        // the events for a hit are built from the record, see ContactRecord::CreateEvent
+        bool Collides(GameObject *other, ContactRecord &record);
         void SetBoxHitArea(float width, float height, float depth, 
                            glm::vec3 offset = glm::vec3(0), 
                            glm::vec3 scale = glm::vec3(1), glm::quat rotation = QUAT1);
         void SetSphereHitArea(float radius, glm::vec3 offset = glm::vec3(0));
+        // the triangles of a mesh (by default this object's), for exact ray and point queries
+        void SetMeshHitArea(Mesh *mesh = nullptr);
+        // terrain from a heightmap texture, spanning width x depth around this object,
+        // going up by height for the brightest pixels
+        void SetHeightfieldHitArea(Texture *heightmap, float width, float height, float depth);
 
         GameObject *InertDeepCopy(bool keepWorldPosition = true);
         uint32_t GetLayerMask();
+        // null until the object is added to a scene
+        ObjectHandle GetHandle() const { return handle; }
+        // false if this object or any of its ancestors is inactive
+        bool IsActiveInHierarchy();
 
         bool active = true;
         std::string name = "";
@@ -96,9 +172,6 @@ namespace engine
         Material material;
         ControlledScene3D *scene = nullptr;
 
-        glm::vec3 velocity = glm::vec3(0);
-        glm::vec3 angularVelocity = glm::vec3(0);
-        glm::vec3 acceleration = glm::vec3(0);
         bool useUnscaledTime = false;
 
         // if true, this gameobject will not change its world rotation when
@@ -109,13 +182,44 @@ namespace engine
         GameObject(GameObject *parent, Mesh *mesh, glm::vec3 position, 
                    glm::vec3 scale = glm::vec3(1), glm::quat rotation = QUAT1);
 
-        void SetLocalPositionDirty(glm::vec3 position);
-        void SetLocalRotationDirty(glm::quat rotation);
-        void SetLocalScaleDirty(glm::vec3 scale);
-        void SetPositionDirty(glm::vec3 position);
-        void SetRotationDirty(glm::quat rotation);
-        void SetPseudoScaleDirty(glm::vec3 scale);
-        void RecalculateMatrix();
+        // world transforms are resolved lazily, see MarkTransformDirty
+        void MarkTransformDirty();
+        void MarkTransformDirtyRecursive();
+        void UpdateTransform();
+        void ResolveTransformRecursive();
+        void ResolveTransform();
+        // called once the world transform was recomputed, by ResolveTransform or the store
+        void OnTransformResolved();
+        // the current world transform becomes the one of the start of the step
+        void SnapshotTransform();
+        // During the Tick phase of a step, the objects of the other root hierarchies may be
+        // ticking on another thread: the getters read their transform at the start of the
+        // step instead, and never resolve them
+        bool ReadsStepStart();
+        // bounds of this object in the scene tree: mesh bounds and hit area bounds
+        AABB GetProxyBounds();
+
+        // the transform lives in these fields, or in the scene's TransformStore while the
+        // object has a slot there; the transform code only accesses it through these
+        glm::vec3 &LocalPositionRef() { return transformStore ? transformStore->localPositions[transformSlot] : localPosition; }
+        glm::quat &LocalRotationRef() { return transformStore ? transformStore->localRotations[transformSlot] : localRotation; }
+        glm::vec3 &LocalScaleRef() { return transformStore ? transformStore->localScales[transformSlot] : localScale; }
+        glm::vec3 &PositionRef() { return transformStore ? transformStore->positions[transformSlot] : position; }
+        glm::quat &RotationRef() { return transformStore ? transformStore->rotations[transformSlot] : rotation; }
+        glm::vec3 &PseudoScaleRef() { return transformStore ? transformStore->pseudoScales[transformSlot] : pseudoScale; }
+        glm::mat4 &ObjectToWorldMatrixRef() { return transformStore ? transformStore->matrices[transformSlot] : objectToWorldMatrix; }
+
+        // the motion lives in these fields, or in the scene's KinematicIntegrator while the
+        // object has a slot there
+        glm::vec3 &VelocityRef() { return integrator ? integrator->velocities[kinematicSlot] : velocity; }
+        glm::vec3 &AccelerationRef() { return integrator ? integrator->accelerations[kinematicSlot] : acceleration; }
+        glm::vec3 &AngularVelocityRef() { return integrator ? integrator->angularVelocities[kinematicSlot] : angularVelocity; }
+        bool HasMotion();
+        // asks the scene for a slot in its integrator, once the object started moving
+        void QueueMotion();
+        // applies a change of the update fields, then lets the scheduler know if it returns
+        // true; deferred during the Tick phase of a step, like the other scene changes
+        void ChangeUpdates(std::function<bool()> change);
 
         glm::vec3 localPosition = glm::vec3(0);
         glm::vec3 localScale = glm::vec3(1);
@@ -123,14 +227,57 @@ namespace engine
         glm::vec3 position = glm::vec3(0);
         glm::quat rotation = QUAT1;
         glm::vec3 pseudoScale = glm::vec3(1);
-        glm::vec3 forward = glm::vec3_forward;
-        glm::vec3 right = glm::vec3_right;
-        glm::vec3 up = glm::vec3_up;
         glm::mat4 objectToWorldMatrix = glm::mat4(1);
+        // the world transform (position, rotation, pseudoScale, matrix) is out of date
+        bool transformDirty = false;
+        TransformStore *transformStore = nullptr;
+        int transformSlot = -1;
+        // inverse of the world matrix, computed on demand
+        glm::mat4 worldToObjectMatrix = glm::mat4(1);
+        bool worldToObjectDirty = true;
+        // world transform at the start of the last simulation step, used for interpolation
+        // and by the Ticks of the other hierarchies, see ReadsStepStart
+        glm::mat4 previousObjectToWorldMatrix = glm::mat4(1);
+        glm::vec3 previousPosition = glm::vec3(0);
+        glm::quat previousRotation = QUAT1;
+        glm::vec3 previousPseudoScale = glm::vec3(1);
+        glm::vec3 velocity = glm::vec3(0);
+        glm::vec3 acceleration = glm::vec3(0);
+        glm::vec3 angularVelocity = glm::vec3(0);
+        KinematicIntegrator *integrator = nullptr;
+        int kinematicSlot = -1;
+        bool motionQueued = false;  // waiting for a slot, see ControlledScene3D::QueueMotion
+        RigidBody *rigidBody = nullptr;
+        // simulated time, in the object's clock, of its last draw (see
+        // ControlledScene3D::SubmitRenderQueue)
+        double renderedTime = 0;
+        bool snapshotQueued = false;  // moved in this step, see ControlledScene3D::QueueSnapshot
+
+        UpdateMode updateMode = UPDATE_NONE;
+        float updateInterval = 0;
+        bool sleeping = false;
+        float sleepDuration = 0;  // 0 to sleep until woken
+        // where the object is in the scheduler's lists, and the version its timers must have
+        int updateList = -1;
+        int updateSlot = -1;
+        uint32_t updateVersion = 0;
+        double lastUpdateTime = 0;  // of the last timer update
+        uint32_t taskWaiters = TASK_NULL_INDEX;  // the tasks waiting for a collision, see TaskScheduler
+
+        AABB localBounds;
+        bool customBounds = false;
+        AABB worldBounds;
+        bool boundsDirty = true;  // set whenever the world matrix changes
+        Mesh *boundsMesh = nullptr;  // the mesh the world bounds were computed for
+
+        int proxy = AABB_TREE_NULL_NODE;  // leaf in the scene tree, if any
+        int collider = BROADPHASE_NULL_PROXY;  // hit area proxy in the collision broadphase
+        bool proxyDirty = false;  // moved during a parallel Tick, the leaf is updated after it
 
         GameObject *parent = nullptr;
-        HitArea *hitArea;
+        HitArea *hitArea = nullptr;
         std::unordered_set<GameObject *> children;
         uint32_t layerMask = 0x00000001;
+        ObjectHandle handle;
     };
 }
\ No newline at end of file
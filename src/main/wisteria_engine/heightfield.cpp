@@ -0,0 +1,331 @@
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include "heightfield.h"
+
+#define HEIGHTFIELD_EPSILON 1e-6f  // tolerance of the ray tests, so rays don't slip between triangles
+
+using namespace engine;
+
+namespace
+{
+    // real-time collision detection, 5.1.5
+    glm::vec3 ClosestPointOnTriangle(glm::vec3 p, glm::vec3 a, glm::vec3 b, glm::vec3 c)
+    {
+        glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+        float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+        if (d1 <= 0 && d2 <= 0)
+            return a;
+
+        glm::vec3 bp = p - b;
+        float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+        if (d3 >= 0 && d4 <= d3)
+            return b;
+
+        float vc = d1 * d4 - d3 * d2;
+        if (vc <= 0 && d1 >= 0 && d3 <= 0)
+            return a + ab * (d1 / (d1 - d3));
+
+        glm::vec3 cp = p - c;
+        float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+        if (d6 >= 0 && d5 <= d6)
+            return c;
+
+        float vb = d5 * d2 - d1 * d6;
+        if (vb <= 0 && d2 >= 0 && d6 <= 0)
+            return a + ac * (d2 / (d2 - d6));
+
+        float va = d3 * d6 - d5 * d4;
+        if (va <= 0 && d4 - d3 >= 0 && d5 - d6 >= 0)
+            return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+        float denominator = 1.0f / (va + vb + vc);
+        return a + ab * (vb * denominator) + ac * (vc * denominator);
+    }
+
+    // distance along the ray to the triangle, or -1
+    float RayTriangle(glm::vec3 origin, glm::vec3 direction, glm::vec3 v0, glm::vec3 v1, glm::vec3 v2)
+    {
+        glm::vec3 e1 = v1 - v0, e2 = v2 - v0;
+        glm::vec3 p = glm::cross(direction, e2);
+        float determinant = glm::dot(e1, p);
+        if (glm::abs(determinant) < 1e-12f)
+            return -1;
+        float invDeterminant = 1.0f / determinant;
+        glm::vec3 s = origin - v0;
+        float u = glm::dot(s, p) * invDeterminant;
+        if (u < -HEIGHTFIELD_EPSILON || u > 1 + HEIGHTFIELD_EPSILON)
+            return -1;
+        glm::vec3 q = glm::cross(s, e1);
+        float v = glm::dot(direction, q) * invDeterminant;
+        if (v < -HEIGHTFIELD_EPSILON || u + v > 1 + HEIGHTFIELD_EPSILON)
+            return -1;
+        return glm::dot(e2, q) * invDeterminant;
+    }
+
+    // one side of a Sutherland-Hodgman clip in the xz plane, keeping the part of the
+    // polygon where sign * (point[axis] - bound) >= 0; y is linear, so it stays exact
+    int Clip(const glm::vec3 *in, int count, glm::vec3 *out, int axis, float bound, float sign)
+    {
+        int outCount = 0;
+        for (int k = 0; k < count; ++k) {
+            glm::vec3 a = in[k], b = in[(k + 1) % count];
+            float da = sign * (a[axis] - bound), db = sign * (b[axis] - bound);
+            if (da >= 0)
+                out[outCount++] = a;
+            if ((da >= 0) != (db >= 0))
+                out[outCount++] = a + (b - a) * (da / (da - db));
+        }
+        return outCount;
+    }
+
+    // the cells overlapped by [min, max] along an axis of count samples, empty if last < first
+    void CellRange(float min, float max, float spacing, int count, int &first, int &last)
+    {
+        first = std::max(static_cast<int>(glm::floor(min / spacing)), 0);
+        last = std::min(static_cast<int>(glm::floor(max / spacing)), count - 2);
+    }
+}
+
+void Heightfield::Build(const float *heights, int columns, int rows)
+{
+    if (columns < 2 || rows < 2) {
+        std::cerr << "Heightfield: needs at least 2 x 2 samples, got " << columns << " x " << rows << std::endl;
+        exit(1);
+    }
+    this->columns = columns;
+    this->rows = rows;
+    this->heights.assign(heights, heights + (size_t)columns * rows);
+    ComputeRange();
+}
+
+void Heightfield::Build(const unsigned char *pixels, int columns, int rows, size_t stride)
+{
+    std::vector<float> samples((size_t)columns * rows);
+    for (size_t k = 0; k < samples.size(); ++k)
+        samples[k] = pixels[k * stride] / 255.0f;
+    Build(samples.data(), columns, rows);
+}
+
+void Heightfield::ComputeRange()
+{
+    auto range = std::minmax_element(heights.begin(), heights.end());
+    minHeight = *range.first;
+    maxHeight = *range.second;
+}
+
+void Heightfield::GetTriangles(int i, int j, glm::vec3 spacing, glm::vec3 (&triangles)[2][3]) const
+{
+    glm::vec3 p00 = glm::vec3(i, At(i, j), j) * spacing;
+    glm::vec3 p10 = glm::vec3(i + 1, At(i + 1, j), j) * spacing;
+    glm::vec3 p01 = glm::vec3(i, At(i, j + 1), j + 1) * spacing;
+    glm::vec3 p11 = glm::vec3(i + 1, At(i + 1, j + 1), j + 1) * spacing;
+    triangles[0][0] = p00; triangles[0][1] = p10; triangles[0][2] = p01;
+    triangles[1][0] = p11; triangles[1][1] = p01; triangles[1][2] = p10;
+}
+
+float Heightfield::GetCellMaxHeight(int i, int j) const
+{
+    return std::max(std::max(At(i, j), At(i + 1, j)), std::max(At(i, j + 1), At(i + 1, j + 1)));
+}
+
+bool Heightfield::GetHeight(float x, float z, glm::vec3 spacing, float &height) const
+{
+    float gx = x / spacing.x, gz = z / spacing.z;
+    if (!(gx >= 0 && gx <= columns - 1 && gz >= 0 && gz <= rows - 1))
+        return false;
+
+    int i = std::min(static_cast<int>(gx), columns - 2);
+    int j = std::min(static_cast<int>(gz), rows - 2);
+    float fx = gx - i, fz = gz - j;
+    float h;
+    if (fx + fz <= 1) {
+        float h00 = At(i, j);
+        h = h00 + fx * (At(i + 1, j) - h00) + fz * (At(i, j + 1) - h00);
+    } else {
+        float h11 = At(i + 1, j + 1);
+        h = h11 + (1 - fx) * (At(i, j + 1) - h11) + (1 - fz) * (At(i + 1, j) - h11);
+    }
+    height = h * spacing.y;
+    return true;
+}
+
+bool Heightfield::IsUnder(glm::vec3 point, glm::vec3 spacing, float &height) const
+{
+    return GetHeight(point.x, point.z, spacing, height) && point.y < height &&
+           point.y >= minHeight * spacing.y;
+}
+
+bool Heightfield::ClosestPoint(glm::vec3 point, float maxDistance, glm::vec3 spacing, glm::vec3 &closest) const
+{
+    int i0, i1, j0, j1;
+    CellRange(point.x - maxDistance, point.x + maxDistance, spacing.x, columns, i0, i1);
+    CellRange(point.z - maxDistance, point.z + maxDistance, spacing.z, rows, j0, j1);
+
+    float best = maxDistance * maxDistance;
+    bool found = false;
+    for (int j = j0; j <= j1; ++j) {
+        for (int i = i0; i <= i1; ++i) {
+            // skip the cells whose bounds are already further than the best point
+            float cellMin = std::min(std::min(At(i, j), At(i + 1, j)), std::min(At(i, j + 1), At(i + 1, j + 1)));
+            glm::vec3 boundsMin = glm::vec3(i, cellMin, j) * spacing;
+            glm::vec3 boundsMax = glm::vec3(i + 1, GetCellMaxHeight(i, j), j + 1) * spacing;
+            glm::vec3 outside = point - glm::clamp(point, boundsMin, boundsMax);
+            if (glm::dot(outside, outside) > best)
+                continue;
+
+            glm::vec3 triangles[2][3];
+            GetTriangles(i, j, spacing, triangles);
+            for (auto &triangle : triangles) {
+                glm::vec3 candidate = ClosestPointOnTriangle(point, triangle[0], triangle[1], triangle[2]);
+                glm::vec3 offset = candidate - point;
+                float distance = glm::dot(offset, offset);
+                if (distance <= best) {
+                    best = distance;
+                    closest = candidate;
+                    found = true;
+                }
+            }
+        }
+    }
+    return found;
+}
+
+bool Heightfield::GetMaxHeight(glm::vec2 min, glm::vec2 max, glm::vec3 spacing, float &height) const
+{
+    // the rectangle, clamped to the grid
+    min = glm::max(min, glm::vec2(0));
+    max = glm::min(max, glm::vec2((columns - 1) * spacing.x, (rows - 1) * spacing.z));
+    if (min.x > max.x || min.y > max.y)
+        return false;
+
+    int i0, i1, j0, j1;
+    CellRange(min.x, max.x, spacing.x, columns, i0, i1);
+    CellRange(min.y, max.y, spacing.z, rows, j0, j1);
+
+    // the surface is linear over a triangle, so its highest point over the part of the
+    // triangle inside the rectangle is a corner of that part
+    float highest = -std::numeric_limits<float>::infinity();
+    for (int j = j0; j <= j1; ++j) {
+        for (int i = i0; i <= i1; ++i) {
+            bool inside = i * spacing.x >= min.x && (i + 1) * spacing.x <= max.x &&
+                          j * spacing.z >= min.y && (j + 1) * spacing.z <= max.y;
+            if (inside) {
+                highest = std::max(highest, GetCellMaxHeight(i, j) * spacing.y);
+                continue;
+            }
+            if (GetCellMaxHeight(i, j) * spacing.y <= highest)
+                continue;
+
+            glm::vec3 triangles[2][3];
+            GetTriangles(i, j, spacing, triangles);
+            for (auto &triangle : triangles) {
+                // a triangle clipped by 4 sides has at most 7 corners
+                glm::vec3 polygon[8], clipped[8];
+                int count = Clip(triangle, 3, clipped, 0, min.x, 1);
+                count = Clip(clipped, count, polygon, 0, max.x, -1);
+                count = Clip(polygon, count, clipped, 2, min.y, 1);
+                count = Clip(clipped, count, polygon, 2, max.y, -1);
+                for (int k = 0; k < count; ++k)
+                    highest = std::max(highest, polygon[k].y);
+            }
+        }
+    }
+    if (highest == -std::numeric_limits<float>::infinity())
+        return false;
+    height = highest;
+    return true;
+}
+
+bool Heightfield::Raycast(glm::vec3 origin, glm::vec3 direction, float maxDistance, glm::vec3 spacing,
+                          HeightfieldHit &hit) const
+{
+    float startHeight;
+    if (IsUnder(origin, spacing, startHeight)) {
+        hit.distance = 0;
+        hit.normal = -direction;
+        return true;
+    }
+
+    // in grid units, where cells are 1 x 1 and heights are the samples; distances along
+    // the ray stay the same
+    glm::vec3 gridOrigin = origin / spacing;
+    glm::vec3 gridDirection = direction / spacing;
+
+    // the part of the ray over the grid, in its bounds
+    glm::vec3 invDirection = 1.0f / gridDirection;
+    glm::vec3 t1 = (glm::vec3(0, minHeight, 0) - gridOrigin) * invDirection;
+    glm::vec3 t2 = (glm::vec3(columns - 1, maxHeight, rows - 1) - gridOrigin) * invDirection;
+    glm::vec3 tMin = glm::min(t1, t2), tMax = glm::max(t1, t2);
+    float enter = glm::max(glm::max(tMin.x, tMin.y), glm::max(tMin.z, 0.0f));
+    float exit = glm::min(glm::min(tMax.x, tMax.y), glm::min(tMax.z, maxDistance));
+    if (!(enter <= exit))
+        return false;
+
+    // entering the grid from a side, under the surface: the side of the solid
+    const float infinity = std::numeric_limits<float>::infinity();
+    glm::vec3 start = gridOrigin + gridDirection * enter;
+    float entryHeight;
+    glm::vec3 entry = glm::clamp(start, glm::vec3(0, -infinity, 0), glm::vec3(columns - 1, infinity, rows - 1));
+    if (enter > 0 && tMin.y < enter && IsUnder(entry * spacing, spacing, entryHeight)) {
+        int axis = tMin.x >= tMin.z ? 0 : 2;
+        hit.distance = enter;
+        hit.normal = glm::vec3(0);
+        hit.normal[axis] = direction[axis] > 0 ? -1.0f : 1.0f;
+        return true;
+    }
+
+    // walk the cells under the ray, in order (Amanatides and Woo)
+    int i = glm::clamp(static_cast<int>(glm::floor(start.x)), 0, columns - 2);
+    int j = glm::clamp(static_cast<int>(glm::floor(start.z)), 0, rows - 2);
+    int stepI = gridDirection.x > 0 ? 1 : -1, stepJ = gridDirection.z > 0 ? 1 : -1;
+    float deltaI = gridDirection.x != 0 ? glm::abs(invDirection.x) : infinity;
+    float deltaJ = gridDirection.z != 0 ? glm::abs(invDirection.z) : infinity;
+    float nextI = gridDirection.x != 0 ? enter + ((i + (stepI > 0)) - start.x) * invDirection.x : infinity;
+    float nextJ = gridDirection.z != 0 ? enter + ((j + (stepJ > 0)) - start.z) * invDirection.z : infinity;
+
+    float t = enter;
+    while (t <= exit) {
+        float cellExit = std::min(std::min(nextI, nextJ), exit);
+        // only the cells the ray dips low enough over
+        float lowest = gridOrigin.y + gridDirection.y * (gridDirection.y < 0 ? cellExit : t);
+        if (lowest <= GetCellMaxHeight(i, j)) {
+            glm::vec3 triangles[2][3];
+            GetTriangles(i, j, glm::vec3(1), triangles);
+            float closest = infinity;
+            int closestTriangle = -1;
+            for (int k = 0; k < 2; ++k) {
+                float distance = RayTriangle(gridOrigin, gridDirection,
+                                             triangles[k][0], triangles[k][1], triangles[k][2]);
+                if (distance >= 0 && distance < closest) {
+                    closest = distance;
+                    closestTriangle = k;
+                }
+            }
+            if (closestTriangle >= 0 && closest <= exit) {
+                glm::vec3 *triangle = triangles[closestTriangle];
+                glm::vec3 normal = glm::cross(triangle[2] - triangle[0], triangle[1] - triangle[0]);
+                // back to the scaled space, with the inverse transpose of the scaling
+                normal = glm::normalize(normal / spacing);
+                hit.distance = closest;
+                hit.normal = glm::dot(normal, direction) > 0 ? -normal : normal;
+                return true;
+            }
+        }
+
+        if (nextI < nextJ) {
+            i += stepI;
+            t = nextI;
+            nextI += deltaI;
+            if (i < 0 || i > columns - 2)
+                break;
+        } else {
+            j += stepJ;
+            t = nextJ;
+            nextJ += deltaJ;
+            if (j < 0 || j > rows - 2)
+                break;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include "utils/glm_utils.h"
+
+namespace engine
+{
+    struct HeightfieldHit {
+        float distance = 0;  // in units of the ray direction
+        glm::vec3 normal = glm::vec3(0);  // of the surface, normalized, facing the ray
+    };
+
+    // A grid of heights, e.g. a terrain heightmap, kept on the CPU for collisions and
+    // queries. Every cell between 4 samples is split into 2 triangles along the same
+    // diagonal, so the surface is the one a grid mesh of the heights would draw.
+    // The queries work in the grid's own space, scaled by spacing: sample (i, j) sits
+    // at (i * spacing.x, height * spacing.y, j * spacing.z), and the grid is solid from
+    // the lowest sample up to the surface. Sampling a height is O(1), the other queries
+    // only look at the cells under the region they cover.
+    class Heightfield
+    {
+    public:
+        // columns along x, rows along z, row by row
+        void Build(const float *heights, int columns, int rows);
+        // the first byte of every pixel, stride bytes apart, as a height from 0 to 1
+        void Build(const unsigned char *pixels, int columns, int rows, size_t stride);
+
+        // height of the surface above (x, z); false outside the grid
+        bool GetHeight(float x, float z, glm::vec3 spacing, float &height) const;
+        // whether point is in the solid part of the grid; height is the surface's above it
+        bool IsUnder(glm::vec3 point, glm::vec3 spacing, float &height) const;
+        // closest point of the surface to point, if there is one within maxDistance
+        bool ClosestPoint(glm::vec3 point, float maxDistance, glm::vec3 spacing, glm::vec3 &closest) const;
+        // highest point of the surface over the rectangle min..max (x and z); false if
+        // the rectangle is outside the grid
+        bool GetMaxHeight(glm::vec2 min, glm::vec2 max, glm::vec3 spacing, float &height) const;
+        // first hit of origin + t * direction with the surface for t in [0, maxDistance],
+        // walking the cells under the ray; a ray starting in the solid hits at 0
+        bool Raycast(glm::vec3 origin, glm::vec3 direction, float maxDistance, glm::vec3 spacing,
+                     HeightfieldHit &hit) const;
+
+        int GetColumns() const { return columns; }
+        int GetRows() const { return rows; }
+        float GetMinHeight() const { return minHeight; }
+        float GetMaxHeight() const { return maxHeight; }
+        float At(int i, int j) const { return heights[(size_t)j * columns + i]; }
+
+    private:
+        void ComputeRange();
+        // the 2 triangles of cell (i, j), in the scaled space, lower one first
+        void GetTriangles(int i, int j, glm::vec3 spacing, glm::vec3 (&triangles)[2][3]) const;
+        float GetCellMaxHeight(int i, int j) const;
+
+        std::vector<float> heights;
+        int columns = 0, rows = 0;
+        float minHeight = 0, maxHeight = 0;
+    };
+}
@@ -1,23 +1,194 @@
 #include "hitarea3d.h"
 #include "gameobject3d.h"
+#include "aabbtree.h"
 #include <iostream>
+#include <atomic>
+
+// conservative advancement of a sphere swept or cast against a box
+#define SWEEP_MAX_ITERATIONS 32
+#define SWEEP_TOLERANCE 1e-3f  // of the radius
+#define HEIGHTFIELD_MAX_CAST_STEPS 4096
 
 using namespace engine;
 
-std::unordered_map<HitArea::type_pair, HitArea::CollidesFunc, HitArea::pair_hash> HitArea::collisionFuncs;
+namespace
+{
+    // the tests on plain shapes, shared by the discrete and the swept collisions
+    bool SphereSphere(glm::vec3 center, float radius, glm::vec3 otherCenter, float otherRadius,
+                      ContactRecord &record)
+    {
+        glm::vec3 displacement = otherCenter - center;
+        float distance = glm::length(displacement);
+        float sumRadius = radius + otherRadius;
+        record.createEvent = &SphereSphereCollisionEvent::Create;
+        record.displacement = displacement;
+        record.distance = distance;
+        record.sumRadius = sumRadius;
+        return distance <= sumRadius;
+    }
+
+    bool BoxSphere(glm::vec3 boxCenter, glm::vec3 halfSize, glm::vec3 sphereCenter, float radius,
+                   ContactRecord &record)
+    {
+        glm::vec3 closestPoint = glm::min(glm::max(sphereCenter, boxCenter - halfSize), boxCenter + halfSize);
+        glm::vec3 displacement = sphereCenter - closestPoint;
+        float distance = glm::length(displacement);
+        record.createEvent = &SphereBoxCollisionEvent::Create;
+        record.point = closestPoint;
+        record.displacement = displacement;
+        record.distance = distance;
+        return distance <= radius;
+    }
+
+    // the casts of HitArea::Cast on plain shapes; direction is normalized
+    bool CastSphere(glm::vec3 center, float sphereRadius, glm::vec3 origin, float radius,
+                    glm::vec3 direction, float maxDistance, RaycastHit &hit)
+    {
+        // first root of |origin + t * direction - center| = sphereRadius + radius
+        float sumRadius = sphereRadius + radius;
+        glm::vec3 offset = origin - center;
+        float b = glm::dot(offset, direction);
+        float c = glm::dot(offset, offset) - sumRadius * sumRadius;
+        if (c > 0 && b > 0)
+            return false;
+        float discriminant = b * b - c;
+        if (discriminant < 0)
+            return false;
+        float t = glm::max(-b - glm::sqrt(discriminant), 0.0f);
+        if (t > maxDistance)
+            return false;
+
+        glm::vec3 toCast = origin + t * direction - center;
+        float length = glm::length(toCast);
+        hit.distance = t;
+        hit.normal = length > 0 ? toCast / length : -direction;
+        hit.point = center + hit.normal * sphereRadius;
+        return true;
+    }
+
+    bool CastBox(glm::vec3 center, glm::vec3 halfSize, glm::vec3 origin, float radius,
+                 glm::vec3 direction, float maxDistance, RaycastHit &hit)
+    {
+        // the box grown by the radius contains the rounded box the sphere center must
+        // reach, so the cast can only start touching after entering it
+        glm::vec3 grown = halfSize + radius;
+        float t = AABBTree::RayBoxDistance(origin, 1.0f / direction, maxDistance,
+                                           AABB(center - grown, center + grown));
+        if (t < 0)
+            return false;
+
+        if (radius <= 0) {
+            hit.distance = t;
+            hit.point = origin + t * direction;
+            // the face the ray entered through, the one furthest out along its axis
+            glm::vec3 local = (hit.point - center) / glm::max(halfSize, glm::vec3(1e-6f));
+            glm::vec3 distances = glm::abs(local);
+            int axis = distances.x > distances.y ? (distances.x > distances.z ? 0 : 2)
+                                                 : (distances.y > distances.z ? 1 : 2);
+            hit.normal = glm::vec3(0);
+            hit.normal[axis] = local[axis] < 0 ? -1.0f : 1.0f;
+            if (t == 0)
+                hit.normal = -direction;  // starts inside
+            return true;
+        }
+
+        ContactRecord record;
+        for (int i = 0; i < SWEEP_MAX_ITERATIONS; ++i) {
+            bool touching = BoxSphere(center, halfSize, origin + t * direction, radius, record);
+            float gap = record.distance - radius;
+            if (touching || gap <= radius * SWEEP_TOLERANCE) {
+                hit.distance = t;
+                hit.point = record.point;
+                hit.normal = record.distance > 0 ? record.displacement / record.distance : -direction;
+                return true;
+            }
+            t += gap;
+            if (t > maxDistance)
+                return false;
+        }
+        return false;  // grazing the box
+    }
+}
+
+HitArea::CollidesFunc HitArea::collisionTable[HITAREA_MAX_TYPES][HITAREA_MAX_TYPES];
 
-bool HitArea::Collides(HitArea *other, CollisionEventPtr &event, CollisionEventPtr &otherEvent)
+int HitArea::NextTypeId()
 {
-    auto collisionFunc = collisionFuncs.find({GetType(), other->GetType()});
-    if (collisionFunc == collisionFuncs.end())
+    static std::atomic<int> typeCount(0);
+    int id = typeCount++;
+    if (id >= HITAREA_MAX_TYPES) {
+        std::cerr << "Too many hit area types, increase HITAREA_MAX_TYPES" << std::endl;
+        exit(1);
+    }
+    return id;
+}
+
+AABB HitArea::GetSweptBounds()
+{
+    AABB bounds = GetBounds();
+    if (continuous) {
+        glm::vec3 motion = GetMotion();
+        bounds.Expand(AABB(bounds.min - motion, bounds.max - motion));
+    }
+    return bounds;
+}
+
+glm::vec3 HitArea::GetMotion()
+{
+    return support->GetPosition() - support->GetPreviousPosition();
+}
+
+bool HitArea::Cast(glm::vec3 origin, float radius, glm::vec3 direction, float maxDistance,
+                   RaycastHit &hit)
+{
+    AABB bounds = GetBounds();
+    return CastBox(bounds.Center(), bounds.Extents(), origin, radius,
+                   direction, maxDistance, hit);
+}
+
+bool HitArea::Overlaps(const AABB &box)
+{
+    return GetBounds().Overlaps(box);
+}
+
+bool HitArea::Overlaps(glm::vec3 center, float radius)
+{
+    AABB bounds = GetBounds();
+    glm::vec3 closestPoint = glm::clamp(center, bounds.min, bounds.max);
+    return glm::distance(center, closestPoint) <= radius;
+}
+
+bool HitArea::Collides(HitArea *other, ContactRecord &record)
+{
+    record.timeOfImpact = 1;
+    // a sphere is only swept if it moved more than its radius, relative to the other
+    int sphere = TypeId<SphereHitArea>(), box = TypeId<BoxHitArea>();
+    if (continuous || other->continuous) {
+        glm::vec3 motion = GetMotion() - other->GetMotion();
+        float distance = glm::length(motion);
+        if (typeId == sphere && (other->typeId == sphere || other->typeId == box) &&
+            distance > static_cast<SphereHitArea *>(this)->GetRadius())
+            return SweepSphere(static_cast<SphereHitArea *>(this), motion, other, record);
+        if (other->typeId == sphere && (typeId == sphere || typeId == box) &&
+            distance > static_cast<SphereHitArea *>(other)->GetRadius()) {
+            bool collided = SweepSphere(static_cast<SphereHitArea *>(other), -motion, this, record);
+            record.displacement = -record.displacement;  // seen from this one
+            return collided;
+        }
+    }
+
+    CollidesFunc collisionFunc = collisionTable[typeId][other->typeId];
+    if (collisionFunc == nullptr)
         return false;
-    return (collisionFunc->second)(this, other, event, otherEvent);
+    return collisionFunc(this, other, record);
 }
 
-void HitArea::RegisterCollisionFunc(std::type_index type1, std::type_index type2, 
-                                    CollidesFunc func)
+CollisionEvent *ContactRecord::CreateEvent(GameObject *other, bool reversed, FrameArena &arena) const
 {
-    collisionFuncs[{type1, type2}] = func;
+    CollisionEvent *event = createEvent == nullptr ? CollisionEvent::Create(*this, other, reversed, arena)
+                                                   : createEvent(*this, other, reversed, arena);
+    event->timeOfImpact = timeOfImpact;
+    return event;
 }
 
 HitArea *BoxShape::CreateHitArea(GameObject *support)
@@ -28,10 +199,8 @@ HitArea *BoxShape::CreateHitArea(GameObject *support)
 const BoxHitArea::init BoxHitArea::initializer;
 BoxHitArea::init::init()
 {
-    RegisterCollisionFunc(typeid(BoxHitArea), typeid(BoxHitArea), 
-                          (CollidesFunc)(&CollidesBoxBox));
-    RegisterCollisionFunc(typeid(BoxHitArea), typeid(SphereHitArea),
-                          (CollidesFunc)(&CollidesBoxSphere));
+    RegisterCollisionFunc<BoxHitArea, BoxHitArea, &CollidesBoxBox>();
+    RegisterCollisionFunc<BoxHitArea, SphereHitArea, &CollidesBoxSphere>();
 }
 
 bool BoxHitArea::Contains(glm::vec3 point)
@@ -41,50 +210,44 @@ bool BoxHitArea::Contains(glm::vec3 point)
            point.z >= -shape.depth  / 2 && point.z <= shape.depth  / 2;
 }
 
-bool engine::CollidesBoxBox(BoxHitArea *box1, BoxHitArea *box2, 
-                            CollisionEventPtr &event, CollisionEventPtr &otherEvent)
+AABB BoxHitArea::GetBounds()
+{
+    glm::vec3 center = support->GetPosition();
+    glm::vec3 halfSize = GetHalfSize();
+    return AABB(center - halfSize, center + halfSize);
+}
+
+glm::vec3 BoxHitArea::GetHalfSize()
+{
+    return glm::abs(glm::vec3(shape.width, shape.height, shape.depth) * support->GetPseudoScale()) / 2.0f;
+}
+
+bool BoxHitArea::Cast(glm::vec3 origin, float radius, glm::vec3 direction, float maxDistance,
+                      RaycastHit &hit)
+{
+    return CastBox(support->GetPosition(), GetHalfSize(), origin, radius, direction, maxDistance, hit);
+}
+
+bool BoxHitArea::Overlaps(glm::vec3 center, float radius)
+{
+    ContactRecord record;
+    return BoxSphere(support->GetPosition(), GetHalfSize(), center, radius, record);
+}
+
+bool engine::CollidesBoxBox(BoxHitArea *box1, BoxHitArea *box2, ContactRecord &record)
 {
     glm::vec3 center = box1->support->GetPosition();
     glm::vec3 otherCenter = box2->support->GetPosition();
-    float thisW = box1->shape.width * box1->support->GetPseudoScale().x;
-    float thisH = box1->shape.height * box1->support->GetPseudoScale().y;
-    float thisD = box1->shape.depth * box1->support->GetPseudoScale().z;
-    float otherW = box2->support->GetPseudoScale().x * box2->shape.width;
-    float otherH = box2->support->GetPseudoScale().y * box2->shape.height;
-    float otherD = box2->support->GetPseudoScale().z * box2->shape.depth;
-
-    event = std::make_unique<CollisionEvent>(box2->support);
-    otherEvent = std::make_unique<CollisionEvent>(box1->support);
-    return center.x - thisW / 2 <= otherCenter.x + otherW / 2 &&
-           center.x + thisW / 2 >= otherCenter.x - otherW / 2 && 
-           center.y - thisH / 2 <= otherCenter.y + otherH / 2 &&
-           center.y + thisH / 2 >= otherCenter.y - otherH / 2 &&
-           center.z - thisD / 2 <= otherCenter.z + otherD / 2 &&
-           center.z + thisD / 2 >= otherCenter.z - otherD / 2;
-}
-
-bool engine::CollidesBoxSphere(BoxHitArea *box, SphereHitArea *sphere, 
-                               CollisionEventPtr &event, CollisionEventPtr &otherEvent)
-{
-    glm::vec3 boxCenter = box->support->GetPosition();
-    glm::vec3 sphereCenter = sphere->support->GetPosition();
-    float radius = glm::abs(sphere->support->GetPseudoScale().x) * sphere->shape.radius;
-    float thisW = box->shape.width * box->support->GetPseudoScale().x;
-    float thisH = box->shape.height * box->support->GetPseudoScale().y;
-    float thisD = box->shape.depth * box->support->GetPseudoScale().z;
-
-    glm::vec3 closestPoint = glm::vec3(
-        glm::clamp(sphereCenter.x, boxCenter.x - thisW / 2, boxCenter.x + thisW / 2),
-        glm::clamp(sphereCenter.y, boxCenter.y - thisH / 2, boxCenter.y + thisH / 2),
-        glm::clamp(sphereCenter.z, boxCenter.z - thisD / 2, boxCenter.z + thisD / 2));
-    
-    glm::vec3 displacement = sphereCenter - closestPoint;
-    float distance = glm::length(displacement);
-    event = std::make_unique<SphereBoxCollisionEvent>(sphere->support, closestPoint, 
-                                                      displacement, distance);
-    otherEvent = std::make_unique<SphereBoxCollisionEvent>(box->support, closestPoint, 
-                                                           -displacement, distance);
-    return distance <= radius;
+
+    record.createEvent = nullptr;
+    glm::vec3 separation = glm::abs(center - otherCenter) - (box1->GetHalfSize() + box2->GetHalfSize());
+    return separation.x <= 0 && separation.y <= 0 && separation.z <= 0;
+}
+
+bool engine::CollidesBoxSphere(BoxHitArea *box, SphereHitArea *sphere, ContactRecord &record)
+{
+    return BoxSphere(box->support->GetPosition(), box->GetHalfSize(),
+                     sphere->support->GetPosition(), sphere->GetRadius(), record);
 }
 
 HitArea *SphereShape::CreateHitArea(GameObject *support)
@@ -95,10 +258,8 @@ HitArea *SphereShape::CreateHitArea(GameObject *support)
 const SphereHitArea::init SphereHitArea::initializer;
 SphereHitArea::init::init()
 {
-    RegisterCollisionFunc(typeid(SphereHitArea), typeid(SphereHitArea), 
-                          (CollidesFunc)(&CollidesSphereSphere));
-    RegisterCollisionFunc(typeid(SphereHitArea), typeid(BoxHitArea), 
-                          (CollidesFunc)(&CollidesSphereBox));
+    RegisterCollisionFunc<SphereHitArea, SphereHitArea, &CollidesSphereSphere>();
+    RegisterCollisionFunc<SphereHitArea, BoxHitArea, &CollidesSphereBox>();
 }
 
 bool SphereHitArea::Contains(glm::vec3 point)
@@ -106,28 +267,334 @@ bool SphereHitArea::Contains(glm::vec3 point)
     return glm::distance(point, glm::vec3(0)) <= shape.radius;
 }
 
-bool engine::CollidesSphereSphere(SphereHitArea *sphere1, SphereHitArea *sphere2,
-                                  CollisionEventPtr &event, CollisionEventPtr &otherEvent)
+AABB SphereHitArea::GetBounds()
+{
+    glm::vec3 center = support->GetPosition();
+    float radius = GetRadius();
+    return AABB(center - glm::vec3(radius), center + glm::vec3(radius));
+}
+
+float SphereHitArea::GetRadius()
+{
+    return glm::abs(support->GetPseudoScale().x) * shape.radius;
+}
+
+bool SphereHitArea::Cast(glm::vec3 origin, float radius, glm::vec3 direction, float maxDistance,
+                         RaycastHit &hit)
+{
+    return CastSphere(support->GetPosition(), GetRadius(), origin, radius, direction, maxDistance, hit);
+}
+
+bool SphereHitArea::Overlaps(const AABB &box)
+{
+    ContactRecord record;
+    return BoxSphere(box.Center(), box.Extents(), support->GetPosition(), GetRadius(), record);
+}
+
+bool SphereHitArea::Overlaps(glm::vec3 center, float radius)
+{
+    return glm::distance(center, support->GetPosition()) <= GetRadius() + radius;
+}
+
+bool engine::CollidesSphereSphere(SphereHitArea *sphere1, SphereHitArea *sphere2, ContactRecord &record)
+{
+    return SphereSphere(sphere1->support->GetPosition(), sphere1->GetRadius(),
+                        sphere2->support->GetPosition(), sphere2->GetRadius(), record);
+}
+
+bool engine::CollidesSphereBox(SphereHitArea *sphere, BoxHitArea *box, ContactRecord &record)
+{
+    // seen from the sphere
+    bool collided = CollidesBoxSphere(box, sphere, record);
+    record.displacement = -record.displacement;
+    return collided;
+}
+
+HitArea *MeshShape::CreateHitArea(GameObject *support)
+{
+    return new MeshHitArea(support, *this);
+}
+
+bool MeshHitArea::Contains(glm::vec3 point)
+{
+    return shape.bvh != nullptr && shape.bvh->Contains(point);
+}
+
+AABB MeshHitArea::GetBounds()
+{
+    if (shape.bvh == nullptr)
+        return AABB();
+    return shape.bvh->GetBounds().Transformed(support->ObjectToWorldMatrix());
+}
+
+bool MeshHitArea::Cast(glm::vec3 origin, float radius, glm::vec3 direction, float maxDistance,
+                       RaycastHit &hit)
+{
+    if (radius > 0)
+        return HitArea::Cast(origin, radius, direction, maxDistance, hit);
+    if (shape.bvh == nullptr)
+        return false;
+
+    // not the support's cached inverse, which is filled lazily: casts may run on
+    // several threads at once (see ControlledScene3D::CastBatch)
+    glm::mat4 worldToObject = glm::inverse(support->ObjectToWorldMatrix());
+    glm::vec3 localOrigin = worldToObject * glm::vec4(origin, 1);
+    // not normalized: a local distance along it is the same world distance
+    glm::vec3 localDirection = glm::mat3(worldToObject) * direction;
+
+    TriangleHit triangleHit;
+    if (!shape.bvh->Raycast(localOrigin, localDirection, maxDistance, triangleHit))
+        return false;
+    hit.distance = triangleHit.distance;
+    hit.point = origin + direction * triangleHit.distance;
+    hit.normal = glm::normalize(glm::transpose(glm::mat3(worldToObject)) * triangleHit.normal);
+    return true;
+}
+
+HitArea *HeightfieldShape::CreateHitArea(GameObject *support)
+{
+    return new HeightfieldHitArea(support, *this);
+}
+
+const HeightfieldHitArea::init HeightfieldHitArea::initializer;
+HeightfieldHitArea::init::init()
+{
+    RegisterCollisionFunc<HeightfieldHitArea, SphereHitArea, &CollidesHeightfieldSphere>();
+    RegisterCollisionFunc<SphereHitArea, HeightfieldHitArea, &CollidesSphereHeightfield>();
+    RegisterCollisionFunc<HeightfieldHitArea, BoxHitArea, &CollidesHeightfieldBox>();
+    RegisterCollisionFunc<BoxHitArea, HeightfieldHitArea, &CollidesBoxHeightfield>();
+}
+
+bool HeightfieldHitArea::Contains(glm::vec3 point)
+{
+    if (shape.field == nullptr)
+        return false;
+    glm::vec3 spacing = glm::vec3(shape.width / (shape.field->GetColumns() - 1), shape.height,
+                                  shape.depth / (shape.field->GetRows() - 1));
+    float height;
+    return shape.field->IsUnder(point + glm::vec3(shape.width, 0, shape.depth) / 2.0f, spacing, height);
+}
+
+AABB HeightfieldHitArea::GetBounds()
+{
+    if (shape.field == nullptr)
+        return AABB();
+    glm::vec3 corner = GetCorner();
+    glm::vec3 spacing = GetSpacing();
+    const Heightfield *field = shape.field;
+    return AABB(corner + glm::vec3(0, field->GetMinHeight() * spacing.y, 0),
+                corner + glm::vec3(field->GetColumns() - 1, field->GetMaxHeight(), field->GetRows() - 1) * spacing);
+}
+
+glm::vec3 HeightfieldHitArea::GetCorner()
+{
+    glm::vec3 scale = glm::abs(support->GetPseudoScale());
+    return support->GetPosition() - glm::vec3(shape.width * scale.x, 0, shape.depth * scale.z) / 2.0f;
+}
+
+glm::vec3 HeightfieldHitArea::GetSpacing()
+{
+    glm::vec3 scale = glm::abs(support->GetPseudoScale());
+    return glm::vec3(shape.width / (shape.field->GetColumns() - 1), shape.height,
+                     shape.depth / (shape.field->GetRows() - 1)) * scale;
+}
+
+bool HeightfieldHitArea::ClosestPoint(glm::vec3 center, float radius, glm::vec3 &closestPoint, float &distance)
+{
+    if (shape.field == nullptr)
+        return false;
+    glm::vec3 corner = GetCorner();
+    glm::vec3 spacing = GetSpacing();
+    glm::vec3 local = center - corner;
+
+    // under the surface, the point right above is out of it, so the closest one is no further
+    float height;
+    bool under = shape.field->IsUnder(local, spacing, height);
+    float search = under ? glm::max(radius, height - local.y) : radius;
+    if (!shape.field->ClosestPoint(local, search, spacing, closestPoint)) {
+        if (!under)
+            return false;
+        closestPoint = glm::vec3(local.x, height, local.z);
+    }
+    closestPoint += corner;
+    distance = glm::distance(center, closestPoint);
+    if (under)
+        distance = -distance;
+    return true;
+}
+
+bool HeightfieldHitArea::Cast(glm::vec3 origin, float radius, glm::vec3 direction, float maxDistance,
+                              RaycastHit &hit)
+{
+    if (shape.field == nullptr)
+        return false;
+    glm::vec3 corner = GetCorner();
+    glm::vec3 spacing = GetSpacing();
+
+    if (radius <= 0) {
+        HeightfieldHit fieldHit;
+        if (!shape.field->Raycast(origin - corner, direction, maxDistance, spacing, fieldHit))
+            return false;
+        hit.distance = fieldHit.distance;
+        hit.point = origin + direction * fieldHit.distance;
+        hit.normal = fieldHit.normal;
+        return true;
+    }
+
+    // conservative advancement, as for boxes; the surface is only searched up to reach
+    // from the sphere, so a step covers at least a cell or the radius, whichever is larger
+    AABB bounds = GetBounds();
+    bounds = AABB(bounds.min - radius, bounds.max + radius);
+    float t = AABBTree::RayBoxDistance(origin, 1.0f / direction, maxDistance, bounds);
+    if (t < 0)
+        return false;
+    float reach = radius + glm::max(radius, glm::min(spacing.x, spacing.z));
+    for (int i = 0; i < HEIGHTFIELD_MAX_CAST_STEPS; ++i) {
+        glm::vec3 center = origin + t * direction;
+        glm::vec3 closestPoint;
+        float distance;
+        float gap = reach - radius;
+        if (ClosestPoint(center, reach, closestPoint, distance)) {
+            gap = distance - radius;
+            if (gap <= radius * SWEEP_TOLERANCE) {
+                hit.distance = t;
+                hit.point = closestPoint;
+                hit.normal = distance > 0 ? (center - closestPoint) / distance : -direction;
+                return true;
+            }
+        }
+        t += gap;
+        if (t > maxDistance)
+            return false;
+    }
+    return false;
+}
+
+bool HeightfieldHitArea::Overlaps(const AABB &box)
+{
+    if (shape.field == nullptr)
+        return false;
+    glm::vec3 corner = GetCorner();
+    glm::vec3 spacing = GetSpacing();
+    float height;
+    return box.max.y - corner.y >= shape.field->GetMinHeight() * spacing.y &&
+           shape.field->GetMaxHeight(glm::vec2(box.min.x - corner.x, box.min.z - corner.z),
+                                     glm::vec2(box.max.x - corner.x, box.max.z - corner.z),
+                                     spacing, height) &&
+           box.min.y - corner.y <= height;
+}
+
+bool HeightfieldHitArea::Overlaps(glm::vec3 center, float radius)
 {
-    glm::vec3 center = sphere1->support->GetPosition();
-    glm::vec3 otherCenter = sphere2->support->GetPosition();
-    float radius = glm::abs(sphere1->support->GetPseudoScale().x) * sphere1->shape.radius;
-    float otherRadius = glm::abs(sphere2->support->GetPseudoScale().x) * sphere2->shape.radius;
+    glm::vec3 closestPoint;
+    float distance;
+    return ClosestPoint(center, radius, closestPoint, distance);
+}
 
-    glm::vec3 displacement = otherCenter - center;
-    float distance = glm::length(displacement);
-    float sumRadius = radius + otherRadius;
-    event = std::make_unique<SphereSphereCollisionEvent>(sphere2->support, displacement, 
-                                                        distance, sumRadius);
-    otherEvent = std::make_unique<SphereSphereCollisionEvent>(sphere1->support, -displacement, 
-                                                              distance, sumRadius);
-    return distance <= sumRadius;
+bool engine::CollidesHeightfieldSphere(HeightfieldHitArea *heightfield, SphereHitArea *sphere, ContactRecord &record)
+{
+    glm::vec3 center = sphere->support->GetPosition();
+    glm::vec3 closestPoint;
+    float distance;
+    if (!heightfield->ClosestPoint(center, sphere->GetRadius(), closestPoint, distance))
+        return false;
+    // out of the surface, towards the sphere
+    record.createEvent = &SphereBoxCollisionEvent::Create;
+    record.point = closestPoint;
+    record.displacement = distance < 0 ? closestPoint - center : center - closestPoint;
+    record.distance = distance;
+    return true;
+}
+
+bool engine::CollidesSphereHeightfield(SphereHitArea *sphere, HeightfieldHitArea *heightfield, ContactRecord &record)
+{
+    // seen from the sphere
+    bool collided = CollidesHeightfieldSphere(heightfield, sphere, record);
+    record.displacement = -record.displacement;
+    return collided;
+}
+
+bool engine::CollidesHeightfieldBox(HeightfieldHitArea *heightfield, BoxHitArea *box, ContactRecord &record)
+{
+    record.createEvent = nullptr;
+    return heightfield->Overlaps(box->GetBounds());
+}
+
+bool engine::CollidesBoxHeightfield(BoxHitArea *box, HeightfieldHitArea *heightfield, ContactRecord &record)
+{
+    return CollidesHeightfieldBox(heightfield, box, record);
+}
+
+bool engine::SweepSphere(SphereHitArea *sphere, glm::vec3 motion, HitArea *other, ContactRecord &record)
+{
+    float radius = sphere->GetRadius();
+    glm::vec3 end = sphere->support->GetPosition();
+    glm::vec3 start = end - motion;
+    glm::vec3 otherCenter = other->support->GetPosition();
+
+    if (other->GetTypeId() == HitArea::TypeId<SphereHitArea>()) {
+        // first root of |start + t * motion - otherCenter| = sumRadius
+        float otherRadius = static_cast<SphereHitArea *>(other)->GetRadius();
+        float sumRadius = radius + otherRadius;
+        glm::vec3 offset = start - otherCenter;
+        float a = glm::dot(motion, motion);
+        float b = glm::dot(offset, motion);
+        float c = glm::dot(offset, offset) - sumRadius * sumRadius;
+        float discriminant = b * b - a * c;
+        float t = 0;
+        if (c > 0) {
+            // apart at the start: they must be getting closer, and meet within the step
+            if (b >= 0 || discriminant < 0)
+                return SphereSphere(end, radius, otherCenter, otherRadius, record);
+            t = (-b - glm::sqrt(discriminant)) / a;
+            if (t > 1)
+                return SphereSphere(end, radius, otherCenter, otherRadius, record);
+        }
+        SphereSphere(start + t * motion, radius, otherCenter, otherRadius, record);
+        record.timeOfImpact = t;
+        return true;  // even if rounding puts the distance a hair above sumRadius
+    }
+
+    // box: advance the sphere by its distance to the box, which it can't cover without
+    // touching it; converges quickly unless the sphere only grazes the box
+    glm::vec3 halfSize = static_cast<BoxHitArea *>(other)->GetHalfSize();
+    float length = glm::length(motion);
+    float t = 0;
+    for (int i = 0; i < SWEEP_MAX_ITERATIONS; ++i) {
+        bool touching = BoxSphere(otherCenter, halfSize, start + t * motion, radius, record);
+        float gap = record.distance - radius;
+        if (touching || gap <= radius * SWEEP_TOLERANCE) {
+            record.displacement = -record.displacement;  // seen from the sphere
+            record.timeOfImpact = t;
+            return true;
+        }
+        t += gap / length;
+        if (t > 1)
+            break;
+    }
+    bool collided = BoxSphere(otherCenter, halfSize, end, radius, record);
+    record.displacement = -record.displacement;
+    return collided;
+}
+
+CollisionEvent *CollisionEvent::Create(const ContactRecord & /*record*/, GameObject *other,
+                                       bool /*reversed*/, FrameArena &arena)
+{
+    return arena.New<CollisionEvent>(other);
+}
+
+CollisionEvent *SphereBoxCollisionEvent::Create(const ContactRecord &record, GameObject *other,
+                                                bool reversed, FrameArena &arena)
+{
+    glm::vec3 displacement = reversed ? -record.displacement : record.displacement;
+    return arena.New<SphereBoxCollisionEvent>(other, record.point, displacement, record.distance);
 }
 
-bool engine::CollidesSphereBox(SphereHitArea *sphere, BoxHitArea *box, 
-                               CollisionEventPtr &event, CollisionEventPtr &otherEvent)
+CollisionEvent *SphereSphereCollisionEvent::Create(const ContactRecord &record, GameObject *other,
+                                                   bool reversed, FrameArena &arena)
 {
-    return CollidesBoxSphere(box, sphere, otherEvent, event);
+    glm::vec3 displacement = reversed ? -record.displacement : record.displacement;
+    return arena.New<SphereSphereCollisionEvent>(other, displacement, record.distance, record.sumRadius);
 }
 
 void CollisionEvent::Dispatch(GameObject *target)
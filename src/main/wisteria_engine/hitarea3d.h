@@ -1,28 +1,66 @@
 #pragma once
 #include <memory>
-#include <unordered_map>
-#include <typeindex>
 #include "utils/glm_utils.h"
+#include "bounds.h"
+#include "pool.h"
+#include "framearena.h"
+#include "trianglebvh.h"
+#include "heightfield.h"
+
+// shape types a program can have, built-in ones included
+#define HITAREA_MAX_TYPES 16
 
 namespace engine
 {
     struct HitArea;
     struct BoxHitArea;
     struct SphereHitArea;
+    struct HeightfieldHitArea;
     class CollisionEvent;
     class SphereBoxCollisionEvent;
     class GameObject;
 
     typedef std::unique_ptr<CollisionEvent> CollisionEventPtr;
 
+    // The result of a narrowphase test, as plain data, from the point of view of the
+    // first hit area; the second one sees the displacement reversed. Events are only
+    // built from it for actual hits, by createEvent, which is set by the collision
+    // function that knows the event type (nullptr for a plain CollisionEvent).
+    struct ContactRecord {
+        typedef CollisionEvent *(*CreateEventFunc)(const ContactRecord &record, GameObject *other,
+                                                   bool reversed, FrameArena &arena);
+        CreateEventFunc createEvent = nullptr;
+        glm::vec3 point = glm::vec3(0);
+        glm::vec3 displacement = glm::vec3(0);
+        float distance = 0;
+        float sumRadius = 0;
+        // fraction of the step at which the hit areas touched; 1 for discrete tests
+        float timeOfImpact = 1;
+
+        // the event received by the first hit area's object if reversed is false, by
+        // the second one's otherwise; other is the object on the other side
+        CollisionEvent *CreateEvent(GameObject *other, bool reversed, FrameArena &arena) const;
+    };
+
+    // a hit of a scene query, see ControlledScene3D::Raycast
+    struct RaycastHit {
+        GameObject *gameObject = nullptr;  // owning the hit area
+        float distance = 0;  // along the direction of the query
+        glm::vec3 point = glm::vec3(0);  // on the surface of the hit area
+        glm::vec3 normal = glm::vec3(0);  // of the surface, facing the query
+    };
+
     // a shape can be anything, but it must be able to create a hitarea
     struct Shape {
         virtual ~Shape() = default;
         virtual HitArea *CreateHitArea(GameObject *support) = 0;
     };
 
-    // the following uses double dispatch with a double dispatch table and no C++ RTTI
-    // (typeid(expression) and dynamic_cast<type>(expression)). It uses typeid(type);
+    // the following uses double dispatch with a double dispatch table and no C++ RTTI.
+    // Every hit area type gets a small dense id the first time TypeId<T>() is called,
+    // and the collision functions live in a flat table indexed by the two ids, so a
+    // dispatch is one indexed load. The table is plain data, zero-initialized before
+    // any static initializer runs, so registering from them is safe in any order.
     // The visitor pattern was not suitable here because I don't want the hierarchy to
     // be closed, that is, the base class has to know about all the derived classes,
     // which is not extensible. 
@@ -31,32 +69,72 @@ namespace engine
     // note that the hitarea does not contain the shape, as it carries no information
     // instead, concrete hitareas contain concrete shapes
     struct HitArea {
-        HitArea(GameObject *support) : support(support) {}
+        HitArea(GameObject *support, int typeId) : support(support), typeId(typeId) {}
         virtual ~HitArea() = default;
 
+        static void *operator new(size_t size) { return Pools::Allocate(size); }
+        static void operator delete(void *block, size_t size) { Pools::Free(block, size); }
+
         GameObject *support;
+        // Swept collisions, for hit areas moving more than their size in one step, which
+        // would otherwise tunnel through thin ones. A sphere is swept along its motion
+        // relative to the other hit area, over the whole step, against a sphere or a box
+        // at its final position; the first hit of the step is reported, at its time of
+        // impact. Set it on the fast hit area (either side of a pair is enough).
+        bool continuous = false;
 
         virtual bool Contains(glm::vec3 point) = 0;
-        bool Collides(HitArea *other, CollisionEventPtr &event, CollisionEventPtr &otherEvent);
+        // world space bounds, following the transform of the support gameobject
+        virtual AABB GetBounds() = 0;
+        // the bounds covering the whole last step, for continuous hit areas
+        AABB GetSweptBounds();
+        // world space motion of the support during the last simulation step
+        glm::vec3 GetMotion();
+        // fills record only; false if the hit areas don't touch
+        bool Collides(HitArea *other, ContactRecord &record);
+
+        // scene queries in world space; the defaults test the bounds, the built-in hit
+        // areas are exact. Cast moves a sphere (a point if radius is 0) from origin
+        // along the normalized direction, and fills hit if it touches before maxDistance
+        virtual bool Cast(glm::vec3 origin, float radius, glm::vec3 direction, float maxDistance,
+                          RaycastHit &hit);
+        virtual bool Overlaps(const AABB &box);
+        virtual bool Overlaps(glm::vec3 center, float radius);
+
+        int GetTypeId() const { return typeId; }
+        // the id of a hit area type, the same for the whole program
+        template <typename T>
+        static int TypeId()
+        {
+            static const int id = NextTypeId();
+            return id;
+        }
 
     protected:
-        typedef bool (*CollidesFunc)(HitArea *, HitArea *, CollisionEventPtr &, CollisionEventPtr &);
-        virtual std::type_index GetType() = 0;
-        typedef std::pair<std::type_index, std::type_index> type_pair;
-        struct pair_hash {
-            std::size_t operator() (const type_pair &pair) const {
-                return pair.first.hash_code() ^ pair.second.hash_code();
-            }
-        };
-        static std::unordered_map<type_pair, CollidesFunc, pair_hash> collisionFuncs;
+        typedef bool (*CollidesFunc)(HitArea *, HitArea *, ContactRecord &);
         // this is called by the derived classes to register their collision functions;
         // when extending the engine with new hitareas, this function must be called
-        // for each new pair of hitareas that can collide. The func parameter must be
-        // cast to CollidesFunc, even though this cast is unsafe in general. The user
-        // must ensure that the passed function takes two HitArea pointers of the types
-        // specified by the type_index parameters.
-        static void RegisterCollisionFunc(std::type_index type1, std::type_index type2, 
-                                          CollidesFunc func);
+        // for each new pair of hitareas that can collide, e.g.
+        //   RegisterCollisionFunc<BoxHitArea, MyHitArea, &CollidesBoxMine>();
+        // The derived classes pass TypeId<T>() of their own type to the constructor.
+        template <typename T1, typename T2, bool (*func)(T1 *, T2 *, ContactRecord &)>
+        static void RegisterCollisionFunc()
+        {
+            collisionTable[TypeId<T1>()][TypeId<T2>()] = &Collides<T1, T2, func>;
+        }
+
+    private:
+        const int typeId;
+
+        static int NextTypeId();
+        // casts back to the registered types, known at compile time
+        template <typename T1, typename T2, bool (*func)(T1 *, T2 *, ContactRecord &)>
+        static bool Collides(HitArea *first, HitArea *second, ContactRecord &record)
+        {
+            return func(static_cast<T1 *>(first), static_cast<T2 *>(second), record);
+        }
+
+        static CollidesFunc collisionTable[HITAREA_MAX_TYPES][HITAREA_MAX_TYPES];
     };
 
     struct BoxShape : public Shape {
@@ -71,20 +149,24 @@ namespace engine
     struct BoxHitArea : public HitArea
     {
         BoxHitArea(GameObject *support, BoxShape shape) 
-            : HitArea(support), shape(shape) {}
+            : HitArea(support, TypeId<BoxHitArea>()), shape(shape) {}
         BoxShape shape;
         bool Contains(glm::vec3 point) override;
-
-    protected:
-        std::type_index GetType() override { return typeid(BoxHitArea); }
+        AABB GetBounds() override;
+        // world space, scaled by the support (mirroring doesn't count)
+        glm::vec3 GetHalfSize();
+        bool Cast(glm::vec3 origin, float radius, glm::vec3 direction, float maxDistance,
+                  RaycastHit &hit) override;
+        bool Overlaps(glm::vec3 center, float radius) override;
+        using HitArea::Overlaps;
 
     private:
         static const struct init { init(); } initializer;
     };
 
-    bool CollidesBoxBox(BoxHitArea *, BoxHitArea *, CollisionEventPtr &, CollisionEventPtr &);
-    bool CollidesBoxSphere(BoxHitArea *, SphereHitArea *, CollisionEventPtr &, CollisionEventPtr &);
-    bool CollidesSphereBox(SphereHitArea *, BoxHitArea *, CollisionEventPtr &, CollisionEventPtr &);
+    bool CollidesBoxBox(BoxHitArea *, BoxHitArea *, ContactRecord &);
+    bool CollidesBoxSphere(BoxHitArea *, SphereHitArea *, ContactRecord &);
+    bool CollidesSphereBox(SphereHitArea *, BoxHitArea *, ContactRecord &);
 
     struct SphereShape : public Shape {
         SphereShape() = default;
@@ -96,26 +178,106 @@ namespace engine
     struct SphereHitArea : public HitArea
     {
         SphereHitArea(GameObject *support, SphereShape shape) 
-            : HitArea(support), shape(shape) {}
+            : HitArea(support, TypeId<SphereHitArea>()), shape(shape) {}
         SphereShape shape;
         bool Contains(glm::vec3 point) override;
+        AABB GetBounds() override;
+        // world space, scaled by the x pseudo scale of the support
+        float GetRadius();
+        bool Cast(glm::vec3 origin, float radius, glm::vec3 direction, float maxDistance,
+                  RaycastHit &hit) override;
+        bool Overlaps(const AABB &box) override;
+        bool Overlaps(glm::vec3 center, float radius) override;
 
-    protected:
-        std::type_index GetType() override { return typeid(SphereHitArea); }
+    private:
+        static const struct init { init(); } initializer;
+    };
+
+    bool CollidesSphereSphere(SphereHitArea *, SphereHitArea *, ContactRecord &);
+
+    struct MeshShape : public Shape {
+        MeshShape() = default;
+        MeshShape(const TriangleBVH *bvh) : bvh(bvh) {};
+        HitArea *CreateHitArea(GameObject *support) override;
+        const TriangleBVH *bvh = nullptr;  // shared by the users of a mesh, see Assets::GetMeshBVH
+    };
+
+    // The actual triangles of a mesh, for picking and projectile hits: rays and points
+    // are brought into the local space of the support, so unlike the other hit areas
+    // it can be rotated and scaled freely. Sphere casts and overlaps only use its bounds,
+    // and no collision function is registered for it, so it doesn't collide.
+    struct MeshHitArea : public HitArea
+    {
+        MeshHitArea(GameObject *support, MeshShape shape)
+            : HitArea(support, TypeId<MeshHitArea>()), shape(shape) {}
+        MeshShape shape;
+        bool Contains(glm::vec3 point) override;
+        AABB GetBounds() override;
+        bool Cast(glm::vec3 origin, float radius, glm::vec3 direction, float maxDistance,
+                  RaycastHit &hit) override;
+    };
+
+    struct HeightfieldShape : public Shape {
+        HeightfieldShape() = default;
+        HeightfieldShape(const Heightfield *field, float width, float height, float depth)
+            : field(field), width(width), height(height), depth(depth) {};
+        HitArea *CreateHitArea(GameObject *support) override;
+        const Heightfield *field = nullptr;  // shared by the users of a heightmap, see Assets::GetHeightfield
+        // the grid spans width x depth, centered on the support, and the samples are
+        // multiplied by height, going up from the support
+        float width, height, depth;
+    };
+
+    // Terrain: a heightfield, solid from its lowest sample up to its surface. Like boxes, it
+    // follows the position and the pseudo scale of the support, but not its rotation.
+    // Spheres and boxes collide with it, sphere events carry the closest point of the
+    // surface; a sphere whose center is in the solid gets the displacement out
+    // of it instead, with a negative distance.
+    struct HeightfieldHitArea : public HitArea
+    {
+        HeightfieldHitArea(GameObject *support, HeightfieldShape shape)
+            : HitArea(support, TypeId<HeightfieldHitArea>()), shape(shape) {}
+        HeightfieldShape shape;
+        bool Contains(glm::vec3 point) override;
+        AABB GetBounds() override;
+        bool Cast(glm::vec3 origin, float radius, glm::vec3 direction, float maxDistance,
+                  RaycastHit &hit) override;
+        bool Overlaps(const AABB &box) override;
+        bool Overlaps(glm::vec3 center, float radius) override;
+
+        // world space position of sample (0, 0) at height 0
+        glm::vec3 GetCorner();
+        // world space distance between samples, and height of a sample of 1
+        glm::vec3 GetSpacing();
+        // the closest point of the surface to center, if it is within radius or if
+        // center is in the solid; distance is negative in the second case
+        bool ClosestPoint(glm::vec3 center, float radius, glm::vec3 &closestPoint, float &distance);
 
     private:
         static const struct init { init(); } initializer;
     };
 
-    bool CollidesSphereSphere(SphereHitArea *, SphereHitArea *, CollisionEventPtr &, CollisionEventPtr &);
+    bool CollidesHeightfieldSphere(HeightfieldHitArea *, SphereHitArea *, ContactRecord &);
+    bool CollidesSphereHeightfield(SphereHitArea *, HeightfieldHitArea *, ContactRecord &);
+    bool CollidesHeightfieldBox(HeightfieldHitArea *, BoxHitArea *, ContactRecord &);
+    bool CollidesBoxHeightfield(BoxHitArea *, HeightfieldHitArea *, ContactRecord &);
+
+    // a sphere moving by motion during the step, ending at its current position, against
+    // a sphere or a box at its current one; the record is seen from the sphere
+    bool SweepSphere(SphereHitArea *sphere, glm::vec3 motion, HitArea *other, ContactRecord &record);
 
     class CollisionEvent
     {
         friend class ControlledScene3D;  // only the scene can dispatch collision events
     public:
         CollisionEvent(GameObject *gameObject): gameObject(gameObject) {}
+        // events are built in the scene's frame arena, see ContactRecord
+        static CollisionEvent *Create(const ContactRecord &record, GameObject *other,
+                                      bool reversed, FrameArena &arena);
         virtual ~CollisionEvent() = default;
         GameObject *gameObject;
+        // fraction of the step at which the hit areas touched, see HitArea::continuous
+        float timeOfImpact = 1;
     private:
         virtual void Dispatch(GameObject *target);
     };
@@ -127,6 +289,8 @@ namespace engine
                                 glm::vec3 displacement, float distance)
             : CollisionEvent(gameObject), closestPoint(closestPoint), 
               displacement(displacement), distance(distance) {}
+        static CollisionEvent *Create(const ContactRecord &record, GameObject *other,
+                                      bool reversed, FrameArena &arena);
         glm::vec3 closestPoint;
         glm::vec3 displacement;
         float distance;
@@ -142,6 +306,8 @@ namespace engine
                                    float distance, float sumRadius)
             : CollisionEvent(gameObject), displacement(displacement), 
               distance(distance), sumRadius(sumRadius) {}
+        static CollisionEvent *Create(const ContactRecord &record, GameObject *other,
+                                      bool reversed, FrameArena &arena);
         glm::vec3 displacement;
         float distance, sumRadius;
     
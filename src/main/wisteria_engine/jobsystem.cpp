@@ -0,0 +1,261 @@
+#include <thread>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <iostream>
+#include "jobsystem.h"
+
+#define JOB_DEQUE_CAPACITY 4096  // must be a power of 2
+#define JOB_SPIN_COUNT 64  // failed attempts to find a job before a worker goes to sleep
+
+using namespace engine;
+
+namespace
+{
+    // Chase-Lev deque with a fixed capacity. Only the owner pushes and pops (at the
+    // bottom); other threads steal from the top. A full deque refuses new jobs and
+    // the caller runs them inline instead.
+    class WorkDeque
+    {
+    public:
+        bool Push(const Job &job)
+        {
+            int64_t b = bottom.load(std::memory_order_relaxed);
+            int64_t t = top.load(std::memory_order_acquire);
+            if (b - t >= JOB_DEQUE_CAPACITY)
+                return false;
+            jobs[b & (JOB_DEQUE_CAPACITY - 1)] = job;
+            bottom.store(b + 1, std::memory_order_release);  // publishes the job to thieves
+            return true;
+        }
+
+        bool Pop(Job &job)
+        {
+            int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+            bottom.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t t = top.load(std::memory_order_relaxed);
+            if (t > b) {
+                // empty
+                bottom.store(b + 1, std::memory_order_relaxed);
+                return false;
+            }
+
+            job = jobs[b & (JOB_DEQUE_CAPACITY - 1)];
+            if (t == b) {
+                // last job: race the thieves for it
+                bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                                       std::memory_order_relaxed);
+                bottom.store(b + 1, std::memory_order_relaxed);
+                return won;
+            }
+            return true;
+        }
+
+        bool Steal(Job &job)
+        {
+            int64_t t = top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t b = bottom.load(std::memory_order_acquire);
+            if (t >= b)
+                return false;
+
+            // the copy may be torn if the slot got reused meanwhile, but then the CAS fails
+            job = jobs[t & (JOB_DEQUE_CAPACITY - 1)];
+            return top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                               std::memory_order_relaxed);
+        }
+
+    private:
+        alignas(64) std::atomic<int64_t> top { 0 };
+        alignas(64) std::atomic<int64_t> bottom { 0 };
+        Job jobs[JOB_DEQUE_CAPACITY];
+    };
+
+    std::vector<std::unique_ptr<WorkDeque>> deques;
+    std::vector<std::thread> workers;
+
+    // jobs submitted from threads that don't belong to the pool
+    std::mutex globalMutex;
+    std::deque<Job> globalQueue;
+
+    // sleeping workers are woken up when new jobs are pushed
+    std::mutex sleepMutex;
+    std::condition_variable sleepCondition;
+    std::atomic<int> queuedJobs { 0 };
+    std::atomic<int> sleepingWorkers { 0 };
+    std::atomic<bool> quitting { false };
+
+    thread_local int threadIndex = -1;
+}
+
+void JobSystem::Initialize(unsigned int threads)
+{
+    if (!workers.empty()) {
+        std::cerr << "JobSystem is already initialized.\n";
+        return;
+    }
+
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+    if (threads == 0)
+        threads = 1;
+    threadCount = threads;
+
+    quitting = false;
+    deques.clear();
+    for (unsigned int i = 0; i < threads; ++i)
+        deques.push_back(std::make_unique<WorkDeque>());
+
+    threadIndex = 0;
+    for (unsigned int i = 1; i < threads; ++i)
+        workers.emplace_back(WorkerLoop, i);
+}
+
+void JobSystem::Shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        quitting = true;
+    }
+    sleepCondition.notify_all();
+    for (auto &worker : workers)
+        worker.join();
+    workers.clear();
+    deques.clear();
+    threadCount = 1;
+}
+
+unsigned int JobSystem::ThreadIndex()
+{
+    return threadIndex < 0 ? 0 : threadIndex;
+}
+
+void JobSystem::Run(const Job &job, JobCounter *dependency)
+{
+    if (job.counter)
+        job.counter->value.fetch_add(1, std::memory_order_relaxed);
+
+    if (dependency != nullptr) {
+        std::lock_guard<std::mutex> lock(dependency->continuationsMutex);
+        if (!dependency->Done()) {
+            dependency->continuations.push_back(job);
+            return;
+        }
+    }
+    Push(job);
+}
+
+void JobSystem::Push(const Job &job)
+{
+    if (deques.empty()) {
+        // not initialized: everything runs on the calling thread
+        Execute(job);
+        return;
+    }
+
+    if (threadIndex < 0) {
+        std::lock_guard<std::mutex> lock(globalMutex);
+        globalQueue.push_back(job);
+    } else if (!deques[threadIndex]->Push(job)) {
+        Execute(job);
+        return;
+    }
+
+    // seq_cst on both sides, so that either the worker sees the job or we see the worker
+    queuedJobs.fetch_add(1);
+    if (sleepingWorkers.load() > 0) {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        sleepCondition.notify_one();
+    }
+}
+
+void JobSystem::Execute(const Job &job)
+{
+    job.function(job.data, job.begin, job.end);
+
+    JobCounter *counter = job.counter;
+    if (counter == nullptr)
+        return;
+
+    // not the last job of the counter: a plain decrement
+    int value = counter->value.load(std::memory_order_relaxed);
+    while (value > 1) {
+        if (counter->value.compare_exchange_weak(value, value - 1, std::memory_order_acq_rel))
+            return;
+    }
+
+    // Maybe the last one. Once the counter is done, Wait returns and the counter may go
+    // out of scope, so the jobs that depended on it are taken out first, and the last
+    // decrement is made under the lock, which Wait takes before returning. The counter
+    // isn't touched after that
+    std::vector<Job> released;
+    {
+        std::lock_guard<std::mutex> lock(counter->continuationsMutex);
+        released.swap(counter->continuations);
+        if (counter->value.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            released.swap(counter->continuations);  // a job was added meanwhile
+    }
+    for (auto &continuation : released)
+        Push(continuation);
+}
+
+bool JobSystem::RunOne(unsigned int index)
+{
+    Job job;
+    bool found = deques[index]->Pop(job);
+    for (unsigned int i = 1; !found && i < threadCount; ++i)
+        found = deques[(index + i) % threadCount]->Steal(job);
+    if (!found && queuedJobs.load(std::memory_order_acquire) > 0) {
+        std::lock_guard<std::mutex> lock(globalMutex);
+        if (!globalQueue.empty()) {
+            job = globalQueue.front();
+            globalQueue.pop_front();
+            found = true;
+        }
+    }
+    if (!found)
+        return false;
+
+    queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+    Execute(job);
+    return true;
+}
+
+void JobSystem::Wait(JobCounter &counter)
+{
+    if (deques.empty() || threadIndex < 0) {
+        // outside the pool there is nothing to help with
+        while (!counter.Done())
+            std::this_thread::yield();
+    } else {
+        while (!counter.Done()) {
+            if (!RunOne(threadIndex))
+                std::this_thread::yield();
+        }
+    }
+    // the thread that finished the counter may still hold its lock, see Execute
+    std::lock_guard<std::mutex> lock(counter.continuationsMutex);
+}
+
+void JobSystem::WorkerLoop(unsigned int index)
+{
+    threadIndex = index;
+    int idle = 0;
+    while (!quitting.load(std::memory_order_acquire)) {
+        if (RunOne(index)) {
+            idle = 0;
+            continue;
+        }
+        if (++idle < JOB_SPIN_COUNT) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        sleepingWorkers.fetch_add(1);
+        sleepCondition.wait(lock, [] { return quitting.load() || queuedJobs.load() > 0; });
+        sleepingWorkers.fetch_sub(1);
+        idle = 0;
+    }
+}
@@ -0,0 +1,118 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace engine
+{
+    class JobCounter;
+
+    // A job is a plain function pointer over an index range; the data it points to must
+    // outlive the job (the usual pattern is to wait on the job's counter before returning)
+    typedef void (*JobFunction)(void *data, size_t begin, size_t end);
+
+    struct Job {
+        JobFunction function = nullptr;
+        void *data = nullptr;
+        size_t begin = 0;
+        size_t end = 0;
+        JobCounter *counter = nullptr;  // decremented when the job is done
+    };
+
+    // Counts the unfinished jobs of a group. Jobs can be made to depend on a counter:
+    // they are only scheduled once the counter drops to zero, which is enough to
+    // express a job graph. Counters can be reused, or destroyed, once Wait returned.
+    class JobCounter
+    {
+    public:
+        JobCounter() = default;
+        JobCounter(const JobCounter &) = delete;
+        JobCounter &operator=(const JobCounter &) = delete;
+
+        bool Done() const { return value.load(std::memory_order_acquire) == 0; }
+
+    private:
+        friend class JobSystem;
+        std::atomic<int> value { 0 };
+        std::mutex continuationsMutex;
+        std::vector<Job> continuations;  // jobs waiting for this counter
+    };
+
+    // Work-stealing thread pool. Every thread (the workers and the thread that called
+    // Initialize, which is the GL thread) has its own deque: it pushes and pops jobs at
+    // the bottom while idle threads steal from the top. Waiting on a counter never
+    // blocks: the waiting thread runs jobs until the counter is done.
+    class JobSystem
+    {
+    public:
+        // 0 threads means one per hardware thread, including the calling one
+        static void Initialize(unsigned int threadCount = 0);
+        static void Shutdown();
+
+        static void Run(const Job &job, JobCounter *dependency = nullptr);
+        static void Wait(JobCounter &counter);
+
+        // calls body(begin, end) over [0, count) in batches of at least minBatchSize
+        // indices, and returns when all of them are done
+        template <typename Body>
+        static void ParallelFor(size_t count, size_t minBatchSize, Body &&body);
+
+        // the number of threads running jobs, including the GL thread
+        static unsigned int ThreadCount() { return threadCount; }
+        // index of the calling thread in [0, ThreadCount()); 0 is the GL thread. Useful
+        // to give every thread its own buffer without any locking
+        static unsigned int ThreadIndex();
+
+    private:
+        static void WorkerLoop(unsigned int index);
+        static bool RunOne(unsigned int index);
+        static void Execute(const Job &job);
+        static void Push(const Job &job);
+
+        inline static unsigned int threadCount = 1;
+    };
+
+    template <typename Body>
+    void JobSystem::ParallelFor(size_t count, size_t minBatchSize, Body &&body)
+    {
+        if (count == 0)
+            return;
+        if (minBatchSize == 0)
+            minBatchSize = 1;
+
+        // a few batches per thread, so that stealing can even out uneven batches
+        size_t batches = (count + minBatchSize - 1) / minBatchSize;
+        batches = batches < threadCount * 4 ? batches : threadCount * 4;
+        if (batches <= 1 || threadCount == 1) {
+            body((size_t)0, count);
+            return;
+        }
+
+        typedef typename std::remove_reference<Body>::type BodyType;
+        JobCounter counter;
+        Job job;
+        job.function = [](void *data, size_t begin, size_t end) {
+            (*static_cast<BodyType *>(data))(begin, end);
+        };
+        job.data = const_cast<void *>(static_cast<const void *>(&body));
+        job.counter = &counter;
+
+        size_t batchSize = count / batches;
+        size_t remainder = count % batches;
+        size_t begin = 0;
+        // the first batch is kept for the calling thread
+        size_t firstEnd = batchSize + (remainder > 0);
+        begin = firstEnd;
+        for (size_t i = 1; i < batches; ++i) {
+            job.begin = begin;
+            job.end = begin + batchSize + (i < remainder);
+            begin = job.end;
+            Run(job);
+        }
+        body((size_t)0, firstEnd);
+        Wait(counter);
+    }
+}
@@ -0,0 +1,117 @@
+#include "kinematics.h"
+#include "gameobject3d.h"
+#include "jobsystem.h"
+
+using namespace engine;
+
+void KinematicIntegrator::Add(GameObject *gameObject)
+{
+    if (gameObject->integrator != nullptr)
+        return;
+
+    gameObject->integrator = this;
+    gameObject->kinematicSlot = (int)owners.size();
+    owners.push_back(gameObject);
+    velocities.push_back(gameObject->velocity);
+    accelerations.push_back(gameObject->acceleration);
+    angularVelocities.push_back(gameObject->angularVelocity);
+}
+
+void KinematicIntegrator::Remove(GameObject *gameObject)
+{
+    if (gameObject->integrator == this)
+        RemoveSlot(gameObject->kinematicSlot);
+}
+
+void KinematicIntegrator::RemoveSlot(size_t slot)
+{
+    GameObject *gameObject = owners[slot];
+    gameObject->velocity = velocities[slot];
+    gameObject->acceleration = accelerations[slot];
+    gameObject->angularVelocity = angularVelocities[slot];
+    gameObject->integrator = nullptr;
+    gameObject->kinematicSlot = -1;
+
+    // the last slot takes its place
+    size_t last = owners.size() - 1;
+    if (slot != last) {
+        owners[slot] = owners[last];
+        velocities[slot] = velocities[last];
+        accelerations[slot] = accelerations[last];
+        angularVelocities[slot] = angularVelocities[last];
+        owners[slot]->kinematicSlot = (int)slot;
+    }
+    owners.pop_back();
+    velocities.pop_back();
+    accelerations.pop_back();
+    angularVelocities.pop_back();
+}
+
+void KinematicIntegrator::Integrate(float scaledStep, float unscaledStep, bool parallel)
+{
+    // objects whose motion went back to zero since the last step leave first
+    for (size_t slot = 0; slot < owners.size();) {
+        if (velocities[slot] == glm::vec3(0) && accelerations[slot] == glm::vec3(0) &&
+            angularVelocities[slot] == glm::vec3(0))
+            RemoveSlot(slot);
+        else
+            ++slot;
+    }
+
+    size_t count = owners.size();
+    steps.resize(count);
+    rotations.resize(count);
+    moved.resize(count);
+    for (size_t slot = 0; slot < count; ++slot) {
+        GameObject *gameObject = owners[slot];
+        // inactive objects don't tick, so they don't move either
+        if (!gameObject->IsActiveInHierarchy())
+            steps[slot] = 0;
+        else
+            steps[slot] = gameObject->useUnscaledTime ? unscaledStep : scaledStep;
+    }
+
+    if (parallel && count > KINEMATIC_BATCH_SIZE && JobSystem::ThreadCount() > 1) {
+        JobSystem::ParallelFor(count, KINEMATIC_BATCH_SIZE, [this](size_t begin, size_t end) {
+            IntegrateRange(begin, end);
+        });
+    } else {
+        IntegrateRange(0, count);
+    }
+
+    // dirtying walks the hierarchies, which slots may share, so it stays on this thread
+    for (size_t slot = 0; slot < count; ++slot) {
+        if (moved[slot] & 2)
+            owners[slot]->SetLocalRotation(rotations[slot]);
+        else if (moved[slot] & 1)
+            owners[slot]->MarkTransformDirty();
+    }
+}
+
+void KinematicIntegrator::IntegrateRange(size_t begin, size_t end)
+{
+    // straight over the arrays, without branches, so that it vectorizes
+    for (size_t slot = begin; slot < end; ++slot)
+        velocities[slot] += accelerations[slot] * steps[slot];
+
+    // every slot belongs to a different object, so writing the local transforms is safe
+    for (size_t slot = begin; slot < end; ++slot) {
+        GameObject *gameObject = owners[slot];
+        float step = steps[slot];
+        uint8_t flags = 0;
+
+        glm::vec3 displacement = velocities[slot] * step;
+        if (displacement != glm::vec3(0)) {
+            gameObject->LocalPositionRef() += displacement;
+            flags |= 1;
+        }
+        glm::vec3 angularVelocity = angularVelocities[slot];
+        float angularSpeed = glm::length(angularVelocity);
+        if (angularSpeed > 0 && step > 0) {
+            glm::vec3 axis = angularVelocity / angularSpeed;
+            rotations[slot] = glm::rotate(gameObject->LocalRotationRef(), angularSpeed * step, axis);
+            flags |= 2;
+        }
+        moved[slot] = flags;
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include "utils/glm_utils.h"
+
+#define KINEMATIC_BATCH_SIZE 256  // smaller integrations aren't worth splitting
+
+namespace engine
+{
+    class GameObject;
+
+    // Structure-of-arrays storage for the motion (velocity, acceleration, angular velocity)
+    // of a scene's moving objects, integrated in one pass after the ticks of every step.
+    // Only objects with some motion have a slot: they get one when they start moving and
+    // lose it once all their motion is back to zero, so objects at rest are never visited.
+    // While an object has a slot, its motion accessors read and write these arrays.
+    class KinematicIntegrator
+    {
+    public:
+        void Add(GameObject *gameObject);
+        // the motion goes back to the object's fields
+        void Remove(GameObject *gameObject);
+
+        // advances every moving object by its step (scaled, or unscaled if the object uses
+        // unscaled time), optionally on the job system, then marks the moved ones dirty
+        void Integrate(float scaledStep, float unscaledStep, bool parallel);
+
+        size_t Size() const { return owners.size(); }
+
+        std::vector<glm::vec3> velocities;
+        std::vector<glm::vec3> accelerations;
+        std::vector<glm::vec3> angularVelocities;
+
+    private:
+        void RemoveSlot(size_t slot);
+        void IntegrateRange(size_t begin, size_t end);
+
+        std::vector<GameObject *> owners;
+        // per step: the time step of each slot (0 for inactive objects), and the results
+        std::vector<float> steps;
+        std::vector<glm::quat> rotations;
+        std::vector<uint8_t> moved;  // bit 0: translated, bit 1: rotated
+    };
+}
@@ -1,6 +1,7 @@
 #include <iostream>
 #include "material.h"
 #include "light.h"
+#include "renderqueue.h"
 
 using namespace engine;
 
@@ -8,75 +9,70 @@ Material::Material(Shader *shader): shader(shader) {}
 
 Material::~Material() {}
 
-void Material::SetInt(std::string name, int value)
+Material::Uniform &Material::SetUniform(std::string_view name, UniformType type)
 {
-    UniformValue val;
-    val.intValue = value;
-    uniforms[name] = std::make_pair(INT, val);
+    for (auto &uniform : uniforms) {
+        if (uniform.name == name) {
+            uniform.type = type;
+            return uniform;
+        }
+    }
+    uniforms.push_back({ std::string(name), type, UniformValue() });
+    return uniforms.back();
+}
+
+void Material::SetInt(std::string_view name, int value)
+{
+    SetUniform(name, INT).value.intValue = value;
 }
 
-void Material::SetFloat(std::string name, float value)
+void Material::SetFloat(std::string_view name, float value)
 {
-    UniformValue val;
-    val.floatValue = value;
-    uniforms[name] = std::make_pair(FLOAT, val);
+    SetUniform(name, FLOAT).value.floatValue = value;
 }
 
-void Material::SetIVec2(std::string name, glm::ivec2 value)
+void Material::SetIVec2(std::string_view name, glm::ivec2 value)
 {
-    UniformValue val;
-    val.ivec2Value = value;
-    uniforms[name] = std::make_pair(IVEC2, val);
+    SetUniform(name, IVEC2).value.ivec2Value = value;
 }
 
-void Material::SetVec2(std::string name, glm::vec2 value)
+void Material::SetVec2(std::string_view name, glm::vec2 value)
 {
-    UniformValue val;
-    val.vec2Value = value;
-    uniforms[name] = std::make_pair(VEC2, val);
+    SetUniform(name, VEC2).value.vec2Value = value;
 }
 
-void Material::SetVec3(std::string name, glm::vec3 value)
+void Material::SetVec3(std::string_view name, glm::vec3 value)
 {
-    UniformValue val;
-    val.vec3Value = value;
-    uniforms[name] = std::make_pair(VEC3, val);
+    SetUniform(name, VEC3).value.vec3Value = value;
 }
 
-void Material::SetVec4(std::string name, glm::vec4 value)
+void Material::SetVec4(std::string_view name, glm::vec4 value)
 {
-    UniformValue val;
-    val.vec4Value = value;
-    uniforms[name] = std::make_pair(VEC4, val);
+    SetUniform(name, VEC4).value.vec4Value = value;
 }
 
-void Material::SetMat3(std::string name, glm::mat3 value)
+void Material::SetMat3(std::string_view name, glm::mat3 value)
 {
-    UniformValue val;
-    val.mat3Value = value;
-    uniforms[name] = std::make_pair(MAT3, val);
+    SetUniform(name, MAT3).value.mat3Value = value;
 }
 
-void Material::SetMat4(std::string name, glm::mat4 value)
+void Material::SetMat4(std::string_view name, glm::mat4 value)
 {
-    UniformValue val;
-    val.mat4Value = value;
-    uniforms[name] = std::make_pair(MAT4, val);
+    SetUniform(name, MAT4).value.mat4Value = value;
 }
 
-void Material::SetTexture(std::string name, Texture *texture)
+void Material::SetTexture(std::string_view name, Texture *texture)
 {
-    if (uniforms.find(name) == uniforms.end()) {
+    size_t count = uniforms.size();
+    Uniform &uniform = SetUniform(name, TEXTURE);
+    if (uniforms.size() > count) {
         if (numTextures == MAX_2D_TEXTURES) {
             std::cout << "Maximum number of textures reached" << std::endl;
             std::abort();
         }
         numTextures += 1;
     }
-
-    UniformValue val;
-    val.textureValue = texture;
-    uniforms[name] = std::make_pair(TEXTURE, val);
+    uniform.value.textureValue = texture;
 }
 
 Texture *Material::GetTexture()
@@ -94,7 +90,30 @@ void Material::SetTexture(Texture *texture)
     this->texture = texture;
 }
 
-void Material::Use()
+size_t Material::GetTextureSetHash() const
+{
+    size_t hash = texture ? texture->GetGLTextureID() : 0;
+    for (auto &uniform : uniforms) {
+        if (uniform.type == TEXTURE)
+            hash = hash * 31 + uniform.value.textureValue->GetGLTextureID();
+    }
+    return hash;
+}
+
+// binds the texture to the given unit, unless the render state says it is already there
+static void BindTexture(RenderState *state, int unit, Texture *texture)
+{
+    GLuint id = texture->GetGLTextureID();
+    if (state && unit < MAX_2D_TEXTURES) {
+        if (state->textures[unit] == id)
+            return;
+        state->textures[unit] = id;
+    }
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(texture->GetGLType(), id);
+}
+
+void Material::Use(RenderState *state)
 {
     if (!shader || !shader->program)
         return;
@@ -115,11 +134,13 @@ void Material::Use()
         // glDisable(GL_BLEND);
     }
 
-    shader->Use();
+    if (!state || state->shader != shader) {
+        shader->Use();
+        if (state) state->shader = shader;
+    }
 
     if (texture) {
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(texture->GetGLType(), texture->GetGLTextureID());
+        BindTexture(state, 0, texture);
         glUniform1i(glGetUniformLocation(shader->program, "WIST_TEXTURE"), 0);
         glUniform1i(glGetUniformLocation(shader->program, "WIST_USE_TEXTURE"), 1);
     } else {
@@ -136,9 +157,10 @@ void Material::Use()
     glUniform1f(loc_shininess, shininess);
 
     int textureIdx = !!texture;
-    for (auto [name, uniform] : uniforms) {
-        auto [type, value] = uniform;
-        GLint location = glGetUniformLocation(shader->program, name.c_str());
+    for (const auto &uniform : uniforms) {
+        UniformType type = uniform.type;
+        const UniformValue &value = uniform.value;
+        GLint location = glGetUniformLocation(shader->program, uniform.name.c_str());
         if (type == INT) {
             glUniform1i(location, value.intValue);
         } else if (type == FLOAT) {
@@ -156,8 +178,7 @@ void Material::Use()
         } else if (type == MAT4) {
             glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value.mat4Value));
         } else if (type == TEXTURE) {
-            glActiveTexture(GL_TEXTURE0 + textureIdx);
-            glBindTexture(value.textureValue->GetGLType(), value.textureValue->GetGLTextureID());
+            BindTexture(state, textureIdx, value.textureValue);
             glUniform1i(location, textureIdx++);
         }
     }
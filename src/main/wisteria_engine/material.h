@@ -1,11 +1,15 @@
 #pragma once
 
+#include <string>
+#include <string_view>
+#include <vector>
 #include "core/gpu/shader.h"
 #include "utils/glm_utils.h"
 #include "texture.h"
 
 namespace engine
 {
+    struct RenderState;
     class Material
     {
     public:
@@ -13,20 +17,26 @@ namespace engine
         Material(Shader *shader);
         ~Material();
 
-        void SetInt(std::string name, int value);
-        void SetFloat(std::string name, float value);
-        void SetIVec2(std::string name, glm::ivec2 value);
-        void SetVec2(std::string name, glm::vec2 value);
-        void SetVec3(std::string name, glm::vec3 value);
-        void SetVec4(std::string name, glm::vec4 value);
-        void SetMat3(std::string name, glm::mat3 value);
-        void SetMat4(std::string name, glm::mat4 value);
-        void SetTexture(std::string name, Texture *texture);
+        // names are looked up in place, so setting a uniform the material already has
+        // never allocates, whatever the length of its name
+        void SetInt(std::string_view name, int value);
+        void SetFloat(std::string_view name, float value);
+        void SetIVec2(std::string_view name, glm::ivec2 value);
+        void SetVec2(std::string_view name, glm::vec2 value);
+        void SetVec3(std::string_view name, glm::vec3 value);
+        void SetVec4(std::string_view name, glm::vec4 value);
+        void SetMat3(std::string_view name, glm::mat3 value);
+        void SetMat4(std::string_view name, glm::mat4 value);
+        void SetTexture(std::string_view name, Texture *texture);
 
         Texture *GetTexture();
         void SetTexture(Texture *texture);
 
-        void Use();
+        // when a render state is given, the program and the textures it already has
+        // bound are not bound again
+        void Use(RenderState *state = nullptr);
+        // identifies the set of textures bound by Use(); used to sort draws
+        size_t GetTextureSetHash() const;
 
         glm::vec3 diffuseLight = glm::vec3(0.05f, 0.05f, 0.05f);
         glm::vec3 specularLight = glm::vec3(0.02f, 0.02f, 0.02f);
@@ -36,6 +46,8 @@ namespace engine
         bool wireframe = false;
         Texture *texture = nullptr;
         int instances = 1;
+        // render queue pass (0-3); materials in a higher pass are drawn later
+        unsigned int renderPass = 0;
 
         bool blending = false;
         GLint blendFunction = GL_FUNC_ADD;
@@ -60,7 +72,16 @@ namespace engine
             glm::mat3 mat3Value; glm::mat4 mat4Value;
             Texture *textureValue;
         };
-        std::unordered_map<std::string, std::pair<UniformType, UniformValue>> uniforms;
+        struct Uniform {
+            std::string name;
+            UniformType type;
+            UniformValue value;
+        };
+        // the uniform with that name, added if it's new; materials only have a few, so a
+        // linear search beats hashing the name
+        Uniform &SetUniform(std::string_view name, UniformType type);
+
+        std::vector<Uniform> uniforms;  // in the order they were first set
 
         unsigned int numTextures = 0;
     };
@@ -0,0 +1,278 @@
+#include <cmath>
+#include <algorithm>
+#include "narrowphase.h"
+#include "gameobject3d.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+    #include <emmintrin.h>
+    #define WIST_NARROWPHASE_SSE
+    #if defined(_MSC_VER) && !defined(__clang__)
+        #include <intrin.h>
+    #endif
+#elif defined(__ARM_NEON)
+    #include <arm_neon.h>
+    #define WIST_NARROWPHASE_NEON
+#endif
+
+using namespace engine;
+
+namespace
+{
+    struct V1 {
+        static const size_t width = 1;
+        float v;
+
+        static V1 Load(const float *p) { return { *p }; }
+        static V1 Set(float x) { return { x }; }
+        void Store(float *p) const { *p = v; }
+        static void StoreLessEqual(uint8_t *out, V1 a, V1 b) { *out = a.v <= b.v; }
+    };
+
+    V1 operator+(V1 a, V1 b) { return { a.v + b.v }; }
+    V1 operator-(V1 a, V1 b) { return { a.v - b.v }; }
+    V1 operator*(V1 a, V1 b) { return { a.v * b.v }; }
+    V1 Min(V1 a, V1 b) { return { a.v < b.v ? a.v : b.v }; }
+    V1 Max(V1 a, V1 b) { return { a.v > b.v ? a.v : b.v }; }
+    V1 Abs(V1 a) { return { std::fabs(a.v) }; }
+    V1 Sqrt(V1 a) { return { std::sqrt(a.v) }; }
+
+    const NarrowphaseKernels scalarKernels = {
+        "scalar", kernels::SphereSphere<V1>, kernels::BoxSphere<V1>, kernels::BoxBox<V1>
+    };
+
+#if defined(WIST_NARROWPHASE_SSE)
+    struct V4 {
+        static const size_t width = 4;
+        __m128 v;
+
+        static V4 Load(const float *p) { return { _mm_loadu_ps(p) }; }
+        static V4 Set(float x) { return { _mm_set1_ps(x) }; }
+        void Store(float *p) const { _mm_storeu_ps(p, v); }
+        static void StoreLessEqual(uint8_t *out, V4 a, V4 b)
+        {
+            int mask = _mm_movemask_ps(_mm_cmple_ps(a.v, b.v));
+            for (int i = 0; i < 4; ++i)
+                out[i] = (mask >> i) & 1;
+        }
+    };
+
+    V4 operator+(V4 a, V4 b) { return { _mm_add_ps(a.v, b.v) }; }
+    V4 operator-(V4 a, V4 b) { return { _mm_sub_ps(a.v, b.v) }; }
+    V4 operator*(V4 a, V4 b) { return { _mm_mul_ps(a.v, b.v) }; }
+    V4 Min(V4 a, V4 b) { return { _mm_min_ps(a.v, b.v) }; }
+    V4 Max(V4 a, V4 b) { return { _mm_max_ps(a.v, b.v) }; }
+    V4 Abs(V4 a) { return { _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v) }; }
+    V4 Sqrt(V4 a) { return { _mm_sqrt_ps(a.v) }; }
+
+    const NarrowphaseKernels simdKernels = {
+        "SSE", kernels::SphereSphere<V4>, kernels::BoxSphere<V4>, kernels::BoxBox<V4>
+    };
+#elif defined(WIST_NARROWPHASE_NEON)
+    struct V4 {
+        static const size_t width = 4;
+        float32x4_t v;
+
+        static V4 Load(const float *p) { return { vld1q_f32(p) }; }
+        static V4 Set(float x) { return { vdupq_n_f32(x) }; }
+        void Store(float *p) const { vst1q_f32(p, v); }
+        static void StoreLessEqual(uint8_t *out, V4 a, V4 b)
+        {
+            uint32x4_t mask = vcleq_f32(a.v, b.v);
+            out[0] = vgetq_lane_u32(mask, 0) & 1;
+            out[1] = vgetq_lane_u32(mask, 1) & 1;
+            out[2] = vgetq_lane_u32(mask, 2) & 1;
+            out[3] = vgetq_lane_u32(mask, 3) & 1;
+        }
+    };
+
+    V4 operator+(V4 a, V4 b) { return { vaddq_f32(a.v, b.v) }; }
+    V4 operator-(V4 a, V4 b) { return { vsubq_f32(a.v, b.v) }; }
+    V4 operator*(V4 a, V4 b) { return { vmulq_f32(a.v, b.v) }; }
+    V4 Min(V4 a, V4 b) { return { vminq_f32(a.v, b.v) }; }
+    V4 Max(V4 a, V4 b) { return { vmaxq_f32(a.v, b.v) }; }
+    V4 Abs(V4 a) { return { vabsq_f32(a.v) }; }
+    V4 Sqrt(V4 a)
+    {
+        float lanes[4];
+        vst1q_f32(lanes, a.v);
+        for (auto &lane : lanes)
+            lane = std::sqrt(lane);
+        return { vld1q_f32(lanes) };
+    }
+
+    const NarrowphaseKernels simdKernels = {
+        "NEON", kernels::SphereSphere<V4>, kernels::BoxSphere<V4>, kernels::BoxBox<V4>
+    };
+#endif
+
+    bool CpuSupportsAvx2()
+    {
+#if defined(WIST_NARROWPHASE_SSE) && defined(_MSC_VER) && !defined(__clang__)
+        // the CPU must support it, and the OS must save the YMM registers
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+            return false;
+        __cpuid(info, 1);
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        __cpuidex(info, 7, 0);
+        return osxsave && (info[1] & (1 << 5)) != 0 && (_xgetbv(0) & 6) == 6;
+#elif defined(WIST_NARROWPHASE_SSE)
+        return __builtin_cpu_supports("avx2");
+#else
+        return false;
+#endif
+    }
+
+    const NarrowphaseKernels *SelectKernels()
+    {
+        const NarrowphaseKernels *avx2 = GetAvx2Kernels();
+        if (avx2 != nullptr && CpuSupportsAvx2())
+            return avx2;
+#if defined(WIST_NARROWPHASE_SSE) || defined(WIST_NARROWPHASE_NEON)
+        return &simdKernels;
+#else
+        return &scalarKernels;
+#endif
+    }
+}
+
+const NarrowphaseKernels *Narrowphase::selectedKernels = nullptr;
+
+const NarrowphaseKernels *Narrowphase::GetKernels()
+{
+    if (selectedKernels == nullptr)
+        selectedKernels = SelectKernels();
+    return selectedKernels;
+}
+
+const NarrowphaseKernels *Narrowphase::GetScalarKernels() { return &scalarKernels; }
+
+void Narrowphase::SetKernels(const NarrowphaseKernels *kernels)
+{
+    selectedKernels = kernels;
+}
+
+void Narrowphase::Group::Clear()
+{
+    tags.clear();
+    reversed.clear();
+    for (auto &field : in)
+        field.clear();
+}
+
+size_t Narrowphase::Group::GetCapacity() const
+{
+    size_t capacity = tags.capacity() + reversed.capacity() + hit.capacity();
+    for (auto &field : in)
+        capacity += field.capacity();
+    for (auto &field : out)
+        capacity += field.capacity();
+    return capacity;
+}
+
+size_t Narrowphase::Group::Prepare(int inputs, int outputs)
+{
+    size_t padded = (tags.size() + NARROWPHASE_PADDING - 1) / NARROWPHASE_PADDING * NARROWPHASE_PADDING;
+    for (int field = 0; field < inputs; ++field)
+        in[field].resize(padded, 0.0f);
+    for (int field = 0; field < outputs; ++field)
+        out[field].resize(padded);
+    hit.resize(padded);
+    return padded;
+}
+
+void Narrowphase::Clear()
+{
+    sphereSphere.Clear();
+    boxSphere.Clear();
+    boxBox.Clear();
+}
+
+size_t Narrowphase::GetCapacity() const
+{
+    return sphereSphere.GetCapacity() + boxSphere.GetCapacity() + boxBox.GetCapacity();
+}
+
+bool Narrowphase::Add(HitArea *first, HitArea *second, size_t tag)
+{
+    // swept pairs go through HitArea::Collides
+    if (first->support == nullptr || second->support == nullptr || first->continuous || second->continuous)
+        return false;
+    const int box = HitArea::TypeId<BoxHitArea>(), sphere = HitArea::TypeId<SphereHitArea>();
+    bool firstBox = first->GetTypeId() == box, firstSphere = first->GetTypeId() == sphere;
+    bool secondBox = second->GetTypeId() == box, secondSphere = second->GetTypeId() == sphere;
+
+    // the shapes as the scalar collision functions see them, mirroring included
+    auto gatherSphere = [](HitArea *hitArea, std::vector<float> *fields) {
+        SphereHitArea *s = static_cast<SphereHitArea *>(hitArea);
+        glm::vec3 center = s->support->GetPosition();
+        fields[0].push_back(center.x);
+        fields[1].push_back(center.y);
+        fields[2].push_back(center.z);
+        fields[3].push_back(s->GetRadius());
+    };
+    auto gatherBox = [](HitArea *hitArea, std::vector<float> *fields) {
+        BoxHitArea *b = static_cast<BoxHitArea *>(hitArea);
+        glm::vec3 center = b->support->GetPosition();
+        glm::vec3 halfSize = b->GetHalfSize();
+        fields[0].push_back(center.x);
+        fields[1].push_back(center.y);
+        fields[2].push_back(center.z);
+        fields[3].push_back(halfSize.x);
+        fields[4].push_back(halfSize.y);
+        fields[5].push_back(halfSize.z);
+    };
+
+    if (firstSphere && secondSphere) {
+        gatherSphere(first, sphereSphere.in);
+        gatherSphere(second, sphereSphere.in + 4);
+        sphereSphere.tags.push_back(tag);
+    } else if ((firstBox && secondSphere) || (firstSphere && secondBox)) {
+        bool reversed = firstSphere;
+        gatherBox(reversed ? second : first, boxSphere.in);
+        gatherSphere(reversed ? first : second, boxSphere.in + 6);
+        boxSphere.tags.push_back(tag);
+        boxSphere.reversed.push_back(reversed);
+    } else if (firstBox && secondBox) {
+        gatherBox(first, boxBox.in);
+        gatherBox(second, boxBox.in + 6);
+        boxBox.tags.push_back(tag);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void Narrowphase::Run()
+{
+    const NarrowphaseKernels *kernels = GetKernels();
+
+    if (!sphereSphere.tags.empty()) {
+        Group &g = sphereSphere;
+        size_t count = g.Prepare(8, 4);
+        kernels->sphereSphere({ g.in[0].data(), g.in[1].data(), g.in[2].data(), g.in[3].data(),
+                                g.in[4].data(), g.in[5].data(), g.in[6].data(), g.in[7].data(),
+                                g.out[0].data(), g.out[1].data(), g.out[2].data(), g.out[3].data(),
+                                g.hit.data(), count });
+    }
+    if (!boxSphere.tags.empty()) {
+        Group &g = boxSphere;
+        size_t count = g.Prepare(10, 7);
+        kernels->boxSphere({ g.in[0].data(), g.in[1].data(), g.in[2].data(),
+                             g.in[3].data(), g.in[4].data(), g.in[5].data(),
+                             g.in[6].data(), g.in[7].data(), g.in[8].data(), g.in[9].data(),
+                             g.out[0].data(), g.out[1].data(), g.out[2].data(),
+                             g.out[3].data(), g.out[4].data(), g.out[5].data(), g.out[6].data(),
+                             g.hit.data(), count });
+    }
+    if (!boxBox.tags.empty()) {
+        Group &g = boxBox;
+        size_t count = g.Prepare(12, 0);
+        kernels->boxBox({ g.in[0].data(), g.in[1].data(), g.in[2].data(),
+                          g.in[3].data(), g.in[4].data(), g.in[5].data(),
+                          g.in[6].data(), g.in[7].data(), g.in[8].data(),
+                          g.in[9].data(), g.in[10].data(), g.in[11].data(),
+                          g.hit.data(), count });
+    }
+}
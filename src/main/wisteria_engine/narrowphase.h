@@ -0,0 +1,86 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "hitarea3d.h"
+#include "narrowphasekernels.h"
+
+#define NARROWPHASE_MAX_INPUTS 12
+#define NARROWPHASE_MAX_OUTPUTS 7
+
+namespace engine
+{
+    // Batched narrowphase for the built-in hit areas. Pairs are grouped by shape
+    // combination, their shape parameters (center, half extents and radius, with the
+    // pseudo scale applied) gathered into SoA arrays, and each group is tested with
+    // the widest kernels the CPU supports: AVX2 (8 pairs at once), SSE or NEON (4),
+    // or plain scalar code. Pairs of other hit areas go through HitArea::Collides.
+    class Narrowphase
+    {
+    public:
+        void Clear();
+        // queues a pair; false if no kernel handles it, and the caller must test it
+        bool Add(HitArea *first, HitArea *second, size_t tag);
+        void Run();
+        // of the reused buffers; only changes when they grow
+        size_t GetCapacity() const;
+        // result(tag, touching, record) for every queued pair, after Run
+        template <typename Callback>
+        void ForEachResult(Callback result) const;
+
+        // the kernels picked for this CPU, and the portable ones
+        static const NarrowphaseKernels *GetKernels();
+        static const NarrowphaseKernels *GetScalarKernels();
+        // overrides the runtime selection, e.g. to compare the kernels; nullptr restores it
+        static void SetKernels(const NarrowphaseKernels *kernels);
+
+    private:
+        // one array per field; padded with zeros before running the kernels
+        struct Group {
+            std::vector<size_t> tags;
+            std::vector<uint8_t> reversed;  // queued as (sphere, box) instead of (box, sphere)
+            std::vector<float> in[NARROWPHASE_MAX_INPUTS];
+            std::vector<float> out[NARROWPHASE_MAX_OUTPUTS];
+            std::vector<uint8_t> hit;
+
+            void Clear();
+            size_t GetCapacity() const;
+            // returns the padded count
+            size_t Prepare(int inputs, int outputs);
+        };
+
+        Group sphereSphere;  // inputs: a xyz r, b xyz r; outputs: d xyz, distance
+        Group boxSphere;  // inputs: c xyz, h xyz, s xyz r; outputs: p xyz, d xyz, distance
+        Group boxBox;  // inputs: a xyz, ah xyz, b xyz, bh xyz; no outputs
+
+        static const NarrowphaseKernels *selectedKernels;
+    };
+
+    template <typename Callback>
+    void Narrowphase::ForEachResult(Callback result) const
+    {
+        for (size_t i = 0; i < sphereSphere.tags.size(); ++i) {
+            ContactRecord record;
+            record.createEvent = &SphereSphereCollisionEvent::Create;
+            record.displacement = glm::vec3(sphereSphere.out[0][i], sphereSphere.out[1][i], sphereSphere.out[2][i]);
+            record.distance = sphereSphere.out[3][i];
+            record.sumRadius = sphereSphere.in[3][i] + sphereSphere.in[7][i];
+            result(sphereSphere.tags[i], sphereSphere.hit[i] != 0, record);
+        }
+        for (size_t i = 0; i < boxSphere.tags.size(); ++i) {
+            ContactRecord record;
+            record.createEvent = &SphereBoxCollisionEvent::Create;
+            record.point = glm::vec3(boxSphere.out[0][i], boxSphere.out[1][i], boxSphere.out[2][i]);
+            record.displacement = glm::vec3(boxSphere.out[3][i], boxSphere.out[4][i], boxSphere.out[5][i]);
+            record.distance = boxSphere.out[6][i];
+            // the records are seen from the first hit area, see CollidesSphereBox
+            if (boxSphere.reversed[i])
+                record.displacement = -record.displacement;
+            result(boxSphere.tags[i], boxSphere.hit[i] != 0, record);
+        }
+        for (size_t i = 0; i < boxBox.tags.size(); ++i) {
+            ContactRecord record;
+            result(boxBox.tags[i], boxBox.hit[i] != 0, record);
+        }
+    }
+}
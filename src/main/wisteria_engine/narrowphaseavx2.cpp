@@ -0,0 +1,49 @@
+// Compiled with AVX2 enabled when the build targets x86-64 (see CMakeLists.txt); it is
+// only called after checking the CPU at runtime, and includes nothing but the kernels,
+// so that no AVX2 code can leak into inline functions shared with other files.
+#include "narrowphasekernels.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+
+using namespace engine;
+
+namespace
+{
+    struct V8 {
+        static const size_t width = 8;
+        __m256 v;
+
+        static V8 Load(const float *p) { return { _mm256_loadu_ps(p) }; }
+        static V8 Set(float x) { return { _mm256_set1_ps(x) }; }
+        void Store(float *p) const { _mm256_storeu_ps(p, v); }
+        static void StoreLessEqual(uint8_t *out, V8 a, V8 b)
+        {
+            int mask = _mm256_movemask_ps(_mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ));
+            for (int i = 0; i < 8; ++i)
+                out[i] = (mask >> i) & 1;
+        }
+    };
+
+    V8 operator+(V8 a, V8 b) { return { _mm256_add_ps(a.v, b.v) }; }
+    V8 operator-(V8 a, V8 b) { return { _mm256_sub_ps(a.v, b.v) }; }
+    V8 operator*(V8 a, V8 b) { return { _mm256_mul_ps(a.v, b.v) }; }
+    V8 Min(V8 a, V8 b) { return { _mm256_min_ps(a.v, b.v) }; }
+    V8 Max(V8 a, V8 b) { return { _mm256_max_ps(a.v, b.v) }; }
+    V8 Abs(V8 a) { return { _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v) }; }
+    V8 Sqrt(V8 a) { return { _mm256_sqrt_ps(a.v) }; }
+
+    void SphereSphere(const SphereSphereBatch &batch) { kernels::SphereSphere<V8>(batch); }
+    void BoxSphere(const BoxSphereBatch &batch) { kernels::BoxSphere<V8>(batch); }
+    void BoxBox(const BoxBoxBatch &batch) { kernels::BoxBox<V8>(batch); }
+
+    const NarrowphaseKernels avx2Kernels = { "AVX2", SphereSphere, BoxSphere, BoxBox };
+}
+
+const NarrowphaseKernels *engine::GetAvx2Kernels() { return &avx2Kernels; }
+
+#else
+
+const engine::NarrowphaseKernels *engine::GetAvx2Kernels() { return nullptr; }
+
+#endif
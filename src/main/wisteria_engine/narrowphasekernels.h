@@ -0,0 +1,109 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Batched narrowphase kernels, shared by the instruction set specific translation units
+// (see narrowphase.cpp and narrowphaseavx2.cpp). Each one instantiates the kernels with
+// its own SIMD wrapper type V, which provides:
+//   static const size_t width;
+//   static V Load(const float *), V Set(float); void Store(float *) const;
+//   operators + - *, Min, Max, Abs, Sqrt;
+//   static void StoreLessEqual(uint8_t *out, V a, V b);  // out[i] = a[i] <= b[i]
+// The wrapper types must have internal linkage, so that code compiled for one
+// instruction set can never be picked by the linker for another one.
+
+// SoA inputs and outputs hold one value per pair. Counts are padded to a multiple of
+// the widest SIMD width, so the kernels never need a scalar tail.
+#define NARROWPHASE_PADDING 8
+
+namespace engine
+{
+    struct SphereSphereBatch {
+        const float *ax, *ay, *az, *ar;  // first sphere: center and radius
+        const float *bx, *by, *bz, *br;  // second sphere
+        float *dx, *dy, *dz, *distance;  // displacement from the first to the second
+        uint8_t *hit;
+        size_t count;
+    };
+
+    struct BoxSphereBatch {
+        const float *cx, *cy, *cz;  // box center
+        const float *hx, *hy, *hz;  // box half extents, positive
+        const float *sx, *sy, *sz, *r;  // sphere center and radius
+        float *px, *py, *pz;  // closest point of the box to the sphere center
+        float *dx, *dy, *dz, *distance;  // displacement from the closest point to the center
+        uint8_t *hit;
+        size_t count;
+    };
+
+    struct BoxBoxBatch {
+        const float *ax, *ay, *az, *ahx, *ahy, *ahz;  // first box: center and half extents
+        const float *bx, *by, *bz, *bhx, *bhy, *bhz;
+        uint8_t *hit;
+        size_t count;
+    };
+
+    struct NarrowphaseKernels {
+        const char *name;
+        void (*sphereSphere)(const SphereSphereBatch &batch);
+        void (*boxSphere)(const BoxSphereBatch &batch);
+        void (*boxBox)(const BoxBoxBatch &batch);
+    };
+
+    // nullptr if the build doesn't compile them (the CPU may still lack support)
+    const NarrowphaseKernels *GetAvx2Kernels();
+
+    namespace kernels
+    {
+        template <typename V>
+        void SphereSphere(const SphereSphereBatch &b)
+        {
+            for (size_t i = 0; i < b.count; i += V::width) {
+                V dx = V::Load(b.bx + i) - V::Load(b.ax + i);
+                V dy = V::Load(b.by + i) - V::Load(b.ay + i);
+                V dz = V::Load(b.bz + i) - V::Load(b.az + i);
+                V distance = Sqrt(dx * dx + dy * dy + dz * dz);
+                dx.Store(b.dx + i);
+                dy.Store(b.dy + i);
+                dz.Store(b.dz + i);
+                distance.Store(b.distance + i);
+                V::StoreLessEqual(b.hit + i, distance, V::Load(b.ar + i) + V::Load(b.br + i));
+            }
+        }
+
+        template <typename V>
+        void BoxSphere(const BoxSphereBatch &b)
+        {
+            for (size_t i = 0; i < b.count; i += V::width) {
+                V cx = V::Load(b.cx + i), cy = V::Load(b.cy + i), cz = V::Load(b.cz + i);
+                V hx = V::Load(b.hx + i), hy = V::Load(b.hy + i), hz = V::Load(b.hz + i);
+                V sx = V::Load(b.sx + i), sy = V::Load(b.sy + i), sz = V::Load(b.sz + i);
+                V px = Min(Max(sx, cx - hx), cx + hx);
+                V py = Min(Max(sy, cy - hy), cy + hy);
+                V pz = Min(Max(sz, cz - hz), cz + hz);
+                V dx = sx - px, dy = sy - py, dz = sz - pz;
+                V distance = Sqrt(dx * dx + dy * dy + dz * dz);
+                px.Store(b.px + i);
+                py.Store(b.py + i);
+                pz.Store(b.pz + i);
+                dx.Store(b.dx + i);
+                dy.Store(b.dy + i);
+                dz.Store(b.dz + i);
+                distance.Store(b.distance + i);
+                V::StoreLessEqual(b.hit + i, distance, V::Load(b.r + i));
+            }
+        }
+
+        template <typename V>
+        void BoxBox(const BoxBoxBatch &b)
+        {
+            // separated on an axis if the distance of the centers exceeds the summed extents
+            for (size_t i = 0; i < b.count; i += V::width) {
+                V sx = Abs(V::Load(b.ax + i) - V::Load(b.bx + i)) - (V::Load(b.ahx + i) + V::Load(b.bhx + i));
+                V sy = Abs(V::Load(b.ay + i) - V::Load(b.by + i)) - (V::Load(b.ahy + i) + V::Load(b.bhy + i));
+                V sz = Abs(V::Load(b.az + i) - V::Load(b.bz + i)) - (V::Load(b.ahz + i) + V::Load(b.bhz + i));
+                V::StoreLessEqual(b.hit + i, Max(Max(sx, sy), sz), V::Set(0));
+            }
+        }
+    }
+}
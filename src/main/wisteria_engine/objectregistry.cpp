@@ -0,0 +1,98 @@
+#include "objectregistry.h"
+#include "gameobject3d.h"
+
+using namespace engine;
+
+ObjectHandle ObjectRegistry::Add(GameObject *gameObject)
+{
+    uint32_t slot = freeSlots;
+    if (slot == OBJECT_NULL_INDEX) {
+        slot = (uint32_t)slots.size();
+        slots.push_back(Slot());
+    } else {
+        freeSlots = slots[slot].position;
+    }
+
+    slots[slot].position = (uint32_t)objects.size();
+    objects.push_back(gameObject);
+    objectSlots.push_back(slot);
+    JoinLayers(slot, gameObject, gameObject->GetLayerMask());
+
+    ObjectHandle handle;
+    handle.index = slot;
+    handle.generation = slots[slot].generation;
+    return handle;
+}
+
+void ObjectRegistry::Remove(ObjectHandle handle)
+{
+    GameObject *gameObject = Get(handle);
+    if (gameObject == nullptr)
+        return;
+
+    LeaveLayers(handle.index, gameObject->GetLayerMask());
+
+    // the last object fills the hole
+    uint32_t position = slots[handle.index].position;
+    objects[position] = objects.back();
+    objectSlots[position] = objectSlots.back();
+    slots[objectSlots[position]].position = position;
+    objects.pop_back();
+    objectSlots.pop_back();
+
+    // the new generation invalidates every handle to the removed object
+    Slot &slot = slots[handle.index];
+    ++slot.generation;
+    slot.position = freeSlots;
+    freeSlots = handle.index;
+}
+
+GameObject *ObjectRegistry::Get(ObjectHandle handle) const
+{
+    if (handle.index >= slots.size())
+        return nullptr;
+    const Slot &slot = slots[handle.index];
+    if (slot.generation != handle.generation || slot.position >= objects.size())
+        return nullptr;
+    return objects[slot.position];
+}
+
+void ObjectRegistry::UpdateLayers(GameObject *gameObject, uint32_t oldMask)
+{
+    ObjectHandle handle = gameObject->GetHandle();
+    if (Get(handle) != gameObject)
+        return;  // not in this registry
+    uint32_t mask = gameObject->GetLayerMask();
+    LeaveLayers(handle.index, oldMask & ~mask);
+    JoinLayers(handle.index, gameObject, mask & ~oldMask);
+}
+
+void ObjectRegistry::JoinLayers(uint32_t slot, GameObject *gameObject, uint32_t mask)
+{
+    for (int layer = 0; mask != 0; ++layer, mask >>= 1) {
+        if (!(mask & 1))
+            continue;
+        if (layerPositions[layer].size() < slots.size())
+            layerPositions[layer].resize(slots.size(), OBJECT_NULL_INDEX);
+        layerPositions[layer][slot] = (uint32_t)layers[layer].size();
+        layers[layer].push_back(gameObject);
+        layerSlots[layer].push_back(slot);
+    }
+}
+
+void ObjectRegistry::LeaveLayers(uint32_t slot, uint32_t mask)
+{
+    for (int layer = 0; mask != 0; ++layer, mask >>= 1) {
+        if (!(mask & 1))
+            continue;
+        // the last object of the layer takes the place of the one leaving
+        std::vector<uint32_t> &positions = layerPositions[layer];
+        uint32_t position = positions[slot];
+        layers[layer][position] = layers[layer].back();
+        layerSlots[layer][position] = layerSlots[layer].back();
+        positions[layerSlots[layer][position]] = position;
+        positions[slot] = OBJECT_NULL_INDEX;
+        layers[layer].pop_back();
+        layerSlots[layer].pop_back();
+    }
+}
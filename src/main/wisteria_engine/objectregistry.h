@@ -0,0 +1,75 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#define OBJECT_NULL_INDEX 0xFFFFFFFF
+
+namespace engine
+{
+    class GameObject;
+
+    // Refers to an object of a scene without owning it. Once the object is destroyed,
+    // its slot gets a new generation, so an old handle resolves to nullptr instead of
+    // dangling, even after the slot is reused by another object.
+    struct ObjectHandle {
+        uint32_t index = OBJECT_NULL_INDEX;
+        uint32_t generation = 0;
+
+        bool IsNull() const { return index == OBJECT_NULL_INDEX; }
+        bool operator==(const ObjectHandle &other) const
+        {
+            return index == other.index && generation == other.generation;
+        }
+        bool operator!=(const ObjectHandle &other) const { return !(*this == other); }
+    };
+
+    // Slot map of the objects of a scene. The objects themselves are kept densely packed
+    // in one array, so iterating them is a linear walk in a deterministic order; the
+    // slots only map handles to positions in that array. Adding and removing are O(1):
+    // removing moves the last object into the hole.
+    //
+    // Layers are nothing more than the layer mask bits of the objects. Each layer also
+    // has a dense list of its objects, kept up to date in O(1) like the objects: every
+    // object knows its position in the lists of its layers, and leaving a list moves the
+    // last object of the list into the hole.
+    class ObjectRegistry
+    {
+    public:
+        ObjectHandle Add(GameObject *gameObject);
+        void Remove(ObjectHandle handle);
+        // nullptr if the handle is null or stale
+        GameObject *Get(ObjectHandle handle) const;
+
+        size_t Size() const { return objects.size(); }
+        std::vector<GameObject *>::const_iterator begin() const { return objects.begin(); }
+        std::vector<GameObject *>::const_iterator end() const { return objects.end(); }
+        const std::vector<GameObject *> &Objects() const { return objects; }
+
+        // must be called once the layer mask of a registered object changed from oldMask
+        void UpdateLayers(GameObject *gameObject, uint32_t oldMask);
+        // the objects on a layer, in a deterministic order (not the one of Objects())
+        const std::vector<GameObject *> &GetLayer(int layer) const { return layers[layer]; }
+
+    private:
+        struct Slot {
+            uint32_t generation = 0;
+            // position in objects while the slot is used, next free slot otherwise
+            uint32_t position = OBJECT_NULL_INDEX;
+        };
+
+        std::vector<Slot> slots;
+        uint32_t freeSlots = OBJECT_NULL_INDEX;  // head of the free slot list
+        std::vector<GameObject *> objects;
+        std::vector<uint32_t> objectSlots;  // slot of each object, parallel to objects
+
+        void JoinLayers(uint32_t slot, GameObject *gameObject, uint32_t mask);
+        void LeaveLayers(uint32_t slot, uint32_t mask);
+
+        std::vector<GameObject *> layers[32];
+        // per layer, slot of each object of the list, and position in the list of each
+        // slot on the layer; only grown for the layers in use
+        std::vector<uint32_t> layerSlots[32];
+        std::vector<uint32_t> layerPositions[32];
+    };
+}
@@ -6,6 +6,7 @@ using namespace engine;
 
 ParticleSystem::ParticleSystem()
 {
+    SetUpdateMode(UPDATE_FIXED);
 }
 
 ParticleSystem::~ParticleSystem()
@@ -28,8 +29,10 @@ void ParticleSystem::Initialize()
     mesh->SetDrawMode(GL_POINTS);
     mesh->InitFromData(mesh->vertices, mesh->indices);
     material.instances = 0;
+    randomState = (uint32_t)rand();
+    SetLocalBounds(ComputeParticleBounds());
 
-    material.SetVec3("WIST_PARTICLE_SYSTEM_POSITION", position);
+    material.SetVec3("WIST_PARTICLE_SYSTEM_POSITION", GetPosition());
     material.SetFloat("WIST_PARTICLE_SIZE", particleSize);
 
     if (!material.shader)
@@ -42,8 +45,31 @@ void ParticleSystem::Tick(float deltaTime)
     if (activeParticles < maxParticles) {
         Emit((int)(maxParticles / duration * deltaTime + 0.5f));
     }
+    // every particle is out and the GPU does the rest, so there is nothing left to update
+    if (activeParticles >= maxParticles)
+        Sleep();
+}
+
+void ParticleSystem::OnTransformChange()
+{
+    material.SetVec3("WIST_PARTICLE_SYSTEM_POSITION", GetPosition());
+}
+
+void ParticleSystem::OnBeforeRender()
+{
+    // upload the particles emitted since the last draw; Tick can't, it may run on a worker thread
+    if (!emitted.empty()) {
+        size_t size = emitted.size() * sizeof(WistParticle);
+        size_t base = uploadedParticles * sizeof(WistParticle);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, base, size, emitted.data());
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        uploadedParticles += (int)emitted.size();
+        material.instances = uploadedParticles;
+        emitted.clear();
+    }
 
-    material.SetVec3("WIST_PARTICLE_SYSTEM_POSITION", position);
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, ssbo);
     // the unbinding is done after rendering by ControlledScene3D
 }
@@ -54,27 +80,42 @@ void ParticleSystem::Emit(int maxCount)
     if (maxCount <= 0)
         return;  // no more particles to emit
 
-    std::vector<WistParticle> particles(maxCount);
-    for (int i = 0; i < maxCount; ++i) {
-        particles[i].position = glm::vec3(rand11() * boxSize.x, rand11() * boxSize.y, rand11() * boxSize.z);
-        particles[i].velocity = initVelocity;
-        particles[i].acceleration = acceleration;
-        particles[i].init_position = particles[i].position;
-        particles[i].init_velocity = initVelocity;
-        particles[i].delay = delay;
-        particles[i].init_delay = delay;
-        particles[i].lifetime = initLifetime;
-        particles[i].init_lifetime = initLifetime;
+    size_t first = emitted.size();
+    emitted.resize(first + maxCount);
+    for (size_t i = first; i < emitted.size(); ++i) {
+        WistParticle &particle = emitted[i];
+        particle.position = glm::vec3(rand11() * boxSize.x, rand11() * boxSize.y, rand11() * boxSize.z);
+        particle.velocity = initVelocity;
+        particle.acceleration = acceleration;
+        particle.init_position = particle.position;
+        particle.init_velocity = initVelocity;
+        particle.delay = delay;
+        particle.init_delay = delay;
+        particle.lifetime = initLifetime;
+        particle.init_lifetime = initLifetime;
     }
 
-    size_t size = maxCount * sizeof(WistParticle);
-    size_t base = activeParticles * sizeof(WistParticle);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
-    glBufferSubData(GL_SHADER_STORAGE_BUFFER, base, size, particles.data());
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
-
+    // the GPU buffer is only updated in OnBeforeRender
     activeParticles += maxCount;
-    material.instances = activeParticles;
+}
+
+AABB ParticleSystem::ComputeParticleBounds()
+{
+    // the particles are simulated on the GPU, so bound every point a particle can
+    // reach: the emitter box swept along p(t) = v * t + a * t^2 / 2, t in [0, lifetime]
+    glm::vec3 minDisp = glm::vec3(0), maxDisp = glm::vec3(0);
+    for (int axis = 0; axis < 3; ++axis) {
+        float v = initVelocity[axis], a = acceleration[axis];
+        float ts[3] = { 0, initLifetime, initLifetime };
+        if (a != 0) ts[2] = glm::clamp(-v / a, 0.0f, initLifetime);  // extremum of the parabola
+        for (float t : ts) {
+            float p = v * t + a * t * t / 2;
+            minDisp[axis] = glm::min(minDisp[axis], p);
+            maxDisp[axis] = glm::max(maxDisp[axis], p);
+        }
+    }
+    glm::vec3 padding = glm::vec3(particleSize / 2);
+    return AABB(-boxSize + minDisp - padding, boxSize + maxDisp + padding);
 }
 
 void ParticleSystem::SwitchFragmentShader(std::string fragShaderName)
@@ -25,6 +25,8 @@ namespace engine
 
         void Initialize() override;
         void Tick(float deltaTime) override;
+        void OnTransformChange() override;
+        void OnBeforeRender() override;
 
         int maxParticles = 100;
         float duration = 1;
@@ -42,10 +44,19 @@ namespace engine
     private:
         GLuint ssbo = 0;
         int activeParticles = 0;
-        inline float rand11() { return 2 * (float)rand() / RAND_MAX - 1; }
+        int uploadedParticles = 0;
+        // rand() is shared by all the threads; every system gets its own generator instead,
+        // seeded from rand() in Initialize
+        uint32_t randomState = 0;
+        inline float rand11()
+        {
+            randomState = randomState * 1664525u + 1013904223u;
+            return 2 * (randomState >> 8) / (float)(1 << 24) - 1;
+        }
 
     protected:
         void Emit(int maxCount);
+        AABB ComputeParticleBounds();
 
         // the particle struct that will be passed to the shader
         // the naming of the fields matches the ones in the shader
@@ -65,5 +76,6 @@ namespace engine
             float lifetime;
             float init_lifetime;
         };
+        std::vector<WistParticle> emitted;  // emitted by Tick, not yet uploaded
     };
 };
\ No newline at end of file
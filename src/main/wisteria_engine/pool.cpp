@@ -0,0 +1,130 @@
+#include <new>
+#include <iostream>
+#include "pool.h"
+
+#define POOL_SLAB_SIZE (64 * 1024)  // bytes per slab, at least one block
+
+using namespace engine;
+
+PoolAllocator::PoolAllocator(size_t blockSize, size_t blocksPerSlab)
+    : blockSize(blockSize), blocksPerSlab(blocksPerSlab)
+{
+    stats.blockSize = blockSize;
+}
+
+PoolAllocator::~PoolAllocator()
+{
+    for (auto slab : slabs)
+        ::operator delete(slab);
+}
+
+void PoolAllocator::AddSlab()
+{
+    // ::operator new is aligned for any fundamental type, and the block size is a
+    // multiple of POOL_SIZE_CLASS, so every block is too
+    char *slab = static_cast<char *>(::operator new(blockSize * blocksPerSlab));
+    slabs.push_back(slab);
+    // link the blocks in address order, so consecutive allocations are contiguous
+    for (size_t i = blocksPerSlab; i-- > 0;) {
+        FreeBlock *block = reinterpret_cast<FreeBlock *>(slab + i * blockSize);
+        block->next = freeList;
+        freeList = block;
+    }
+    stats.capacity += blocksPerSlab;
+}
+
+void *PoolAllocator::Allocate()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (freeList == nullptr)
+        AddSlab();
+
+    FreeBlock *block = freeList;
+    freeList = block->next;
+    if (++stats.live > stats.peak)
+        stats.peak = stats.live;
+    return block;
+}
+
+void PoolAllocator::Free(void *block)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    FreeBlock *freeBlock = static_cast<FreeBlock *>(block);
+    freeBlock->next = freeList;
+    freeList = freeBlock;
+    --stats.live;
+}
+
+PoolStats PoolAllocator::GetStats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+PoolAllocator *Pools::GetPool(size_t size)
+{
+    // created on first use and never destroyed: objects may be deleted by static
+    // destructors, after this translation unit's statics would be gone
+    static PoolAllocator **pools = [] {
+        size_t count = POOL_MAX_BLOCK_SIZE / POOL_SIZE_CLASS;
+        PoolAllocator **pools = new PoolAllocator *[count];
+        for (size_t i = 0; i < count; ++i) {
+            size_t blockSize = (i + 1) * POOL_SIZE_CLASS;
+            size_t blocksPerSlab = POOL_SLAB_SIZE / blockSize;
+            pools[i] = new PoolAllocator(blockSize, blocksPerSlab > 0 ? blocksPerSlab : 1);
+        }
+        return pools;
+    }();
+
+    if (size == 0 || size > POOL_MAX_BLOCK_SIZE)
+        return nullptr;
+    return pools[(size - 1) / POOL_SIZE_CLASS];
+}
+
+void *Pools::Allocate(size_t size)
+{
+    PoolAllocator *pool = GetPool(size);
+    return pool != nullptr ? pool->Allocate() : ::operator new(size);
+}
+
+void Pools::Free(void *block, size_t size)
+{
+    if (block == nullptr)
+        return;
+    PoolAllocator *pool = GetPool(size);
+    if (pool != nullptr)
+        pool->Free(block);
+    else
+        ::operator delete(block);
+}
+
+std::vector<PoolStats> Pools::GetStats()
+{
+    std::vector<PoolStats> stats;
+    for (size_t size = POOL_SIZE_CLASS; size <= POOL_MAX_BLOCK_SIZE; size += POOL_SIZE_CLASS) {
+        PoolStats poolStats = GetPool(size)->GetStats();
+        if (poolStats.capacity > 0)
+            stats.push_back(poolStats);
+    }
+    return stats;
+}
+
+PoolStats Pools::GetTotalStats()
+{
+    // the total peak is the sum of the peaks, which may not have happened at once
+    PoolStats total;
+    for (auto &stats : GetStats()) {
+        total.live += stats.live;
+        total.peak += stats.peak;
+        total.capacity += stats.capacity;
+    }
+    return total;
+}
+
+void Pools::PrintStats()
+{
+    for (auto &stats : GetStats()) {
+        std::cout << "pool " << stats.blockSize << "B: " << stats.live << " live, "
+                  << stats.peak << " peak, " << stats.capacity << " capacity\n";
+    }
+}
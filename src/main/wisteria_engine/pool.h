@@ -0,0 +1,67 @@
+#pragma once
+#include <mutex>
+#include <vector>
+#include <cstddef>
+
+#define POOL_SIZE_CLASS 64  // block sizes are multiples of this
+#define POOL_MAX_BLOCK_SIZE 4096  // bigger allocations go to the general heap
+
+namespace engine
+{
+    struct PoolStats {
+        size_t blockSize = 0;
+        size_t live = 0;  // blocks currently allocated
+        size_t peak = 0;  // highest live count so far
+        size_t capacity = 0;  // blocks carved out of slabs, live or free
+    };
+
+    // Fixed-size block allocator: blocks are carved out of slabs and recycled through
+    // an intrusive free list, so both allocating and freeing are O(1), and objects of
+    // the same size class stay packed in the same few slabs. Slabs are never returned
+    // to the heap, a pool only grows up to its peak.
+    class PoolAllocator
+    {
+    public:
+        PoolAllocator(size_t blockSize, size_t blocksPerSlab);
+        ~PoolAllocator();
+        PoolAllocator(const PoolAllocator &) = delete;
+        PoolAllocator &operator=(const PoolAllocator &) = delete;
+
+        void *Allocate();
+        void Free(void *block);
+        PoolStats GetStats();
+
+    private:
+        struct FreeBlock {
+            FreeBlock *next;
+        };
+
+        void AddSlab();
+
+        // objects may be created from a Tick running on a worker thread
+        std::mutex mutex;
+        std::vector<char *> slabs;
+        FreeBlock *freeList = nullptr;
+        size_t blockSize;
+        size_t blocksPerSlab;
+        PoolStats stats;
+    };
+
+    // The size-class pools behind the class-level operator new/delete of GameObject
+    // and HitArea; derived classes of any size share them, rounded up to the next
+    // POOL_SIZE_CLASS bytes. The pools are shared by every scene.
+    class Pools
+    {
+    public:
+        static void *Allocate(size_t size);
+        static void Free(void *block, size_t size);
+
+        // stats of the size classes in use, and the totals over all of them
+        static std::vector<PoolStats> GetStats();
+        static PoolStats GetTotalStats();
+        static void PrintStats();
+
+    private:
+        static PoolAllocator *GetPool(size_t size);
+    };
+}
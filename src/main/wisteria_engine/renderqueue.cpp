@@ -0,0 +1,66 @@
+#include <algorithm>
+#include <cstring>
+#include "renderqueue.h"
+
+using namespace engine;
+
+#define KEY_BITS_12 0xFFFull
+#define KEY_BITS_24 0xFFFFFFull
+
+// folds a hash to the given number of bits, keeping some of the high bits
+static inline uint64_t Fold(uint64_t hash, uint64_t mask)
+{
+    return (hash ^ (hash >> 12) ^ (hash >> 24) ^ (hash >> 36)) & mask;
+}
+
+// positive floats compare the same way as their bit patterns, so the top 24 bits
+// below the sign bit are a monotonic quantization of the depth
+static inline uint64_t QuantizeDepth(float depth)
+{
+    depth = glm::max(depth, 0.0f);
+    uint32_t bits;
+    std::memcpy(&bits, &depth, sizeof(bits));
+    return (bits >> 7) & KEY_BITS_24;
+}
+
+uint64_t RenderQueue::MakeKey(unsigned int pass, bool transparent, GLuint program,
+                              size_t textureSet, const Mesh *mesh, float depth)
+{
+    uint64_t shaderBits = Fold(program, KEY_BITS_12);
+    uint64_t textureBits = Fold(textureSet, KEY_BITS_12);
+    uint64_t meshBits = Fold(reinterpret_cast<uintptr_t>(mesh) >> 4, KEY_BITS_12);
+    uint64_t depthBits = QuantizeDepth(depth);
+
+    uint64_t key = (uint64_t)(pass & 0x3) << 62;
+    if (!transparent) {
+        key |= shaderBits << 48 | textureBits << 36 | meshBits << 24 | depthBits;
+    } else {
+        key |= 1ull << 61;
+        key |= (KEY_BITS_24 - depthBits) << 36 | shaderBits << 24 | textureBits << 12 | meshBits;
+    }
+    return key;
+}
+
+void RenderQueue::Clear()
+{
+    // keeps the capacity, so a queue stops allocating once it has seen the largest frame
+    packets.clear();
+    order.clear();
+}
+
+void RenderQueue::Push(DrawPacket packet, unsigned int pass, float depth, size_t textureSet)
+{
+    GLuint program = packet.shader ? packet.shader->program : 0;
+    packet.key = MakeKey(pass, packet.blending, program, textureSet, packet.mesh, depth);
+    order.push_back({ packet.key, (uint32_t)packets.size() });
+    packets.push_back(packet);
+}
+
+void RenderQueue::Sort()
+{
+    // ties are broken by the collection order, which keeps the sort deterministic
+    // without the temporary buffer std::stable_sort would allocate
+    std::sort(order.begin(), order.end(), [](const SortItem &a, const SortItem &b) {
+        return a.key < b.key || (a.key == b.key && a.index < b.index);
+    });
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include "core/gpu/mesh.h"
+#include "core/gpu/shader.h"
+#include "utils/glm_utils.h"
+
+namespace engine
+{
+    class GameObject;
+    class Material;
+
+    // everything needed to issue a single draw call, gathered before anything is drawn
+    struct DrawPacket {
+        uint64_t key;
+        GameObject *gameObject;
+        Mesh *mesh;
+        Material *material;  // nullptr if the object is drawn with a default shader
+        Shader *shader;
+        glm::mat4 modelMatrix;
+        uint32_t layerMask;
+        bool blending;
+        uint8_t faceMask;  // cubemap faces the object is visible in, when rendering to a cubemap
+    };
+
+    // per camera (and per frame, for the scene) culling counters
+    struct RenderStats {
+        unsigned int visible = 0;  // objects submitted to the render queue
+        unsigned int culled = 0;  // objects rejected by frustum culling
+        unsigned int culledFaces = 0;  // cubemap faces skipped for otherwise visible objects
+
+        void Add(const RenderStats &other)
+        {
+            visible += other.visible;
+            culled += other.culled;
+            culledFaces += other.culledFaces;
+        }
+    };
+
+    // GL state already bound during the submission of a render queue, used
+    // to skip redundant program and texture binds between packets
+    struct RenderState {
+        const Shader *shader = nullptr;
+        GLuint textures[MAX_2D_TEXTURES] = { 0 };
+
+        void Reset() { *this = RenderState(); }
+    };
+
+    // A flat list of draw packets, sorted by a 64-bit key so that the packets sharing
+    // the same program, textures and mesh end up next to each other. Each camera owns
+    // one queue and refills it every time it renders.
+    //
+    // Key layout, from the most significant bit:
+    //   opaque:      pass (2) | 0 | shader (12) | texture set (12) | mesh (12) | depth (24) | 0
+    //   transparent: pass (2) | 1 | inverted depth (24) | shader (12) | texture set (12) | mesh (12)
+    // Opaque packets are drawn front to back (early-Z), transparent ones back to front.
+    // The shader, texture set and mesh fields are folded hashes: a collision only
+    // makes the grouping worse, it never changes what is drawn.
+    class RenderQueue
+    {
+    public:
+        RenderQueue() { packets.reserve(64); order.reserve(64); }
+
+        void Clear();
+        void Push(DrawPacket packet, unsigned int pass, float depth, size_t textureSet);
+        void Sort();
+
+        size_t Size() const { return order.size(); }
+        // i-th packet in sorted order
+        DrawPacket &operator[](size_t i) { return packets[order[i].index]; }
+
+        static uint64_t MakeKey(unsigned int pass, bool transparent, GLuint program,
+                                size_t textureSet, const Mesh *mesh, float depth);
+
+    private:
+        struct SortItem {
+            uint64_t key;
+            uint32_t index;
+        };
+
+        // packets stay in place, only the (key, index) pairs get sorted
+        std::vector<DrawPacket> packets;
+        std::vector<SortItem> order;
+    };
+}
@@ -0,0 +1,504 @@
+#include <algorithm>
+#include <limits>
+#include "rigidbody.h"
+#include "hitarea3d.h"
+#include "contactcache.h"
+#include "gameobject3d.h"
+
+using namespace engine;
+
+namespace
+{
+    void AddPoint(ContactManifold &manifold, glm::vec3 position, float penetration, uint32_t id)
+    {
+        ContactPoint &point = manifold.points[manifold.count++];
+        point = ContactPoint();
+        point.position = position;
+        point.penetration = penetration;
+        point.id = id;
+    }
+
+    bool SphereSphereManifold(SphereHitArea *first, SphereHitArea *second, ContactManifold &manifold)
+    {
+        glm::vec3 center = first->support->GetPosition(), otherCenter = second->support->GetPosition();
+        float radius = first->GetRadius(), otherRadius = second->GetRadius();
+        glm::vec3 offset = otherCenter - center;
+        float distance = glm::length(offset);
+        float penetration = radius + otherRadius - distance;
+        if (penetration < 0)
+            return false;
+        manifold.normal = distance > 1e-6f ? offset / distance : glm::vec3(0, 1, 0);
+        AddPoint(manifold, center + manifold.normal * (radius - penetration / 2), penetration, 0);
+        return true;
+    }
+
+    bool BoxSphereManifold(BoxHitArea *box, SphereHitArea *sphere, ContactManifold &manifold)
+    {
+        glm::vec3 boxCenter = box->support->GetPosition(), halfSize = box->GetHalfSize();
+        glm::vec3 center = sphere->support->GetPosition();
+        float radius = sphere->GetRadius();
+        glm::vec3 closestPoint = glm::clamp(center, boxCenter - halfSize, boxCenter + halfSize);
+        glm::vec3 offset = center - closestPoint;
+        float distance = glm::length(offset);
+        if (distance > radius)
+            return false;
+
+        if (distance > 1e-6f) {
+            manifold.normal = offset / distance;
+            float penetration = radius - distance;
+            AddPoint(manifold, closestPoint - manifold.normal * (penetration / 2), penetration, 0);
+            return true;
+        }
+        // the center is inside the box: out through the closest face
+        glm::vec3 local = center - boxCenter;
+        glm::vec3 faceDistances = halfSize - glm::abs(local);
+        int axis = faceDistances.x < faceDistances.y ? (faceDistances.x < faceDistances.z ? 0 : 2)
+                                                     : (faceDistances.y < faceDistances.z ? 1 : 2);
+        manifold.normal = glm::vec3(0);
+        manifold.normal[axis] = local[axis] < 0 ? -1.0f : 1.0f;
+        AddPoint(manifold, center, radius + faceDistances[axis], 0);
+        return true;
+    }
+
+    bool BoxBoxManifold(BoxHitArea *first, BoxHitArea *second, ContactManifold &manifold)
+    {
+        glm::vec3 center = first->support->GetPosition(), otherCenter = second->support->GetPosition();
+        glm::vec3 halfSize = first->GetHalfSize(), otherHalfSize = second->GetHalfSize();
+        glm::vec3 offset = otherCenter - center;
+        glm::vec3 overlap = halfSize + otherHalfSize - glm::abs(offset);
+        if (overlap.x < 0 || overlap.y < 0 || overlap.z < 0)
+            return false;
+
+        // the boxes don't rotate: the normal is the axis of least overlap, and the points
+        // are the corners of the overlap of the two faces, on the plane between them
+        int axis = overlap.x < overlap.y ? (overlap.x < overlap.z ? 0 : 2) : (overlap.y < overlap.z ? 1 : 2);
+        float sign = offset[axis] < 0 ? -1.0f : 1.0f;
+        manifold.normal = glm::vec3(0);
+        manifold.normal[axis] = sign;
+        glm::vec3 low = glm::max(center - halfSize, otherCenter - otherHalfSize);
+        glm::vec3 high = glm::min(center + halfSize, otherCenter + otherHalfSize);
+        float plane = (center[axis] + sign * halfSize[axis] + otherCenter[axis] - sign * otherHalfSize[axis]) / 2;
+        int u = (axis + 1) % 3, v = (axis + 2) % 3;
+        for (uint32_t corner = 0; corner < 4; ++corner) {
+            glm::vec3 position;
+            position[axis] = plane;
+            position[u] = (corner & 1) ? high[u] : low[u];
+            position[v] = (corner & 2) ? high[v] : low[v];
+            AddPoint(manifold, position, overlap[axis], axis * 4 + corner);
+        }
+        return true;
+    }
+
+    bool HeightfieldSphereManifold(HeightfieldHitArea *heightfield, SphereHitArea *sphere, ContactManifold &manifold)
+    {
+        glm::vec3 center = sphere->support->GetPosition();
+        float radius = sphere->GetRadius();
+        glm::vec3 closestPoint;
+        float distance;
+        if (!heightfield->ClosestPoint(center, radius, closestPoint, distance))
+            return false;
+
+        // out of the surface, towards the sphere; the distance is negative in the solid
+        if (glm::abs(distance) > 1e-6f)
+            manifold.normal = (distance > 0 ? center - closestPoint : closestPoint - center) / glm::abs(distance);
+        else
+            manifold.normal = glm::vec3(0, 1, 0);
+        float penetration = radius - distance;
+        AddPoint(manifold, closestPoint - manifold.normal * (penetration / 2), penetration, 0);
+        return true;
+    }
+
+    bool HeightfieldBoxManifold(HeightfieldHitArea *heightfield, BoxHitArea *box, ContactManifold &manifold)
+    {
+        if (heightfield->shape.field == nullptr)
+            return false;
+        const Heightfield *field = heightfield->shape.field;
+        glm::vec3 corner = heightfield->GetCorner(), spacing = heightfield->GetSpacing();
+        AABB bounds = box->GetBounds();
+
+        // terrain is mostly flat at the scale of a box: the bottom corners under the
+        // surface are pushed straight up
+        manifold.normal = glm::vec3(0, 1, 0);
+        for (uint32_t k = 0; k < 4; ++k) {
+            glm::vec3 position = glm::vec3((k & 1) ? bounds.max.x : bounds.min.x, bounds.min.y,
+                                           (k & 2) ? bounds.max.z : bounds.min.z);
+            float height;
+            glm::vec3 local = position - corner;
+            if (field->GetHeight(local.x, local.z, spacing, height) && local.y < height) {
+                float penetration = height - local.y;
+                AddPoint(manifold, position + glm::vec3(0, penetration / 2, 0), penetration, k);
+            }
+        }
+        if (manifold.count > 0)
+            return true;
+
+        // a bump poking into the bottom face, between the corners
+        float height;
+        if (!field->GetMaxHeight(glm::vec2(bounds.min.x - corner.x, bounds.min.z - corner.z),
+                                 glm::vec2(bounds.max.x - corner.x, bounds.max.z - corner.z), spacing, height) ||
+            bounds.min.y - corner.y >= height)
+            return false;
+        float penetration = height - (bounds.min.y - corner.y);
+        glm::vec3 center = bounds.Center();
+        AddPoint(manifold, glm::vec3(center.x, bounds.min.y + penetration / 2, center.z), penetration, 4);
+        return true;
+    }
+
+    // the arms of the impulses are crossed with them, see PhysicsWorld::Constraint
+    glm::vec3 VelocityAt(const std::vector<glm::vec3> &linear, const std::vector<glm::vec3> &angular,
+                         int body, glm::vec3 arm, glm::vec3 staticVelocity)
+    {
+        if (body < 0)
+            return staticVelocity;
+        return linear[body] + glm::cross(angular[body], arm);
+    }
+}
+
+bool engine::BuildManifold(HitArea *first, HitArea *second, ContactManifold &manifold)
+{
+    manifold.count = 0;
+    if (first->support == nullptr || second->support == nullptr)
+        return false;
+
+    const int box = HitArea::TypeId<BoxHitArea>(), sphere = HitArea::TypeId<SphereHitArea>();
+    const int heightfield = HitArea::TypeId<HeightfieldHitArea>();
+    int firstType = first->GetTypeId(), secondType = second->GetTypeId();
+    // the other orders are built reversed
+    bool reversed = (firstType == sphere && (secondType == box || secondType == heightfield)) ||
+                    (firstType == box && secondType == heightfield);
+    if (reversed) {
+        std::swap(first, second);
+        std::swap(firstType, secondType);
+    }
+
+    bool touching = false;
+    if (firstType == sphere && secondType == sphere)
+        touching = SphereSphereManifold(static_cast<SphereHitArea *>(first), static_cast<SphereHitArea *>(second), manifold);
+    else if (firstType == box && secondType == sphere)
+        touching = BoxSphereManifold(static_cast<BoxHitArea *>(first), static_cast<SphereHitArea *>(second), manifold);
+    else if (firstType == box && secondType == box)
+        touching = BoxBoxManifold(static_cast<BoxHitArea *>(first), static_cast<BoxHitArea *>(second), manifold);
+    else if (firstType == heightfield && secondType == sphere)
+        touching = HeightfieldSphereManifold(static_cast<HeightfieldHitArea *>(first),
+                                             static_cast<SphereHitArea *>(second), manifold);
+    else if (firstType == heightfield && secondType == box)
+        touching = HeightfieldBoxManifold(static_cast<HeightfieldHitArea *>(first),
+                                          static_cast<BoxHitArea *>(second), manifold);
+
+    if (!touching) {
+        manifold.count = 0;
+        return false;
+    }
+    if (reversed)
+        manifold.normal = -manifold.normal;
+    return true;
+}
+
+void RigidBody::Wake()
+{
+    sleeping = false;
+    sleepTime = 0;
+}
+
+void RigidBody::ApplyImpulse(glm::vec3 impulse)
+{
+    if (mass <= 0)
+        return;
+    gameObject->SetVelocity(gameObject->GetVelocity() + impulse / mass);
+    Wake();
+}
+
+void PhysicsWorld::Add(RigidBody *body)
+{
+    if (body->index >= 0)
+        return;
+    body->index = (int)bodies.size();
+    bodies.push_back(body);
+}
+
+void PhysicsWorld::Remove(RigidBody *body)
+{
+    if (body->index < 0)
+        return;
+    // the last body takes its place
+    bodies[body->index] = bodies.back();
+    bodies[body->index]->index = body->index;
+    bodies.pop_back();
+    body->index = -1;
+}
+
+void PhysicsWorld::OnSeparated(GameObject *gameObject)
+{
+    if (gameObject->rigidBody != nullptr)
+        gameObject->rigidBody->Wake();
+}
+
+int PhysicsWorld::DynamicIndex(GameObject *gameObject)
+{
+    RigidBody *body = gameObject->rigidBody;
+    return body != nullptr && body->index >= 0 && body->mass > 0 ? body->index : -1;
+}
+
+int PhysicsWorld::Find(int body)
+{
+    while (islands[body] != body) {
+        islands[body] = islands[islands[body]];  // path halving
+        body = islands[body];
+    }
+    return body;
+}
+
+void PhysicsWorld::Unite(int first, int second)
+{
+    first = Find(first);
+    second = Find(second);
+    if (first != second)
+        islands[std::max(first, second)] = std::min(first, second);
+}
+
+void PhysicsWorld::Step(const std::vector<Contact *> &contacts, float deltaTime)
+{
+    if (deltaTime <= 0 || bodies.empty())
+        return;
+
+    size_t count = bodies.size();
+    linearVelocities.resize(count);
+    angularVelocities.resize(count);
+    inverseMasses.resize(count);
+    inverseInertias.resize(count);
+    islands.resize(count);
+    islandAwake.assign(count, 0);
+    islandSleepTimes.assign(count, std::numeric_limits<float>::infinity());
+    for (size_t i = 0; i < count; ++i) {
+        RigidBody *body = bodies[i];
+        GameObject *gameObject = body->gameObject;
+        islands[i] = (int)i;
+        linearVelocities[i] = gameObject->VelocityRef();
+        angularVelocities[i] = gameObject->AngularVelocityRef();
+        // something else set a velocity: it's moving again
+        if (body->sleeping && (linearVelocities[i] != glm::vec3(0) || angularVelocities[i] != glm::vec3(0)))
+            body->Wake();
+
+        inverseMasses[i] = body->mass > 0 ? 1.0f / body->mass : 0;
+        inverseInertias[i] = 0;
+        HitArea *hitArea = gameObject->hitArea;
+        if (body->mass > 0 && hitArea != nullptr && hitArea->support != nullptr &&
+            hitArea->GetTypeId() == HitArea::TypeId<SphereHitArea>()) {
+            float radius = static_cast<SphereHitArea *>(hitArea)->GetRadius();
+            if (radius > 0)
+                inverseInertias[i] = 1.0f / (0.4f * body->mass * radius * radius);
+        }
+    }
+
+    // islands: bodies touching each other, and the moving objects that wake them
+    for (auto contact : contacts) {
+        int first = DynamicIndex(contact->first), second = DynamicIndex(contact->second);
+        if (first >= 0 && second >= 0)
+            Unite(first, second);
+        else if (first >= 0 && contact->second->GetVelocity() != glm::vec3(0))
+            bodies[first]->Wake();
+        else if (second >= 0 && contact->first->GetVelocity() != glm::vec3(0))
+            bodies[second]->Wake();
+    }
+    for (size_t i = 0; i < count; ++i) {
+        if (bodies[i]->mass > 0 && !bodies[i]->sleeping)
+            islandAwake[Find((int)i)] = 1;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        RigidBody *body = bodies[i];
+        if (body->mass <= 0)
+            continue;
+        if (body->sleeping && islandAwake[Find((int)i)])
+            body->Wake();
+        if (body->sleeping)
+            continue;
+        linearVelocities[i] += gravity * deltaTime;
+        linearVelocities[i] *= 1.0f / (1.0f + deltaTime * body->linearDamping);
+        angularVelocities[i] *= 1.0f / (1.0f + deltaTime * body->angularDamping);
+    }
+
+    // contacts of sleeping islands keep their manifold, for when they wake up
+    constraints.clear();
+    for (auto contact : contacts) {
+        int first = DynamicIndex(contact->first), second = DynamicIndex(contact->second);
+        bool firstAwake = first >= 0 && !bodies[first]->sleeping;
+        bool secondAwake = second >= 0 && !bodies[second]->sleeping;
+        if (firstAwake || secondAwake)
+            PrepareConstraints(*contact, deltaTime);
+    }
+    WarmStart();
+    for (int iteration = 0; iteration < SOLVER_ITERATIONS; ++iteration)
+        Solve();
+
+    for (size_t i = 0; i < count; ++i) {
+        RigidBody *body = bodies[i];
+        if (body->mass <= 0 || body->sleeping)
+            continue;
+        GameObject *gameObject = body->gameObject;
+        gameObject->VelocityRef() = linearVelocities[i];
+        gameObject->AngularVelocityRef() = angularVelocities[i];
+        gameObject->QueueMotion();
+    }
+    UpdateSleep(deltaTime);
+}
+
+void PhysicsWorld::PrepareConstraints(Contact &contact, float deltaTime)
+{
+    // the new points take the impulses of last step's points made by the same features
+    ContactManifold previous = contact.manifold;
+    ContactManifold &manifold = contact.manifold;
+    if (!BuildManifold(contact.first->hitArea, contact.second->hitArea, manifold))
+        return;
+    for (int i = 0; i < manifold.count; ++i) {
+        for (int j = 0; j < previous.count; ++j) {
+            if (previous.points[j].id == manifold.points[i].id) {
+                manifold.points[i].normalImpulse = previous.points[j].normalImpulse;
+                manifold.points[i].tangentImpulse[0] = previous.points[j].tangentImpulse[0];
+                manifold.points[i].tangentImpulse[1] = previous.points[j].tangentImpulse[1];
+                break;
+            }
+        }
+    }
+
+    int first = DynamicIndex(contact.first), second = DynamicIndex(contact.second);
+    RigidBody *firstBody = contact.first->rigidBody, *secondBody = contact.second->rigidBody;
+    float friction = glm::sqrt((firstBody ? firstBody->friction : RIGIDBODY_DEFAULT_FRICTION) *
+                               (secondBody ? secondBody->friction : RIGIDBODY_DEFAULT_FRICTION));
+    float restitution = glm::max(firstBody ? firstBody->restitution : 0.0f,
+                                 secondBody ? secondBody->restitution : 0.0f);
+    glm::vec3 staticVelocity = first < 0 ? contact.first->GetVelocity() :
+                               second < 0 ? contact.second->GetVelocity() : glm::vec3(0);
+    glm::vec3 firstCenter = contact.first->GetPosition(), secondCenter = contact.second->GetPosition();
+
+    glm::vec3 normal = manifold.normal;
+    glm::vec3 tangent = glm::normalize(glm::cross(normal, glm::abs(normal.x) < 0.9f ? glm::vec3(1, 0, 0)
+                                                                                     : glm::vec3(0, 1, 0)));
+    float firstInverseMass = first >= 0 ? inverseMasses[first] : 0;
+    float secondInverseMass = second >= 0 ? inverseMasses[second] : 0;
+    float firstInverseInertia = first >= 0 ? inverseInertias[first] : 0;
+    float secondInverseInertia = second >= 0 ? inverseInertias[second] : 0;
+    for (int i = 0; i < manifold.count; ++i) {
+        ContactPoint &point = manifold.points[i];
+        Constraint constraint;
+        constraint.first = first;
+        constraint.second = second;
+        constraint.point = &point;
+        constraint.normal = normal;
+        constraint.tangents[0] = tangent;
+        constraint.tangents[1] = glm::cross(normal, tangent);
+        constraint.firstArm = point.position - firstCenter;
+        constraint.secondArm = point.position - secondCenter;
+        constraint.friction = friction;
+        constraint.staticVelocity = staticVelocity;
+
+        // spheres are the only ones with inertia, and it is the same on every axis
+        auto effectiveMass = [&](glm::vec3 direction) {
+            glm::vec3 firstTorque = glm::cross(constraint.firstArm, direction);
+            glm::vec3 secondTorque = glm::cross(constraint.secondArm, direction);
+            float mass = firstInverseMass + secondInverseMass +
+                         firstInverseInertia * glm::dot(firstTorque, firstTorque) +
+                         secondInverseInertia * glm::dot(secondTorque, secondTorque);
+            return mass > 0 ? 1.0f / mass : 0.0f;
+        };
+        constraint.normalMass = effectiveMass(normal);
+        constraint.tangentMass[0] = effectiveMass(constraint.tangents[0]);
+        constraint.tangentMass[1] = effectiveMass(constraint.tangents[1]);
+
+        // bounce off fast impacts, otherwise push out of the penetration a bit every step
+        glm::vec3 relativeVelocity =
+            VelocityAt(linearVelocities, angularVelocities, second, constraint.secondArm, staticVelocity) -
+            VelocityAt(linearVelocities, angularVelocities, first, constraint.firstArm, staticVelocity);
+        float normalVelocity = glm::dot(relativeVelocity, normal);
+        float bias = -SOLVER_BAUMGARTE / deltaTime * glm::max(point.penetration - SOLVER_SLOP, 0.0f);
+        if (normalVelocity < -SOLVER_RESTITUTION_THRESHOLD)
+            bias = glm::min(bias, restitution * normalVelocity);
+        constraint.bias = bias;
+        constraints.push_back(constraint);
+    }
+}
+
+void PhysicsWorld::WarmStart()
+{
+    for (auto &constraint : constraints) {
+        const ContactPoint &point = *constraint.point;
+        glm::vec3 impulse = constraint.normal * point.normalImpulse +
+                            constraint.tangents[0] * point.tangentImpulse[0] +
+                            constraint.tangents[1] * point.tangentImpulse[1];
+        if (constraint.first >= 0) {
+            linearVelocities[constraint.first] -= inverseMasses[constraint.first] * impulse;
+            angularVelocities[constraint.first] -= inverseInertias[constraint.first] * glm::cross(constraint.firstArm, impulse);
+        }
+        if (constraint.second >= 0) {
+            linearVelocities[constraint.second] += inverseMasses[constraint.second] * impulse;
+            angularVelocities[constraint.second] += inverseInertias[constraint.second] * glm::cross(constraint.secondArm, impulse);
+        }
+    }
+}
+
+void PhysicsWorld::Solve()
+{
+    for (auto &constraint : constraints) {
+        ContactPoint &point = *constraint.point;
+        int first = constraint.first, second = constraint.second;
+        auto apply = [&](glm::vec3 impulse) {
+            if (first >= 0) {
+                linearVelocities[first] -= inverseMasses[first] * impulse;
+                angularVelocities[first] -= inverseInertias[first] * glm::cross(constraint.firstArm, impulse);
+            }
+            if (second >= 0) {
+                linearVelocities[second] += inverseMasses[second] * impulse;
+                angularVelocities[second] += inverseInertias[second] * glm::cross(constraint.secondArm, impulse);
+            }
+        };
+        auto relativeVelocity = [&]() {
+            return VelocityAt(linearVelocities, angularVelocities, second, constraint.secondArm, constraint.staticVelocity) -
+                   VelocityAt(linearVelocities, angularVelocities, first, constraint.firstArm, constraint.staticVelocity);
+        };
+
+        // friction first, bounded by the normal impulse of the last iteration
+        float maxFriction = constraint.friction * point.normalImpulse;
+        for (int k = 0; k < 2; ++k) {
+            float lambda = -glm::dot(relativeVelocity(), constraint.tangents[k]) * constraint.tangentMass[k];
+            float accumulated = glm::clamp(point.tangentImpulse[k] + lambda, -maxFriction, maxFriction);
+            lambda = accumulated - point.tangentImpulse[k];
+            point.tangentImpulse[k] = accumulated;
+            apply(constraint.tangents[k] * lambda);
+        }
+
+        // then the normal impulse, which can only push
+        float normalVelocity = glm::dot(relativeVelocity(), constraint.normal);
+        float lambda = -(normalVelocity + constraint.bias) * constraint.normalMass;
+        float accumulated = glm::max(point.normalImpulse + lambda, 0.0f);
+        lambda = accumulated - point.normalImpulse;
+        point.normalImpulse = accumulated;
+        apply(constraint.normal * lambda);
+    }
+}
+
+void PhysicsWorld::UpdateSleep(float deltaTime)
+{
+    // a body is slow if it barely moves; an island sleeps once all its bodies were slow
+    // for long enough
+    size_t count = bodies.size();
+    for (size_t i = 0; i < count; ++i) {
+        RigidBody *body = bodies[i];
+        if (body->mass <= 0 || body->sleeping)
+            continue;
+        bool slow = glm::dot(linearVelocities[i], linearVelocities[i]) <
+                        RIGIDBODY_SLEEP_LINEAR_SPEED * RIGIDBODY_SLEEP_LINEAR_SPEED &&
+                    glm::dot(angularVelocities[i], angularVelocities[i]) <
+                        RIGIDBODY_SLEEP_ANGULAR_SPEED * RIGIDBODY_SLEEP_ANGULAR_SPEED;
+        body->sleepTime = slow ? body->sleepTime + deltaTime : 0;
+        float &islandSleepTime = islandSleepTimes[Find((int)i)];
+        islandSleepTime = glm::min(islandSleepTime, body->sleepTime);
+    }
+    for (size_t i = 0; i < count; ++i) {
+        RigidBody *body = bodies[i];
+        if (body->mass <= 0 || body->sleeping || islandSleepTimes[Find((int)i)] < RIGIDBODY_TIME_TO_SLEEP)
+            continue;
+        // without velocity, the integrator lets go of it
+        body->sleeping = true;
+        body->gameObject->VelocityRef() = glm::vec3(0);
+        body->gameObject->AngularVelocityRef() = glm::vec3(0);
+    }
+}
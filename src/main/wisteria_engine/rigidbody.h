@@ -0,0 +1,129 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include "utils/glm_utils.h"
+#include "pool.h"
+
+#define MANIFOLD_MAX_POINTS 4
+#define SOLVER_ITERATIONS 10
+#define SOLVER_BAUMGARTE 0.2f  // fraction of the penetration resolved per step
+#define SOLVER_SLOP 0.01f  // penetration left alone, so that resting contacts don't jitter
+#define SOLVER_RESTITUTION_THRESHOLD 1.0f  // slower impacts don't bounce
+#define RIGIDBODY_DEFAULT_FRICTION 0.5f  // for objects without a rigid body
+#define RIGIDBODY_SLEEP_LINEAR_SPEED 0.05f
+#define RIGIDBODY_SLEEP_ANGULAR_SPEED 0.05f
+#define RIGIDBODY_TIME_TO_SLEEP 0.5f  // seconds an island must stay slow to fall asleep
+
+namespace engine
+{
+    class GameObject;
+    struct HitArea;
+    struct Contact;
+
+    struct ContactPoint {
+        glm::vec3 position = glm::vec3(0);  // world space, halfway between the surfaces
+        float penetration = 0;
+        uint32_t id = 0;  // the features that made it, to match it with last step's points
+        // accumulated impulses, kept from one step to the next for warm starting
+        float normalImpulse = 0;
+        float tangentImpulse[2] = { 0, 0 };
+    };
+
+    // the touching points of two hit areas, with a normal going from the first to the second
+    struct ContactManifold {
+        glm::vec3 normal = glm::vec3(0, 1, 0);
+        ContactPoint points[MANIFOLD_MAX_POINTS];
+        int count = 0;
+    };
+
+    // the manifold of two touching sphere, box or heightfield hit areas, from the same shapes
+    // the narrowphase sees; false for other shapes
+    bool BuildManifold(HitArea *first, HitArea *second, ContactManifold &manifold);
+
+    // Mass and material of a GameObject, moved by the scene's PhysicsWorld through the
+    // object's velocity and angular velocity (see GameObject::SetVelocity), which must be
+    // in world space: rigid bodies are root objects. The shape is the object's hit area.
+    // Box hit areas don't rotate, so boxes get no angular response; spheres roll.
+    class RigidBody
+    {
+        friend class PhysicsWorld;
+    public:
+        RigidBody(GameObject *gameObject, float mass) : mass(mass), gameObject(gameObject) {}
+
+        static void *operator new(size_t size) { return Pools::Allocate(size); }
+        static void operator delete(void *block, size_t size) { Pools::Free(block, size); }
+
+        GameObject *GetGameObject() const { return gameObject; }
+        // a body at rest with the rest of its island is skipped until something wakes it
+        bool IsSleeping() const { return sleeping; }
+        void Wake();
+        // changes the velocity at once, waking the body
+        void ApplyImpulse(glm::vec3 impulse);
+
+        // 0 for bodies that are only moved by their velocity, like objects without a body
+        float mass;
+        float friction = RIGIDBODY_DEFAULT_FRICTION;
+        float restitution = 0;
+        float linearDamping = 0.01f;  // fraction of the velocity lost per second
+        float angularDamping = 0.05f;
+
+    private:
+        GameObject *gameObject;
+        int index = -1;  // in the world's bodies
+        bool sleeping = false;
+        float sleepTime = 0;  // how long it has been slow
+    };
+
+    // Impulse based dynamics for the scene's rigid bodies: after the collision step, the
+    // touching contacts that involve a body get a manifold, kept in the contact from one
+    // step to the next to warm start the sequential impulse solver. Bodies touching each
+    // other form islands, which fall asleep together once they all stay slow for long
+    // enough; a sleeping island has no velocity, so it costs neither the solver nor the
+    // integrator, and its contacts aren't tested again as long as nothing moves.
+    class PhysicsWorld
+    {
+    public:
+        void Add(RigidBody *body);
+        void Remove(RigidBody *body);
+        size_t Size() const { return bodies.size(); }
+
+        // contacts are touching ones, with at least one rigid body
+        void Step(const std::vector<Contact *> &contacts, float deltaTime);
+        // wakes the object's body, if it has one, when something it touched went away
+        void OnSeparated(GameObject *gameObject);
+
+        glm::vec3 gravity = glm::vec3(0, -9.81f, 0);
+
+    private:
+        // a contact point, as the solver sees it; bodies are indices in bodies, or -1
+        // for the objects without a dynamic body, which keep their velocity
+        struct Constraint {
+            int first, second;
+            ContactPoint *point;
+            glm::vec3 normal, tangents[2];
+            glm::vec3 firstArm, secondArm;  // from the centers of mass to the point
+            float normalMass, tangentMass[2];
+            float bias;
+            float friction;
+            glm::vec3 staticVelocity;  // of the side without a dynamic body, if any
+        };
+
+        int Find(int body);
+        void Unite(int first, int second);
+        void PrepareConstraints(Contact &contact, float deltaTime);
+        void WarmStart();
+        void Solve();
+        void UpdateSleep(float deltaTime);
+        // index of the object's body in bodies if it is dynamic, -1 otherwise
+        int DynamicIndex(GameObject *gameObject);
+
+        std::vector<RigidBody *> bodies;
+        // per body, for the current step
+        std::vector<glm::vec3> linearVelocities, angularVelocities;
+        std::vector<float> inverseMasses, inverseInertias;
+        std::vector<int> islands;  // union-find parents
+        std::vector<uint8_t> islandAwake;
+        std::vector<float> islandSleepTimes;
+        std::vector<Constraint> constraints;
+    };
+}
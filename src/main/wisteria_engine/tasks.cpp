@@ -0,0 +1,301 @@
+#include <algorithm>
+#include "tasks.h"
+#include "gameobject3d.h"
+
+using namespace engine;
+
+namespace
+{
+    // std heaps are max-heaps; ties go to the lower task index, so the order is stable
+    struct LaterWait {
+        template <typename Wait>
+        bool operator()(const Wait &a, const Wait &b) const
+        {
+            return a.time != b.time ? a.time > b.time : a.task > b.task;
+        }
+    };
+}
+
+Task &Task::Do(std::function<void()> action)
+{
+    Step step;
+    step.type = TASK_ACTION;
+    step.action = std::move(action);
+    steps.push_back(std::move(step));
+    return *this;
+}
+
+Task &Task::WaitSeconds(float seconds)
+{
+    Step step;
+    step.type = TASK_SECONDS;
+    step.seconds = seconds;
+    steps.push_back(std::move(step));
+    return *this;
+}
+
+Task &Task::WaitFrames(int frames)
+{
+    Step step;
+    step.type = TASK_FRAMES;
+    step.frames = frames;
+    steps.push_back(std::move(step));
+    return *this;
+}
+
+Task &Task::WaitUntil(std::function<bool()> condition)
+{
+    Step step;
+    step.type = TASK_CONDITION;
+    step.condition = std::move(condition);
+    steps.push_back(std::move(step));
+    return *this;
+}
+
+Task &Task::WaitForCollision(std::function<void(GameObject *)> onCollision)
+{
+    Step step;
+    step.type = TASK_COLLISION;
+    step.onCollision = std::move(onCollision);
+    steps.push_back(std::move(step));
+    return *this;
+}
+
+Task &Task::Loop()
+{
+    loop = true;
+    return *this;
+}
+
+TaskHandle TaskScheduler::Start(Task &&task, const ObjectRegistry &objects)
+{
+    uint32_t index = freeTasks;
+    if (index != TASK_NULL_INDEX) {
+        freeTasks = tasks[index].nextFree;
+    } else {
+        index = (uint32_t)tasks.size();
+        tasks.emplace_back();
+    }
+
+    TaskState &state = tasks[index];
+    state.task = std::move(task);
+    state.next = 0;
+    state.owner = state.task.owner->GetHandle();
+    state.used = true;
+    state.stopped = false;
+    ++running;
+
+    // like a coroutine, it runs until its first wait
+    TaskHandle handle = { index, state.generation };
+    Run(index, objects);
+    return handle;
+}
+
+bool TaskScheduler::IsCurrent(uint32_t index, uint32_t generation) const
+{
+    return index < tasks.size() && tasks[index].used && tasks[index].generation == generation;
+}
+
+bool TaskScheduler::IsRunning(TaskHandle handle) const
+{
+    return IsCurrent(handle.index, handle.generation) && !tasks[handle.index].stopped;
+}
+
+void TaskScheduler::Stop(TaskHandle handle)
+{
+    if (!IsCurrent(handle.index, handle.generation))
+        return;
+    // a task stopping itself is freed once its action returns
+    if (tasks[handle.index].active)
+        tasks[handle.index].stopped = true;
+    else
+        Free(handle.index);
+}
+
+void TaskScheduler::Remove(GameObject *gameObject)
+{
+    while (gameObject->taskWaiters != TASK_NULL_INDEX)
+        Free(gameObject->taskWaiters);
+}
+
+void TaskScheduler::Free(uint32_t index)
+{
+    TaskState &state = tasks[index];
+    Unlink(index);
+    state.task = Task(nullptr);
+    ++state.generation;  // its waits are stale now
+    state.used = false;
+    state.active = false;
+    state.nextFree = freeTasks;
+    freeTasks = index;
+    --running;
+}
+
+void TaskScheduler::Unlink(uint32_t index)
+{
+    TaskState &state = tasks[index];
+    if (state.waitingOn == nullptr)
+        return;
+    if (state.previousWaiter != TASK_NULL_INDEX)
+        tasks[state.previousWaiter].nextWaiter = state.nextWaiter;
+    else
+        state.waitingOn->taskWaiters = state.nextWaiter;
+    if (state.nextWaiter != TASK_NULL_INDEX)
+        tasks[state.nextWaiter].previousWaiter = state.previousWaiter;
+    state.waitingOn = nullptr;
+    state.previousWaiter = TASK_NULL_INDEX;
+    state.nextWaiter = TASK_NULL_INDEX;
+}
+
+void TaskScheduler::Push(std::vector<Wait> &heap, double time, uint32_t index)
+{
+    heap.push_back({ time, index, tasks[index].generation });
+    std::push_heap(heap.begin(), heap.end(), LaterWait());
+}
+
+void TaskScheduler::PopDue(std::vector<Wait> &heap, double time, std::vector<Wait> &due)
+{
+    while (!heap.empty() && heap.front().time <= time + UPDATE_TIME_EPSILON) {
+        std::pop_heap(heap.begin(), heap.end(), LaterWait());
+        due.push_back(heap.back());
+        heap.pop_back();
+    }
+}
+
+void TaskScheduler::Run(uint32_t index, const ObjectRegistry &objects)
+{
+    TaskState &state = tasks[index];
+    GameObject *owner = objects.Get(state.owner);
+    if (owner == nullptr) {
+        Free(index);
+        return;
+    }
+
+    int clock = owner->useUnscaledTime ? 1 : 0;
+    state.active = true;
+    while (!state.stopped) {
+        if (state.next >= state.task.steps.size()) {
+            if (!state.task.loop)
+                break;
+            // a loop goes on at the next step, so one without waits can't spin forever
+            state.next = 0;
+            state.active = false;
+            Push(timers[clock], clocks[clock], index);
+            return;
+        }
+
+        Task::Step &step = state.task.steps[state.next++];
+        switch (step.type) {
+        case Task::TASK_ACTION:
+            step.action();
+            continue;
+        case Task::TASK_CONDITION:
+            if (step.condition())
+                continue;
+            conditions.push_back({ 0, index, state.generation });
+            break;
+        case Task::TASK_SECONDS:
+            Push(timers[clock], clocks[clock] + step.seconds, index);
+            break;
+        case Task::TASK_FRAMES:
+            Push(frameWaits, (double)(frame + std::max(step.frames, 1)), index);
+            break;
+        case Task::TASK_COLLISION:
+            state.waitingOn = owner;
+            state.nextWaiter = owner->taskWaiters;
+            if (owner->taskWaiters != TASK_NULL_INDEX)
+                tasks[owner->taskWaiters].previousWaiter = index;
+            owner->taskWaiters = index;
+            break;
+        }
+        state.active = false;
+        return;
+    }
+    Free(index);
+}
+
+void TaskScheduler::Step(const ObjectRegistry &objects, double scaledTime, double unscaledTime)
+{
+    clocks[0] = scaledTime;
+    clocks[1] = unscaledTime;
+    // the conditions registered from here on were just checked
+    polled.clear();
+    polled.swap(conditions);
+
+    // the due timers are taken out first, as running them pushes new ones
+    due.clear();
+    PopDue(timers[0], clocks[0], due);
+    PopDue(timers[1], clocks[1], due);
+    for (auto &wait : due) {
+        if (IsCurrent(wait.task, wait.generation))
+            Run(wait.task, objects);
+    }
+
+    // then the conditions that became true
+    for (auto &wait : polled) {
+        if (!IsCurrent(wait.task, wait.generation))
+            continue;
+        TaskState &state = tasks[wait.task];
+        if (objects.Get(state.owner) == nullptr) {
+            Free(wait.task);
+            continue;
+        }
+        // the condition may stop its own task
+        state.active = true;
+        bool done = state.task.steps[state.next - 1].condition();
+        state.active = false;
+        if (state.stopped)
+            Free(wait.task);
+        else if (done)
+            Run(wait.task, objects);
+        else
+            conditions.push_back(wait);
+    }
+}
+
+void TaskScheduler::Frame(const ObjectRegistry &objects)
+{
+    ++frame;
+    due.clear();
+    PopDue(frameWaits, (double)frame, due);
+    for (auto &wait : due) {
+        if (IsCurrent(wait.task, wait.generation))
+            Run(wait.task, objects);
+    }
+}
+
+void TaskScheduler::OnCollisionEnter(GameObject *gameObject, GameObject *other)
+{
+    // every wait of the object is over; they are resumed in the order they started
+    uint32_t index = gameObject->taskWaiters;
+    size_t first = collisions.size();
+    while (index != TASK_NULL_INDEX) {
+        uint32_t next = tasks[index].nextWaiter;
+        collisions.push_back({ index, tasks[index].generation, other->GetHandle() });
+        Unlink(index);
+        index = next;
+    }
+    std::reverse(collisions.begin() + first, collisions.end());
+}
+
+void TaskScheduler::ResumeCollisions(const ObjectRegistry &objects)
+{
+    resumed.clear();
+    resumed.swap(collisions);
+    for (auto &collision : resumed) {
+        if (!IsCurrent(collision.task, collision.generation))
+            continue;
+        TaskState &state = tasks[collision.task];
+        std::function<void(GameObject *)> &onCollision = state.task.steps[state.next - 1].onCollision;
+        GameObject *other = objects.Get(collision.other);
+        if (onCollision && other != nullptr && objects.Get(state.owner) != nullptr) {
+            state.active = true;
+            onCollision(other);
+            state.active = false;
+        }
+        if (state.stopped)
+            Free(collision.task);
+        else
+            Run(collision.task, objects);
+    }
+}
@@ -0,0 +1,140 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <cstdint>
+#include <functional>
+#include "objectregistry.h"
+#include "updatescheduler.h"
+
+#define TASK_NULL_INDEX 0xFFFFFFFF
+
+namespace engine
+{
+    class GameObject;
+
+    // refers to a started task; stale once the task finished or was stopped
+    struct TaskHandle {
+        uint32_t index = TASK_NULL_INDEX;
+        uint32_t generation = 0;
+
+        bool IsNull() const { return index == TASK_NULL_INDEX; }
+    };
+
+    // A script for an object, as a sequence of actions and waits: what a coroutine would
+    // be, without the C++20 coroutines this project can't use. It's built with chained
+    // calls, then started with ControlledScene3D::StartTask, e.g.
+    //     StartTask(Task(door).WaitForCollision().Do(open).WaitSeconds(2).Do(close).Loop());
+    // Actions run on the main thread, after the ticks of a step (or after the frame's
+    // updates, for frame waits), so they can touch any object of the scene.
+    class Task
+    {
+        friend class TaskScheduler;
+    public:
+        explicit Task(GameObject *owner) : owner(owner) {}
+
+        Task &Do(std::function<void()> action);
+        // seconds of simulated time, in the owner's clock (see GameObject::useUnscaledTime);
+        // 0 waits for the next step
+        Task &WaitSeconds(float seconds);
+        // rendered frames; 0 waits for the next one
+        Task &WaitFrames(int frames);
+        // checked right away, then once per step until it's true
+        Task &WaitUntil(std::function<bool()> condition);
+        // until the owner's next OnCollisionEnter, which gets the other object
+        Task &WaitForCollision(std::function<void(GameObject *)> onCollision = nullptr);
+        // back to the first step once the last one is done, on the next step
+        Task &Loop();
+
+    private:
+        enum StepType { TASK_ACTION, TASK_SECONDS, TASK_FRAMES, TASK_CONDITION, TASK_COLLISION };
+        struct Step {
+            StepType type;
+            float seconds = 0;
+            int frames = 0;
+            std::function<void()> action;
+            std::function<bool()> condition;
+            std::function<void(GameObject *)> onCollision;
+        };
+
+        GameObject *owner;
+        std::vector<Step> steps;
+        bool loop = false;
+    };
+
+    // Runs the tasks of a scene. A waiting task costs nothing until it's due: timers wait
+    // in a heap per clock, frame waits in a heap of frame numbers, collision waits in a
+    // list per object that only the object's enter events look at. Only conditions have to
+    // be polled, once per step. Tasks stop with their owner, when it's destroyed.
+    class TaskScheduler
+    {
+    public:
+        // runs the task until its first wait; its owner must be in the scene
+        TaskHandle Start(Task &&task, const ObjectRegistry &objects);
+        void Stop(TaskHandle handle);
+        bool IsRunning(TaskHandle handle) const;
+        // stops the tasks waiting for a collision of the object, as it's going away; the
+        // other ones find out when they are due
+        void Remove(GameObject *gameObject);
+
+        // resumes the timers due at the clocks' times, then the true conditions
+        void Step(const ObjectRegistry &objects, double scaledTime, double unscaledTime);
+        // counts a rendered frame and resumes the frame waits that are due
+        void Frame(const ObjectRegistry &objects);
+        // called for the enter events of objects with collision waits; the tasks are
+        // resumed by ResumeCollisions, once the events are dispatched
+        void OnCollisionEnter(GameObject *gameObject, GameObject *other);
+        void ResumeCollisions(const ObjectRegistry &objects);
+
+        size_t Size() const { return running; }
+
+    private:
+        struct TaskState {
+            Task task;
+            size_t next = 0;  // step to run when resumed
+            uint32_t generation = 0;
+            ObjectHandle owner;
+            bool used = false;
+            bool active = false;  // running its actions, it is freed once they are done
+            bool stopped = false;
+            // in the list of collision waits of that object, while waiting for one
+            GameObject *waitingOn = nullptr;
+            uint32_t previousWaiter = TASK_NULL_INDEX;
+            uint32_t nextWaiter = TASK_NULL_INDEX;
+            uint32_t nextFree = TASK_NULL_INDEX;
+
+            TaskState() : task(nullptr) {}
+        };
+        struct Wait {
+            double time;  // or frame
+            uint32_t task;
+            uint32_t generation;
+        };
+        struct Collision {
+            uint32_t task;
+            uint32_t generation;
+            ObjectHandle other;
+        };
+
+        // runs the actions from the next step until a wait, or the end
+        void Run(uint32_t index, const ObjectRegistry &objects);
+        void Free(uint32_t index);
+        void Unlink(uint32_t index);
+        void Push(std::vector<Wait> &heap, double time, uint32_t index);
+        // the entries of the heap due at time, in order
+        void PopDue(std::vector<Wait> &heap, double time, std::vector<Wait> &due);
+        bool IsCurrent(uint32_t index, uint32_t generation) const;
+
+        std::deque<TaskState> tasks;  // stable, as actions run while tasks are started
+        uint32_t freeTasks = TASK_NULL_INDEX;  // head of the free slot list
+        size_t running = 0;
+
+        std::vector<Wait> timers[2];  // min-heaps, scaled and unscaled clock
+        std::vector<Wait> frameWaits;  // min-heap of frame numbers
+        std::vector<Wait> conditions;  // polled every step
+        std::vector<Collision> collisions;  // of the step's enter events
+        double clocks[2] = { 0, 0 };
+        uint64_t frame = 0;
+        std::vector<Wait> due, polled;  // reused
+        std::vector<Collision> resumed;  // reused
+    };
+}
@@ -52,4 +52,12 @@ glm::mat4 transform::RotateOZ(float radians)
     return transform::Rotate(glm::angleAxis(radians, glm::vec3(0, 0, 1)));
 }
 
-
+glm::mat4 transform::TRS(glm::vec3 translation, glm::quat rotation, glm::vec3 scale)
+{
+    glm::mat4 matrix = glm::mat4_cast(rotation);
+    matrix[0] *= scale.x;
+    matrix[1] *= scale.y;
+    matrix[2] *= scale.z;
+    matrix[3] = glm::vec4(translation, 1);
+    return matrix;
+}
@@ -12,4 +12,6 @@ namespace engine::transform
     glm::mat4 RotateOX(float radians);
     glm::mat4 RotateOY(float radians);
     glm::mat4 RotateOZ(float radians);
+    // Translate(translation) * Rotate(rotation) * Scale(scale), without the two products
+    glm::mat4 TRS(glm::vec3 translation, glm::quat rotation, glm::vec3 scale);
 }
\ No newline at end of file
@@ -0,0 +1,221 @@
+#include <cstring>
+#include <type_traits>
+#include "transformstore.h"
+#include "gameobject3d.h"
+#include "transform3d.h"
+#include "jobsystem.h"
+
+#define TRANSFORM_PARALLEL_LEVEL_SIZE 1024  // smaller levels aren't worth splitting
+#define TRANSFORM_BATCH_SIZE 256
+
+using namespace engine;
+
+void TransformStore::Add(GameObject *gameObject)
+{
+    if (gameObject->transformStore != nullptr)
+        return;
+
+    // resolve it with its current storage before moving it in
+    gameObject->UpdateTransform();
+
+    int slot = (int)owners.size();
+    owners.push_back(gameObject);
+    GameObject *parent = gameObject->parent;
+    parents.push_back(parent != nullptr && parent->transformStore == this ? parent->transformSlot : -1);
+    dirty.push_back(0);
+    changed.push_back(0);
+    localPositions.push_back(gameObject->localPosition);
+    localRotations.push_back(gameObject->localRotation);
+    localScales.push_back(gameObject->localScale);
+    positions.push_back(gameObject->position);
+    rotations.push_back(gameObject->rotation);
+    pseudoScales.push_back(gameObject->pseudoScale);
+    matrices.push_back(gameObject->objectToWorldMatrix);
+
+    gameObject->transformStore = this;
+    gameObject->transformSlot = slot;
+
+    // children that were added before their parent
+    for (auto child : gameObject->children) {
+        if (child->transformStore == this)
+            parents[child->transformSlot] = slot;
+    }
+    orderDirty = true;
+}
+
+void TransformStore::Remove(GameObject *gameObject)
+{
+    if (gameObject->transformStore != this)
+        return;
+
+    // a child can't stay without its parent, as its slot is resolved from the parent's
+    int slot = gameObject->transformSlot;
+    Resolve(slot);
+    for (auto child : gameObject->children)
+        Remove(child);
+
+    // hand the (resolved) transform back to the object's own fields
+    gameObject->localPosition = localPositions[slot];
+    gameObject->localRotation = localRotations[slot];
+    gameObject->localScale = localScales[slot];
+    gameObject->position = positions[slot];
+    gameObject->rotation = rotations[slot];
+    gameObject->pseudoScale = pseudoScales[slot];
+    gameObject->objectToWorldMatrix = matrices[slot];
+    gameObject->transformDirty = false;
+    gameObject->transformStore = nullptr;
+    gameObject->transformSlot = -1;
+
+    owners[slot] = nullptr;
+    orderDirty = true;
+}
+
+void TransformStore::UpdateParent(GameObject *gameObject)
+{
+    GameObject *parent = gameObject->parent;
+    int slot = gameObject->transformSlot;
+    parents[slot] = parent != nullptr && parent->transformStore == this ? parent->transformSlot : -1;
+    dirty[slot] = 1;
+    orderDirty = true;
+}
+
+void TransformStore::Compute(int slot)
+{
+    int parent = parents[slot];
+    if (owners[slot]->fixedRotation) {
+        // the world rotation is kept, the local one follows the parent
+        localRotations[slot] = parent < 0 ? rotations[slot] : glm::inverse(rotations[parent]) * rotations[slot];
+    } else {
+        rotations[slot] = parent < 0 ? localRotations[slot] : rotations[parent] * localRotations[slot];
+    }
+
+    glm::mat4 local = transform::TRS(localPositions[slot], localRotations[slot], localScales[slot]);
+    if (parent < 0) {
+        positions[slot] = localPositions[slot];
+        pseudoScales[slot] = localScales[slot];
+        matrices[slot] = local;
+    } else {
+        pseudoScales[slot] = localScales[slot] * pseudoScales[parent];
+        positions[slot] = positions[parent] + rotations[parent] * (pseudoScales[parent] * localPositions[slot]);
+        matrices[slot] = matrices[parent] * local;
+    }
+}
+
+void TransformStore::MarkChildrenDirty(int slot)
+{
+    for (auto child : owners[slot]->children) {
+        if (child->transformStore == this)
+            dirty[child->transformSlot] = 1;
+    }
+}
+
+bool TransformStore::ResolveChain(int slot)
+{
+    bool parentChanged = parents[slot] >= 0 && ResolveChain(parents[slot]);
+    if (!parentChanged && !dirty[slot])
+        return false;
+
+    Compute(slot);
+    dirty[slot] = 0;
+    changed[slot] = 1;
+    // only this chain is resolved; its siblings find out through their own flags
+    MarkChildrenDirty(slot);
+    owners[slot]->OnTransformResolved();
+    return true;
+}
+
+void TransformStore::Resolve(int slot)
+{
+    ResolveChain(slot);
+}
+
+void TransformStore::ResolveAll()
+{
+    if (orderDirty)
+        Rebuild();
+
+    // levels in order; within a level the slots are independent
+    auto resolveRange = [this](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            int parent = parents[i];
+            if (!dirty[i] && (parent < 0 || !changed[parent]))
+                continue;
+            Compute((int)i);
+            dirty[i] = 0;
+            changed[i] = 2;
+        }
+    };
+    for (size_t level = 0; level + 1 < levelStarts.size(); ++level) {
+        size_t begin = levelStarts[level], end = levelStarts[level + 1];
+        if (end - begin < TRANSFORM_PARALLEL_LEVEL_SIZE) {
+            resolveRange(begin, end);
+        } else {
+            JobSystem::ParallelFor(end - begin, TRANSFORM_BATCH_SIZE, [&](size_t first, size_t last) {
+                resolveRange(begin + first, begin + last);
+            });
+        }
+    }
+
+    // notify the owners on this thread, as they update the scene tree
+    for (size_t i = 0; i < owners.size(); ++i) {
+        if (changed[i] == 2)
+            owners[i]->OnTransformResolved();
+    }
+    if (!changed.empty())
+        memset(changed.data(), 0, changed.size());
+}
+
+void TransformStore::Rebuild()
+{
+    // breadth first from the roots: parents before children, one level at a time
+    std::vector<int> order;
+    order.reserve(owners.size());
+    levelStarts.clear();
+    levelStarts.push_back(0);
+    for (size_t i = 0; i < owners.size(); ++i) {
+        if (owners[i] != nullptr && parents[i] < 0)
+            order.push_back((int)i);
+    }
+    size_t levelBegin = 0;
+    while (levelBegin < order.size()) {
+        size_t levelEnd = order.size();
+        levelStarts.push_back(levelEnd);
+        for (size_t k = levelBegin; k < levelEnd; ++k) {
+            for (auto child : owners[order[k]]->children) {
+                if (child->transformStore == this)
+                    order.push_back(child->transformSlot);
+            }
+        }
+        levelBegin = levelEnd;
+    }
+
+    std::vector<int> newSlots(owners.size(), -1);
+    for (size_t k = 0; k < order.size(); ++k)
+        newSlots[order[k]] = (int)k;
+
+    auto permute = [&order](auto &array) {
+        typename std::remove_reference<decltype(array)>::type sorted;
+        sorted.reserve(order.size());
+        for (int slot : order)
+            sorted.push_back(array[slot]);
+        array.swap(sorted);
+    };
+    permute(owners);
+    permute(parents);
+    permute(dirty);
+    permute(changed);
+    permute(localPositions);
+    permute(localRotations);
+    permute(localScales);
+    permute(positions);
+    permute(rotations);
+    permute(pseudoScales);
+    permute(matrices);
+
+    for (size_t k = 0; k < owners.size(); ++k) {
+        owners[k]->transformSlot = (int)k;
+        if (parents[k] >= 0)
+            parents[k] = newSlots[parents[k]];
+    }
+    orderDirty = false;
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include "utils/glm_utils.h"
+
+namespace engine
+{
+    class GameObject;
+
+    // Optional structure-of-arrays storage for the transforms of a scene's objects
+    // (see ControlledScene3D::useTransformStore). While an object has a slot here, its
+    // transform accessors read and write these arrays instead of its own fields.
+    //
+    // Slots are kept sorted by hierarchy depth, so parents always precede their children
+    // and every depth level is contiguous: ResolveAll is then a single forward loop over
+    // the arrays, and each level can be split across the job system. Structural changes
+    // (adding, removing, reparenting) only flag the order, which is rebuilt lazily.
+    class TransformStore
+    {
+    public:
+        void Add(GameObject *gameObject);
+        // removes the object and its descendants, their transforms go back to their fields
+        void Remove(GameObject *gameObject);
+        // called after the parent of an object with a slot changed
+        void UpdateParent(GameObject *gameObject);
+
+        void MarkDirty(int slot) { dirty[slot] = 1; }
+        // resolves a single slot (and its dirty ancestors) on demand
+        void Resolve(int slot);
+        // resolves every dirty slot and its descendants, then notifies the owners
+        void ResolveAll();
+
+        size_t Size() const { return owners.size(); }
+
+        // local transform, written by the setters
+        std::vector<glm::vec3> localPositions;
+        std::vector<glm::quat> localRotations;
+        std::vector<glm::vec3> localScales;
+        // world transform, computed by the resolve functions
+        std::vector<glm::vec3> positions;
+        std::vector<glm::quat> rotations;
+        std::vector<glm::vec3> pseudoScales;
+        std::vector<glm::mat4> matrices;
+
+    private:
+        bool ResolveChain(int slot);
+        void Compute(int slot);
+        void MarkChildrenDirty(int slot);
+        void Rebuild();
+
+        std::vector<GameObject *> owners;  // nullptr for removed slots, until the next rebuild
+        std::vector<int> parents;  // -1 for roots
+        std::vector<uint8_t> dirty;
+        // set when a slot is resolved, so that its children follow in the same pass:
+        // 1 if resolved on demand (the owner was notified already), 2 if by ResolveAll
+        std::vector<uint8_t> changed;
+        std::vector<size_t> levelStarts;  // first slot of each depth level, plus the end
+        bool orderDirty = false;
+    };
+}
@@ -0,0 +1,294 @@
+#include <algorithm>
+#include "trianglebvh.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+    #include <emmintrin.h>
+    #define WIST_BVH_SSE
+#endif
+
+using namespace engine;
+
+namespace
+{
+    float Area(const AABB &box)
+    {
+        if (box.IsEmpty())
+            return 0;
+        glm::vec3 size = box.max - box.min;
+        return size.x * size.y + size.y * size.z + size.z * size.x;
+    }
+
+    // ray data for the slab tests, precomputed once per ray
+    struct Ray {
+        glm::vec3 origin, direction, invDirection;
+#if defined(WIST_BVH_SSE)
+        __m128 origin4, invDirection4, mask3;
+#endif
+
+        Ray(glm::vec3 origin, glm::vec3 direction)
+            : origin(origin), direction(direction), invDirection(1.0f / direction)
+        {
+#if defined(WIST_BVH_SSE)
+            origin4 = _mm_setr_ps(origin.x, origin.y, origin.z, 0);
+            invDirection4 = _mm_setr_ps(invDirection.x, invDirection.y, invDirection.z, 0);
+            mask3 = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+#endif
+        }
+
+        // entry distance into the box, or -1 if the ray misses it before maxDistance;
+        // min and max are followed by 4 more bytes, which the SSE loads pick up and ignore
+        float BoxDistance(const glm::vec3 &min, const glm::vec3 &max, float maxDistance) const
+        {
+#if defined(WIST_BVH_SSE)
+            __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&min.x), origin4), invDirection4);
+            __m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&max.x), origin4), invDirection4);
+            // the 4th lane becomes [0, maxDistance]
+            __m128 tMin = _mm_and_ps(_mm_min_ps(t1, t2), mask3);
+            __m128 tMax = _mm_or_ps(_mm_and_ps(_mm_max_ps(t1, t2), mask3),
+                                    _mm_andnot_ps(mask3, _mm_set1_ps(maxDistance)));
+            tMin = _mm_max_ps(tMin, _mm_shuffle_ps(tMin, tMin, _MM_SHUFFLE(1, 0, 3, 2)));
+            tMin = _mm_max_ps(tMin, _mm_shuffle_ps(tMin, tMin, _MM_SHUFFLE(2, 3, 0, 1)));
+            tMax = _mm_min_ps(tMax, _mm_shuffle_ps(tMax, tMax, _MM_SHUFFLE(1, 0, 3, 2)));
+            tMax = _mm_min_ps(tMax, _mm_shuffle_ps(tMax, tMax, _MM_SHUFFLE(2, 3, 0, 1)));
+            float enter = _mm_cvtss_f32(tMin), exit = _mm_cvtss_f32(tMax);
+#else
+            glm::vec3 t1 = (min - origin) * invDirection;
+            glm::vec3 t2 = (max - origin) * invDirection;
+            glm::vec3 tMin = glm::min(t1, t2), tMax = glm::max(t1, t2);
+            float enter = glm::max(glm::max(tMin.x, tMin.y), glm::max(tMin.z, 0.0f));
+            float exit = glm::min(glm::min(tMax.x, tMax.y), glm::min(tMax.z, maxDistance));
+#endif
+            return enter <= exit ? enter : -1;
+        }
+    };
+}
+
+void TriangleBVH::Build(const glm::vec3 *positions, size_t positionCount, size_t stride,
+                        const unsigned int *indices, size_t indexCount)
+{
+    static_assert(sizeof(Node) == 32, "BVH nodes must stay 32 bytes");
+    nodes.clear();
+    triangles.clear();
+    triangleIndices.clear();
+
+    const char *data = reinterpret_cast<const char *>(positions);
+    auto position = [&](unsigned int index) {
+        return *reinterpret_cast<const glm::vec3 *>(data + index * stride);
+    };
+
+    std::vector<BuildTriangle> build;
+    build.reserve(indexCount / 3);
+    for (size_t i = 0; i + 2 < indexCount; i += 3) {
+        if (indices[i] >= positionCount || indices[i + 1] >= positionCount || indices[i + 2] >= positionCount)
+            continue;
+        BuildTriangle triangle;
+        triangle.bounds.Expand(position(indices[i]));
+        triangle.bounds.Expand(position(indices[i + 1]));
+        triangle.bounds.Expand(position(indices[i + 2]));
+        triangle.centroid = triangle.bounds.Center();
+        triangle.index = (uint32_t)(i / 3);
+        build.push_back(triangle);
+    }
+    if (build.empty())
+        return;
+
+    // a binary tree with leaves of at least one triangle has fewer than 2n nodes
+    nodes.reserve(2 * build.size());
+    nodes.push_back(Node());
+    nodes[0].leftOrFirst = 0;
+    nodes[0].count = (uint32_t)build.size();
+    Subdivide(0, build);
+
+    triangles.reserve(build.size());
+    triangleIndices.reserve(build.size());
+    for (auto &triangle : build) {
+        glm::vec3 v0 = position(indices[3 * triangle.index]);
+        glm::vec3 v1 = position(indices[3 * triangle.index + 1]);
+        glm::vec3 v2 = position(indices[3 * triangle.index + 2]);
+        triangles.push_back({ v0, v1 - v0, v2 - v0 });
+        triangleIndices.push_back(triangle.index);
+    }
+}
+
+void TriangleBVH::Subdivide(uint32_t nodeIndex, std::vector<BuildTriangle> &build)
+{
+    uint32_t first = nodes[nodeIndex].leftOrFirst, count = nodes[nodeIndex].count;
+    AABB bounds, centroids;
+    for (uint32_t i = first; i < first + count; ++i) {
+        bounds.Expand(build[i].bounds);
+        centroids.Expand(build[i].centroid);
+    }
+    nodes[nodeIndex].min = bounds.min;
+    nodes[nodeIndex].max = bounds.max;
+    if (count <= 1)
+        return;
+
+    // binned SAH: the split planes are the bin boundaries along each axis, and the best
+    // one minimizes the surface area of each side times its triangle count, plus the
+    // cost of visiting the node; costs are all scaled by the surface area
+    struct Bin {
+        AABB bounds;
+        uint32_t count = 0;
+    };
+    float bestCost = count * Area(bounds);
+    int bestAxis = -1, bestSplit = 0;
+    for (int axis = 0; axis < 3; ++axis) {
+        float low = centroids.min[axis], extent = centroids.max[axis] - low;
+        if (extent <= 0)
+            continue;
+        float scale = BVH_BINS / extent;
+
+        Bin bins[BVH_BINS];
+        for (uint32_t i = first; i < first + count; ++i) {
+            int bin = std::min(BVH_BINS - 1, (int)((build[i].centroid[axis] - low) * scale));
+            bins[bin].bounds.Expand(build[i].bounds);
+            ++bins[bin].count;
+        }
+
+        // the left side of every plane in one sweep, the right side in the other
+        float leftCost[BVH_BINS - 1];
+        AABB side;
+        uint32_t sideCount = 0;
+        for (int plane = 0; plane < BVH_BINS - 1; ++plane) {
+            side.Expand(bins[plane].bounds);
+            sideCount += bins[plane].count;
+            leftCost[plane] = sideCount * Area(side);
+        }
+        side = AABB();
+        sideCount = 0;
+        for (int plane = BVH_BINS - 2; plane >= 0; --plane) {
+            side.Expand(bins[plane + 1].bounds);
+            sideCount += bins[plane + 1].count;
+            float cost = BVH_TRAVERSAL_COST * Area(bounds) + leftCost[plane] + sideCount * Area(side);
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = plane;
+            }
+        }
+    }
+
+    // a leaf is cheaper, unless it would be too big
+    if (bestAxis < 0 && count <= BVH_MAX_LEAF_SIZE)
+        return;
+    uint32_t leftCount;
+    if (bestAxis >= 0) {
+        float low = centroids.min[bestAxis];
+        float scale = BVH_BINS / (centroids.max[bestAxis] - low);
+        auto middle = std::partition(build.begin() + first, build.begin() + first + count,
+                                     [&](const BuildTriangle &triangle) {
+            return std::min(BVH_BINS - 1, (int)((triangle.centroid[bestAxis] - low) * scale)) <= bestSplit;
+        });
+        leftCount = (uint32_t)(middle - build.begin()) - first;
+    } else {
+        // a leaf would be too big, but no plane is worth it (or the centroids are all in
+        // one point): split in halves
+        leftCount = count / 2;
+    }
+    if (leftCount == 0 || leftCount == count)
+        leftCount = count / 2;
+
+    uint32_t left = (uint32_t)nodes.size();
+    nodes.push_back(Node());
+    nodes.push_back(Node());
+    nodes[left].leftOrFirst = first;
+    nodes[left].count = leftCount;
+    nodes[left + 1].leftOrFirst = first + leftCount;
+    nodes[left + 1].count = count - leftCount;
+    nodes[nodeIndex].leftOrFirst = left;
+    nodes[nodeIndex].count = 0;
+    Subdivide(left, build);
+    Subdivide(left + 1, build);
+}
+
+template <typename Callback>
+void TriangleBVH::Traverse(glm::vec3 origin, glm::vec3 direction, float maxDistance, Callback hit) const
+{
+    if (nodes.empty())
+        return;
+
+    Ray ray(origin, direction);
+    if (ray.BoxDistance(nodes[0].min, nodes[0].max, maxDistance) < 0)
+        return;
+
+    uint32_t stack[BVH_STACK_SIZE];
+    int size = 0;
+    stack[size++] = 0;
+    while (size > 0) {
+        const Node &node = nodes[stack[--size]];
+        if (node.count > 0) {
+            // Moller-Trumbore, two-sided
+            for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i) {
+                const Triangle &triangle = triangles[i];
+                glm::vec3 p = glm::cross(direction, triangle.e2);
+                float determinant = glm::dot(triangle.e1, p);
+                if (determinant == 0)
+                    continue;
+                float inverse = 1.0f / determinant;
+                glm::vec3 s = origin - triangle.v0;
+                float u = glm::dot(s, p) * inverse;
+                if (u < 0 || u > 1)
+                    continue;
+                glm::vec3 q = glm::cross(s, triangle.e1);
+                float v = glm::dot(direction, q) * inverse;
+                if (v < 0 || u + v > 1)
+                    continue;
+                float t = glm::dot(triangle.e2, q) * inverse;
+                if (t >= 0 && t <= maxDistance)
+                    maxDistance = hit(i, t, u, v);
+            }
+            continue;
+        }
+
+        // nearest child first; the farther one is often culled by then
+        const Node &left = nodes[node.leftOrFirst], &right = nodes[node.leftOrFirst + 1];
+        float leftDistance = ray.BoxDistance(left.min, left.max, maxDistance);
+        float rightDistance = ray.BoxDistance(right.min, right.max, maxDistance);
+        uint32_t near = node.leftOrFirst, far = node.leftOrFirst + 1;
+        if (rightDistance >= 0 && (leftDistance < 0 || rightDistance < leftDistance)) {
+            std::swap(near, far);
+            std::swap(leftDistance, rightDistance);
+        }
+        // the tree is at most about 2 log n deep, far below the stack size
+        if (rightDistance >= 0 && size < BVH_STACK_SIZE)
+            stack[size++] = far;
+        if (leftDistance >= 0 && size < BVH_STACK_SIZE)
+            stack[size++] = near;
+    }
+}
+
+bool TriangleBVH::Raycast(glm::vec3 origin, glm::vec3 direction, float maxDistance, TriangleHit &hit) const
+{
+    int closest = -1;
+    Traverse(origin, direction, maxDistance, [&](uint32_t triangle, float t, float u, float v) {
+        closest = (int)triangle;
+        hit.distance = t;
+        hit.u = u;
+        hit.v = v;
+        return t;
+    });
+    if (closest < 0)
+        return false;
+
+    const Triangle &triangle = triangles[closest];
+    hit.triangle = triangleIndices[closest];
+    hit.normal = glm::normalize(glm::cross(triangle.e1, triangle.e2));
+    if (glm::dot(hit.normal, direction) > 0)
+        hit.normal = -hit.normal;
+    return true;
+}
+
+bool TriangleBVH::Contains(glm::vec3 point) const
+{
+    // a ray from inside a closed mesh crosses it an odd number of times; the direction
+    // is skewed so that it doesn't run along the edges of axis aligned geometry
+    if (nodes.empty() || !GetBounds().Contains(point))
+        return false;
+    int crossings = 0;
+    float maxDistance = 2 * glm::length(nodes[0].max - nodes[0].min) + 1;
+    Traverse(point, glm::vec3(1, 0.0137f, 0.0091f), maxDistance, [&](uint32_t, float, float, float) {
+        ++crossings;
+        return maxDistance;
+    });
+    return (crossings & 1) != 0;
+}
@@ -0,0 +1,154 @@
+#include <algorithm>
+#include "updatescheduler.h"
+#include "gameobject3d.h"
+
+using namespace engine;
+
+namespace
+{
+    // std heaps are max-heaps; ties go to the lower handle index, so the order is stable
+    struct LaterTimer {
+        template <typename Timer>
+        bool operator()(const Timer &a, const Timer &b) const
+        {
+            return a.time != b.time ? a.time > b.time : a.handle.index > b.handle.index;
+        }
+    };
+}
+
+void UpdateScheduler::Add(GameObject *gameObject)
+{
+    Refresh(gameObject);
+}
+
+void UpdateScheduler::Remove(GameObject *gameObject)
+{
+    ++gameObject->updateVersion;  // its timers are stale now
+    if (gameObject->updateSlot >= 0)
+        RemoveSlot(gameObject->updateList, gameObject->updateSlot);
+}
+
+void UpdateScheduler::Refresh(GameObject *gameObject)
+{
+    Remove(gameObject);
+
+    UpdateMode mode = gameObject->updateMode;
+    if (gameObject->sleeping) {
+        if (gameObject->sleepDuration > 0)
+            Push(gameObject, GetTime(gameObject->useUnscaledTime) + gameObject->sleepDuration);
+        return;
+    }
+    if (mode == UPDATE_FIXED || mode == UPDATE_FRAME) {
+        int list = mode == UPDATE_FIXED ? 0 : 1;
+        gameObject->updateList = list;
+        gameObject->updateSlot = (int)lists[list].size();
+        lists[list].push_back(gameObject);
+    } else if (mode == UPDATE_TIMER) {
+        double time = GetTime(gameObject->useUnscaledTime);
+        gameObject->lastUpdateTime = time;
+        Push(gameObject, time + gameObject->updateInterval);
+    }
+}
+
+void UpdateScheduler::Push(GameObject *gameObject, double time)
+{
+    std::vector<Timer> &heap = timers[gameObject->useUnscaledTime ? 1 : 0];
+    heap.push_back({ time, gameObject->handle, gameObject->updateVersion });
+    std::push_heap(heap.begin(), heap.end(), LaterTimer());
+}
+
+void UpdateScheduler::RemoveSlot(int list, int slot)
+{
+    std::vector<GameObject *> &objects = lists[list];
+    objects[slot]->updateSlot = -1;
+    objects[slot]->updateList = -1;
+
+    // the last object takes its place; the order doesn't matter, updates are sorted
+    objects[slot] = objects.back();
+    if ((size_t)slot + 1 < objects.size())
+        objects[slot]->updateSlot = slot;
+    objects.pop_back();
+}
+
+void UpdateScheduler::Step(const ObjectRegistry &objects, float scaledStep, float unscaledStep,
+                           std::vector<ScheduledUpdate> &updates, std::vector<size_t> &groups)
+{
+    clocks[0] += scaledStep;
+    clocks[1] += unscaledStep;
+
+    // the due entries are taken out first, as running them pushes new ones
+    due.clear();
+    for (int clock = 0; clock < 2; ++clock) {
+        std::vector<Timer> &heap = timers[clock];
+        while (!heap.empty() && heap.front().time <= clocks[clock] + UPDATE_TIME_EPSILON) {
+            std::pop_heap(heap.begin(), heap.end(), LaterTimer());
+            due.push_back(heap.back());
+            heap.pop_back();
+        }
+    }
+
+    updates.clear();
+    for (auto &timer : due) {
+        GameObject *gameObject = objects.Get(timer.handle);
+        if (gameObject == nullptr || gameObject->updateVersion != timer.version)
+            continue;
+        if (gameObject->sleeping) {
+            // the end of a timed sleep; fixed updaters tick in this very step
+            gameObject->sleeping = false;
+            gameObject->sleepDuration = 0;
+            Refresh(gameObject);
+            continue;
+        }
+
+        // a due timer; late ones don't catch up, they just get a longer delta time
+        double time = GetTime(gameObject->useUnscaledTime);
+        double next = std::max(timer.time + gameObject->updateInterval, time);
+        Schedule(gameObject, (float)(time - gameObject->lastUpdateTime), updates);
+        gameObject->lastUpdateTime = time;
+        Push(gameObject, next);
+    }
+    for (auto gameObject : lists[0])
+        Schedule(gameObject, gameObject->useUnscaledTime ? unscaledStep : scaledStep, updates);
+    Sort(updates);
+
+    groups.clear();
+    for (size_t i = 0; i < updates.size(); ++i) {
+        if (i == 0 || updates[i].root != updates[i - 1].root)
+            groups.push_back(i);
+    }
+    groups.push_back(updates.size());
+}
+
+void UpdateScheduler::CollectFrame(float scaledDeltaTime, float unscaledDeltaTime,
+                                   std::vector<ScheduledUpdate> &updates)
+{
+    updates.clear();
+    for (auto gameObject : lists[1])
+        Schedule(gameObject, gameObject->useUnscaledTime ? unscaledDeltaTime : scaledDeltaTime, updates);
+    Sort(updates);
+}
+
+void UpdateScheduler::Schedule(GameObject *gameObject, float deltaTime, std::vector<ScheduledUpdate> &updates)
+{
+    // inactive objects keep their place, they just don't tick
+    uint32_t depth = 0;
+    GameObject *root = gameObject;
+    for (; root->parent != nullptr && root->parent->scene == root->scene; root = root->parent) {
+        if (!root->active)
+            return;
+        ++depth;
+    }
+    if (!root->active)
+        return;
+    updates.push_back({ gameObject, deltaTime, root->handle.index, depth, gameObject->handle.index });
+}
+
+void UpdateScheduler::Sort(std::vector<ScheduledUpdate> &updates)
+{
+    // parents before their children, and the same order whatever the lists look like
+    std::sort(updates.begin(), updates.end(), [](const ScheduledUpdate &a, const ScheduledUpdate &b) {
+        if (a.root != b.root)
+            return a.root < b.root;
+        return a.depth != b.depth ? a.depth < b.depth : a.index < b.index;
+    });
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include "objectregistry.h"
+
+#define UPDATE_TIME_EPSILON 1e-6  // timers due this close to the clock run in this step
+
+namespace engine
+{
+    class GameObject;
+
+    // how often an object's Tick is called, see GameObject::SetUpdateMode
+    enum UpdateMode {
+        UPDATE_NONE,  // never: the object only moves, collides and renders
+        UPDATE_FIXED,  // on every simulation step, with the fixed step
+        UPDATE_FRAME,  // once per frame after the simulation, with the frame's delta time
+        UPDATE_TIMER,  // every interval seconds of simulated time, with the time since the last one
+    };
+
+    // an object updating in the current step or frame, with the time it advances by
+    struct ScheduledUpdate {
+        GameObject *gameObject;
+        float deltaTime;
+        // hierarchy order: the handle index of the root, then the depth, then the handle index
+        uint32_t root;
+        uint32_t depth;
+        uint32_t index;
+    };
+
+    // Dense lists of the awake fixed and frame updaters of a scene, so that a step only
+    // visits the objects that actually update; objects that don't, or sleep, cost nothing.
+    // Timers and timed sleeps wait in a heap per clock (scaled and unscaled simulated time).
+    // Every change of mode or sleep bumps the object's version, so the heap entries it
+    // left behind are simply skipped.
+    class UpdateScheduler
+    {
+    public:
+        // registers an object of the scene, with its current mode and sleep
+        void Add(GameObject *gameObject);
+        void Remove(GameObject *gameObject);
+        // to be called after the mode, interval or sleep of a registered object changed
+        void Refresh(GameObject *gameObject);
+
+        // Advances the clocks by one simulation step, wakes the objects whose sleep ended,
+        // and lists the awake fixed updaters and the due timers of the step in hierarchy
+        // order; groups gets where each root hierarchy starts in updates, plus the end
+        void Step(const ObjectRegistry &objects, float scaledStep, float unscaledStep,
+                  std::vector<ScheduledUpdate> &updates, std::vector<size_t> &groups);
+        // the awake frame updaters, in hierarchy order
+        void CollectFrame(float scaledDeltaTime, float unscaledDeltaTime,
+                          std::vector<ScheduledUpdate> &updates);
+
+        // simulated time since the scene started, in seconds, scaled or not
+        double GetTime(bool unscaled) const { return clocks[unscaled ? 1 : 0]; }
+        size_t Size() const { return lists[0].size() + lists[1].size(); }
+
+    private:
+        struct Timer {
+            double time;
+            ObjectHandle handle;
+            uint32_t version;
+        };
+
+        void Push(GameObject *gameObject, double time);
+        void RemoveSlot(int list, int slot);
+        // appends the object with its place in hierarchy order, unless it's inactive
+        void Schedule(GameObject *gameObject, float deltaTime, std::vector<ScheduledUpdate> &updates);
+        void Sort(std::vector<ScheduledUpdate> &updates);
+
+        std::vector<GameObject *> lists[2];  // fixed, frame
+        std::vector<Timer> timers[2];  // min-heaps, scaled and unscaled clock
+        double clocks[2] = { 0, 0 };
+        std::vector<Timer> due;  // reused every step
+    };
+}